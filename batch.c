@@ -0,0 +1,196 @@
+/* Copyright (c) 2017 Unwired Devices LLC [info@unwds.com]
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+
+/**
+ * @defgroup    
+ * @ingroup     
+ * @brief       
+ * @{
+ * @file        batch.c
+ * @brief       Collects uplink messages into batches
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "batch.h"
+
+/* Room kept for " ]" closing the JSON array */
+#define CLOSE_LEN 2
+
+static uint64_t now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static bool is_binary(const batch_t *b)
+{
+    return b->format == UNWDS_MQTT_CBOR || b->format == UNWDS_MQTT_MSGPACK;
+}
+
+static void batch_reset(batch_t *b)
+{
+    b->items = 0;
+    if (is_binary(b)) {
+        packbuf_init(&b->pb, b->format == UNWDS_MQTT_CBOR ? PACKBUF_CBOR : PACKBUF_MSGPACK, b->buf, b->max_size);
+    } else {
+        textbuf_init(&b->tb, b->buf, b->max_size - CLOSE_LEN + 1);
+    }
+}
+
+bool batch_init(batch_t *b, mqtt_format_t format, unsigned interval_ms, unsigned max_items, size_t max_size,
+                batch_flush_cb_t flush)
+{
+    if (max_size <= CLOSE_LEN) {
+        return false;
+    }
+
+    b->format = format;
+    b->interval_ms = interval_ms;
+    b->max_items = max_items;
+    b->max_size = max_size;
+    b->flush = flush;
+
+    b->buf = (char *)malloc(max_size + 1);
+    if (!b->buf) {
+        return false;
+    }
+
+    if (pthread_mutex_init(&b->mutex, NULL)) {
+        return false;
+    }
+
+    batch_reset(b);
+    return true;
+}
+
+/* Appends the item, returns false and leaves the batch as it was if it doesn't fit */
+static bool append_item(batch_t *b, const char *topic, const char *msg, size_t len)
+{
+    if (is_binary(b)) {
+        size_t mark = packbuf_len(&b->pb);
+
+        packbuf_map(&b->pb, 2);
+        packbuf_string(&b->pb, "topic");
+        packbuf_string(&b->pb, topic);
+        packbuf_string(&b->pb, "message");
+        packbuf_raw(&b->pb, msg, len);
+
+        if (packbuf_overflow(&b->pb)) {
+            packbuf_truncate(&b->pb, mark);
+            return false;
+        }
+        return true;
+    }
+
+    size_t mark = b->tb.len;
+    bool escaped = (b->format == UNWDS_MQTT_ESCAPED);
+
+    /* Messages come escaped already, quotes around them are escaped here */
+    textbuf_append(&b->tb, b->items ? ", " : "[ ");
+    textbuf_append(&b->tb, escaped ? "{ \\\"topic\\\": \\\"" : "{ \"topic\": \"");
+    textbuf_append(&b->tb, topic);
+    textbuf_append(&b->tb, escaped ? "\\\", \\\"message\\\": " : "\", \"message\": ");
+    textbuf_append_n(&b->tb, msg, len);
+    textbuf_append(&b->tb, " }");
+
+    if (b->tb.overflow) {
+        textbuf_truncate(&b->tb, mark);
+        return false;
+    }
+    return true;
+}
+
+static void flush_locked(batch_t *b)
+{
+    if (!b->items) {
+        return;
+    }
+
+    if (is_binary(b)) {
+        b->flush(b->buf, packbuf_len(&b->pb));
+    } else {
+        /* Room for the closing bracket is kept by batch_reset() */
+        size_t len = b->tb.len;
+        memcpy(b->buf + len, " ]", CLOSE_LEN + 1);
+        len += CLOSE_LEN;
+
+        b->flush(b->buf, len);
+    }
+
+    batch_reset(b);
+}
+
+void batch_add(batch_t *b, const char *topic, const char *msg, size_t len)
+{
+    pthread_mutex_lock(&b->mutex);
+
+    if (!append_item(b, topic, msg, len)) {
+        flush_locked(b);
+        if (!append_item(b, topic, msg, len)) {
+            pthread_mutex_unlock(&b->mutex);
+            puts("[error] Message is larger than the batch size, left out of the batch");
+            return;
+        }
+    }
+
+    if (!b->items++) {
+        b->first_ms = now_ms();
+    }
+
+    if (b->items >= b->max_items) {
+        flush_locked(b);
+    }
+
+    pthread_mutex_unlock(&b->mutex);
+}
+
+unsigned batch_poll(batch_t *b)
+{
+    unsigned wait = b->interval_ms;
+
+    pthread_mutex_lock(&b->mutex);
+
+    if (b->items) {
+        uint64_t age = now_ms() - b->first_ms;
+        if (age >= b->interval_ms) {
+            flush_locked(b);
+        } else {
+            wait = b->interval_ms - age;
+        }
+    }
+
+    pthread_mutex_unlock(&b->mutex);
+
+    return wait;
+}
+
+void batch_flush(batch_t *b)
+{
+    pthread_mutex_lock(&b->mutex);
+    flush_locked(b);
+    pthread_mutex_unlock(&b->mutex);
+}
@@ -0,0 +1,250 @@
+/* Copyright (c) 2017 Unwired Devices LLC [info@unwds.com]
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+
+/**
+ * @defgroup    
+ * @ingroup     
+ * @brief       
+ * @{
+ * @file        capture.c
+ * @brief       Binary log of the raw gate traffic
+ */
+
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "capture.h"
+
+#define CAPTURE_MAGIC "LMQC"
+#define CAPTURE_VERSION 1
+#define CAPTURE_SYNC 0xFF
+
+static uint64_t monotonic_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static unsigned put_varint(uint8_t *buf, uint64_t val)
+{
+    unsigned n = 0;
+    while (val >= 0x80) {
+        buf[n++] = (val & 0x7F) | 0x80;
+        val >>= 7;
+    }
+    buf[n++] = val;
+    return n;
+}
+
+static bool get_varint(FILE *f, uint64_t *val)
+{
+    unsigned shift = 0;
+    *val = 0;
+
+    while (shift < 64) {
+        int c = getc(f);
+        if (c == EOF) {
+            return false;
+        }
+
+        *val |= (uint64_t)(c & 0x7F) << shift;
+        if (!(c & 0x80)) {
+            return true;
+        }
+        shift += 7;
+    }
+
+    return false;
+}
+
+static void capture_append(capture_t *cap, uint8_t flags, uint64_t delta, const struct iovec *iov, int iovcnt, unsigned len)
+{
+    uint8_t hdr[1 + 10 + 10];
+    unsigned hdrlen = 0;
+
+    hdr[hdrlen++] = flags;
+    hdrlen += put_varint(hdr + hdrlen, delta);
+    hdrlen += put_varint(hdr + hdrlen, len);
+
+    struct iovec out[3];
+    int outcnt = 0;
+    out[outcnt].iov_base = hdr;
+    out[outcnt++].iov_len = hdrlen;
+
+    /* Take no more than len bytes */
+    int i;
+    unsigned left = len;
+    for (i = 0; i < iovcnt && left && outcnt < 3; i++) {
+        unsigned n = (iov[i].iov_len < left) ? iov[i].iov_len : left;
+        out[outcnt].iov_base = iov[i].iov_base;
+        out[outcnt++].iov_len = n;
+        left -= n;
+    }
+
+    /* One writev per record keeps records whole with O_APPEND */
+    if (writev(cap->fd, out, outcnt) < 0) {
+        puts("[error] Unable to write gate traffic capture");
+    }
+}
+
+bool capture_open(capture_t *cap, const char *name)
+{
+    cap->fd = open(name, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (cap->fd < 0) {
+        printf("[error] Unable to open capture file %s: %s\n", name, strerror(errno));
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(cap->fd, &st) == 0 && st.st_size == 0) {
+        uint8_t hdr[5];
+        memcpy(hdr, CAPTURE_MAGIC, 4);
+        hdr[4] = CAPTURE_VERSION;
+        if (write(cap->fd, hdr, sizeof(hdr)) != sizeof(hdr)) {
+            printf("[error] Unable to write capture file %s: %s\n", name, strerror(errno));
+            close(cap->fd);
+            cap->fd = -1;
+            return false;
+        }
+    }
+
+    pthread_mutex_init(&cap->mutex, NULL);
+
+    /* Wall clock once, monotonic deltas after that */
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    uint64_t now = (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+
+    uint8_t data[8];
+    int i;
+    for (i = 0; i < 8; i++) {
+        data[i] = now >> (8 * i);
+    }
+
+    struct iovec iov = { .iov_base = data, .iov_len = sizeof(data) };
+    cap->last_us = monotonic_us();
+    capture_append(cap, CAPTURE_SYNC, 0, &iov, 1, sizeof(data));
+
+    return true;
+}
+
+void capture_writev(capture_t *cap, int dir, int gate, const struct iovec *iov, int iovcnt, unsigned len)
+{
+    if (cap->fd < 0 || len > CAPTURE_MAX_FRAME) {
+        return;
+    }
+
+    pthread_mutex_lock(&cap->mutex);
+
+    uint64_t now = monotonic_us();
+    capture_append(cap, (dir << 7) | (gate & 0x7F), now - cap->last_us, iov, iovcnt, len);
+    cap->last_us = now;
+
+    pthread_mutex_unlock(&cap->mutex);
+}
+
+void capture_write(capture_t *cap, int dir, int gate, const char *data, unsigned len)
+{
+    struct iovec iov = { .iov_base = (void *)data, .iov_len = len };
+    capture_writev(cap, dir, gate, &iov, 1, len);
+}
+
+bool capture_reader_open(capture_reader_t *r, const char *name)
+{
+    r->f = fopen(name, "rb");
+    if (!r->f) {
+        printf("[error] Unable to open capture file %s: %s\n", name, strerror(errno));
+        return false;
+    }
+
+    uint8_t hdr[5];
+    if (fread(hdr, 1, sizeof(hdr), r->f) != sizeof(hdr) ||
+        memcmp(hdr, CAPTURE_MAGIC, 4) || hdr[4] != CAPTURE_VERSION) {
+        printf("[error] %s is not a gate traffic capture\n", name);
+        fclose(r->f);
+        r->f = NULL;
+        return false;
+    }
+
+    r->time_us = 0;
+    r->sync = false;
+
+    return true;
+}
+
+int capture_read(capture_reader_t *r, capture_record_t *rec)
+{
+    while (1) {
+        int flags = getc(r->f);
+        if (flags == EOF) {
+            return 0;
+        }
+
+        uint64_t delta, len;
+        if (!get_varint(r->f, &delta) || !get_varint(r->f, &len) || len > CAPTURE_MAX_FRAME) {
+            return -1;
+        }
+
+        if (fread(rec->data, 1, len, r->f) != len) {
+            return -1;
+        }
+        rec->data[len] = '\0';
+
+        if (flags == CAPTURE_SYNC) {
+            if (len != 8) {
+                return -1;
+            }
+
+            int i;
+            r->time_us = 0;
+            for (i = 0; i < 8; i++) {
+                r->time_us |= (uint64_t)(uint8_t)rec->data[i] << (8 * i);
+            }
+            r->sync = true;
+            continue;
+        }
+
+        r->time_us += delta;
+
+        rec->dir = flags >> 7;
+        rec->gate = flags & 0x7F;
+        rec->time_us = r->time_us;
+        rec->sync = r->sync;
+        rec->len = len;
+
+        r->sync = false;
+        return 1;
+    }
+}
+
+void capture_reader_close(capture_reader_t *r)
+{
+    if (r->f) {
+        fclose(r->f);
+        r->f = NULL;
+    }
+}
@@ -0,0 +1,132 @@
+/* Copyright (c) 2017 Unwired Devices LLC [info@unwds.com]
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+/**
+ * @defgroup    
+ * @ingroup     
+ * @brief       
+ * @{
+ * @file        cmdq.c
+ * @brief       Queue of commands to the gate drained by the writer thread
+ */
+
+#include <stdio.h>
+#include <stdarg.h>
+
+#include "cmdq.h"
+
+bool cmdq_init(cmdq_t *q)
+{
+    ringbuf_init(&q->rb);
+    q->dropped = 0;
+
+    if (pthread_mutex_init(&q->mutex, NULL)) {
+        return false;
+    }
+
+    if (pthread_cond_init(&q->data_cond, NULL)) {
+        return false;
+    }
+
+    if (pthread_cond_init(&q->space_cond, NULL)) {
+        return false;
+    }
+
+    return true;
+}
+
+static bool cmdq_vprintf(cmdq_t *q, bool wait, const char *fmt, va_list args)
+{
+    char buf[CMDQ_MAX_CMD_LEN];
+
+    /* Format outside of the lock */
+    int len = vsnprintf(buf, sizeof(buf), fmt, args);
+    if (len < 0 || len >= sizeof(buf)) {
+        return false;
+    }
+
+    pthread_mutex_lock(&q->mutex);
+
+    while (ringbuf_free(&q->rb) < len) {
+        if (!wait) {
+            q->dropped++;
+            pthread_mutex_unlock(&q->mutex);
+
+            puts("[error] Gate command queue is full, command dropped");
+            return false;
+        }
+
+        pthread_cond_wait(&q->space_cond, &q->mutex);
+    }
+
+    ringbuf_write(&q->rb, buf, len);
+
+    pthread_cond_signal(&q->data_cond);
+    pthread_mutex_unlock(&q->mutex);
+
+    return true;
+}
+
+bool cmdq_printf(cmdq_t *q, const char *fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    bool res = cmdq_vprintf(q, false, fmt, args);
+    va_end(args);
+
+    return res;
+}
+
+bool cmdq_printf_wait(cmdq_t *q, const char *fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    bool res = cmdq_vprintf(q, true, fmt, args);
+    va_end(args);
+
+    return res;
+}
+
+int cmdq_wait(cmdq_t *q, struct iovec *iov)
+{
+    pthread_mutex_lock(&q->mutex);
+
+    while (ringbuf_used(&q->rb) == 0) {
+        pthread_cond_wait(&q->data_cond, &q->mutex);
+    }
+
+    /* Queued bytes don't move until consumed, so iovecs stay valid without the lock */
+    int iovcnt = ringbuf_peek(&q->rb, iov);
+
+    pthread_mutex_unlock(&q->mutex);
+
+    return iovcnt;
+}
+
+void cmdq_consume(cmdq_t *q, unsigned len)
+{
+    pthread_mutex_lock(&q->mutex);
+
+    ringbuf_consume(&q->rb, len);
+
+    pthread_cond_broadcast(&q->space_cond);
+    pthread_mutex_unlock(&q->mutex);
+}
@@ -0,0 +1,64 @@
+/* Copyright (c) 2017 Unwired Devices LLC [info@unwds.com]
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+/**
+ * @defgroup    
+ * @ingroup     
+ * @brief       
+ * @{
+ * @file        framectx.c
+ * @brief       Per-thread buffers for decoding and publishing a frame
+ */
+
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "framectx.h"
+
+static pthread_key_t ctx_key;
+static pthread_once_t ctx_once = PTHREAD_ONCE_INIT;
+
+static void ctx_key_init(void)
+{
+    pthread_key_create(&ctx_key, free);
+}
+
+frame_ctx_t *frame_ctx_get(void)
+{
+    pthread_once(&ctx_once, ctx_key_init);
+
+    frame_ctx_t *ctx = pthread_getspecific(ctx_key);
+    if (ctx) {
+        return ctx;
+    }
+
+    ctx = malloc(sizeof(frame_ctx_t));
+    if (!ctx) {
+        return NULL;
+    }
+
+    if (pthread_setspecific(ctx_key, ctx)) {
+        free(ctx);
+        return NULL;
+    }
+
+    return ctx;
+}
@@ -0,0 +1,194 @@
+/* Copyright (c) 2017 Unwired Devices LLC [info@unwds.com]
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+/**
+ * @defgroup    
+ * @ingroup     
+ * @brief       
+ * @{
+ * @file        frameq.c
+ * @brief       Bounded lock-free queue of gate frames between threads
+ */
+
+/*
+ * Bounded queue after Dmitry Vyukov: every slot carries a sequence number
+ * telling whether it is free for the producer taking position pos
+ * (seq == pos) or holds a frame for the consumer at position pos
+ * (seq == pos + 1). Consumer sleeps on eventfd only when the queue is empty,
+ * producers write to it only when the consumer is actually sleeping.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#include "frameq.h"
+
+bool frameq_init(frameq_t *q, unsigned num_slots)
+{
+    unsigned size = 1;
+    while (size < num_slots) {
+        size <<= 1;
+    }
+
+    q->slots = (frameq_slot_t *)malloc(size * sizeof(frameq_slot_t));
+    if (!q->slots) {
+        return false;
+    }
+
+    q->efd = eventfd(0, 0);
+    if (q->efd < 0) {
+        free(q->slots);
+        q->slots = NULL;
+        return false;
+    }
+
+    unsigned i;
+    for (i = 0; i < size; i++) {
+        atomic_init(&q->slots[i].seq, i);
+    }
+
+    q->mask = size - 1;
+    atomic_init(&q->enqueue_pos, 0);
+    atomic_init(&q->dequeue_pos, 0);
+    atomic_init(&q->waiting, 0);
+
+    return true;
+}
+
+void frameq_destroy(frameq_t *q)
+{
+    if (q->efd >= 0) {
+        close(q->efd);
+        q->efd = -1;
+    }
+
+    free(q->slots);
+    q->slots = NULL;
+}
+
+bool frameq_push(frameq_t *q, int source, const struct timeval *rx_time, const char *data, unsigned len)
+{
+    if (len >= FRAMEQ_FRAME_SIZE) {
+        return false;
+    }
+
+    frameq_slot_t *slot;
+    unsigned pos = atomic_load_explicit(&q->enqueue_pos, memory_order_relaxed);
+
+    while (1) {
+        slot = &q->slots[pos & q->mask];
+        unsigned seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        int diff = (int)(seq - pos);
+
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&q->enqueue_pos, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            /* Consumer is one lap behind */
+            return false;
+        } else {
+            pos = atomic_load_explicit(&q->enqueue_pos, memory_order_relaxed);
+        }
+    }
+
+    memcpy(slot->frame.data, data, len);
+    slot->frame.data[len] = '\0';
+    slot->frame.len = len;
+    slot->frame.source = source;
+    slot->frame.rx_time = *rx_time;
+
+    atomic_store_explicit(&slot->seq, pos + 1, memory_order_release);
+
+    /* Pairs with the fence in frameq_pop() */
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&q->waiting, memory_order_relaxed)) {
+        uint64_t one = 1;
+        while (write(q->efd, &one, sizeof(one)) < 0 && errno == EINTR) {}
+    }
+
+    return true;
+}
+
+frameq_frame_t *frameq_try_pop(frameq_t *q)
+{
+    frameq_slot_t *slot;
+    unsigned pos = atomic_load_explicit(&q->dequeue_pos, memory_order_relaxed);
+
+    while (1) {
+        slot = &q->slots[pos & q->mask];
+        unsigned seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        int diff = (int)(seq - (pos + 1));
+
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&q->dequeue_pos, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            /* Empty */
+            return NULL;
+        } else {
+            pos = atomic_load_explicit(&q->dequeue_pos, memory_order_relaxed);
+        }
+    }
+
+    slot->pos = pos;
+    return &slot->frame;
+}
+
+frameq_frame_t *frameq_pop(frameq_t *q)
+{
+    while (1) {
+        frameq_frame_t *frame = frameq_try_pop(q);
+        if (frame) {
+            return frame;
+        }
+
+        atomic_store_explicit(&q->waiting, 1, memory_order_relaxed);
+        atomic_thread_fence(memory_order_seq_cst);
+
+        /* Frame might have been pushed before producer saw the flag */
+        frame = frameq_try_pop(q);
+        if (frame) {
+            atomic_store_explicit(&q->waiting, 0, memory_order_relaxed);
+            return frame;
+        }
+
+        uint64_t val;
+        while (read(q->efd, &val, sizeof(val)) < 0 && errno == EINTR) {}
+
+        atomic_store_explicit(&q->waiting, 0, memory_order_relaxed);
+    }
+}
+
+void frameq_release(frameq_t *q, frameq_frame_t *frame)
+{
+    frameq_slot_t *slot = (frameq_slot_t *)((char *)frame - offsetof(frameq_slot_t, frame));
+
+    /* Slot is free for the producer on the next lap */
+    atomic_store_explicit(&slot->seq, slot->pos + q->mask + 1, memory_order_release);
+}
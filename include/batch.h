@@ -0,0 +1,86 @@
+/* Copyright (c) 2017 Unwired Devices LLC [info@unwds.com]
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+
+/**
+ * @defgroup    
+ * @ingroup     
+ * @brief       
+ * @{
+ * @file        batch.h
+ * @brief       Collects uplink messages into batches
+ */
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <pthread.h>
+
+#include "unwds-mqtt.h"
+#include "textbuf.h"
+#include "packbuf.h"
+
+#define BATCH_DEFAULT_ITEMS 100
+#define BATCH_DEFAULT_SIZE 16384
+
+/* Gets the batch payload, called with the batch locked */
+typedef void (*batch_flush_cb_t)(const void *payload, size_t len);
+
+/**
+ * JSON batch is an array, binary ones are CBOR or MessagePack sequences.
+ * Each item is { "topic": <device topic>, "message": <message> }.
+ */
+typedef struct {
+    mqtt_format_t format;
+    unsigned interval_ms;       /* oldest message waits no longer */
+    unsigned max_items;
+    size_t max_size;            /* payload size limit */
+    batch_flush_cb_t flush;
+
+    char *buf;
+    textbuf_t tb;               /* JSON batch */
+    packbuf_t pb;               /* binary batch */
+    unsigned items;
+    uint64_t first_ms;          /* when the oldest message was added */
+    pthread_mutex_t mutex;
+} batch_t;
+
+bool batch_init(batch_t *b, mqtt_format_t format, unsigned interval_ms, unsigned max_items, size_t max_size,
+                batch_flush_cb_t flush);
+
+/**
+ * Adds a message built in the batch format for the topic under the device
+ * EUI, flushing the batch first if the message doesn't fit. Safe to call
+ * from several threads.
+ */
+void batch_add(batch_t *b, const char *topic, const char *msg, size_t len);
+
+/**
+ * Flushes the batch if its oldest message is due. Returns ms until the
+ * next one is due, interval_ms if the batch is empty.
+ */
+unsigned batch_poll(batch_t *b);
+
+void batch_flush(batch_t *b);
+
+#endif
@@ -0,0 +1,103 @@
+/* Copyright (c) 2017 Unwired Devices LLC [info@unwds.com]
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+
+/**
+ * @defgroup    
+ * @ingroup     
+ * @brief       
+ * @{
+ * @file        capture.h
+ * @brief       Binary log of the raw gate traffic
+ */
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <sys/uio.h>
+
+#define CAPTURE_RX 0                /* from the gate */
+#define CAPTURE_TX 1                /* to the gate */
+
+#define CAPTURE_MAX_FRAME 4096      /* longest record, same as the ringbuf */
+
+/**
+ * File starts with "LMQC" and a version byte, then records follow:
+ *
+ *   flags   1 byte, bit 7 is direction, bits 0-6 are gate number
+ *   delta   varint, microseconds since the previous record
+ *   len     varint
+ *   data    len bytes, frame without '\n' or raw bytes written to the gate
+ *
+ * Flags 0xFF is a sync record written every time capture is started, its
+ * 8 data bytes are the wall clock time in microseconds (little endian),
+ * deltas of the following records count from it.
+ */
+typedef struct {
+    int fd;
+    uint64_t last_us;
+    pthread_mutex_t mutex;
+} capture_t;
+
+typedef struct {
+    uint8_t dir;
+    uint8_t gate;
+    bool sync;                      /* first record after a restart of capture */
+    uint64_t time_us;               /* wall clock time */
+    unsigned len;
+    char data[CAPTURE_MAX_FRAME + 1];   /* zero-terminated */
+} capture_record_t;
+
+typedef struct {
+    FILE *f;
+    uint64_t time_us;
+    bool sync;
+} capture_reader_t;
+
+/**
+ * Opens the log for appending, creating it if needed.
+ */
+bool capture_open(capture_t *cap, const char *name);
+
+/**
+ * Appends a record, safe to call from several threads.
+ */
+void capture_write(capture_t *cap, int dir, int gate, const char *data, unsigned len);
+
+/**
+ * Same as capture_write() but takes the first len bytes of the iovecs.
+ */
+void capture_writev(capture_t *cap, int dir, int gate, const struct iovec *iov, int iovcnt, unsigned len);
+
+bool capture_reader_open(capture_reader_t *r, const char *name);
+
+/**
+ * Reads the next record. Returns 1 on success, 0 at the end of log and -1
+ * if the log is damaged.
+ */
+int capture_read(capture_reader_t *r, capture_record_t *rec);
+
+void capture_reader_close(capture_reader_t *r);
+
+#endif
@@ -0,0 +1,73 @@
+/* Copyright (c) 2017 Unwired Devices LLC [info@unwds.com]
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+/**
+ * @defgroup    
+ * @ingroup     
+ * @brief       
+ * @{
+ * @file        cmdq.h
+ * @brief       Queue of commands to the gate drained by the writer thread
+ */
+#ifndef CMDQ_H
+#define CMDQ_H
+
+#include <stdbool.h>
+#include <pthread.h>
+#include <sys/uio.h>
+
+#include "ringbuf.h"
+
+#define CMDQ_MAX_CMD_LEN 1100
+
+typedef struct {
+    ringbuf_t rb;               /* pending command bytes */
+    pthread_mutex_t mutex;
+    pthread_cond_t data_cond;   /* writer waits for commands */
+    pthread_cond_t space_cond;  /* cmdq_printf_wait() waits for room */
+    unsigned dropped;           /* commands dropped for the lack of room */
+} cmdq_t;
+
+bool cmdq_init(cmdq_t *q);
+
+/**
+ * Formats the command and queues it as a whole. Never waits,
+ * returns false if there's no room for it.
+ */
+bool cmdq_printf(cmdq_t *q, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+/**
+ * Same as cmdq_printf() but waits until there's room for the command.
+ */
+bool cmdq_printf_wait(cmdq_t *q, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+/**
+ * Waits for queued commands, fills up to two iovecs with everything queued
+ * so far. Returns number of iovecs. Writer side only.
+ */
+int cmdq_wait(cmdq_t *q, struct iovec *iov);
+
+/**
+ * Removes len bytes already written to the gate from the queue.
+ */
+void cmdq_consume(cmdq_t *q, unsigned len);
+
+#endif
@@ -0,0 +1,65 @@
+/* Copyright (c) 2017 Unwired Devices LLC [info@unwds.com]
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+/**
+ * @defgroup    
+ * @ingroup     
+ * @brief       
+ * @{
+ * @file        framectx.h
+ * @brief       Per-thread buffers for decoding and publishing a frame
+ */
+#ifndef FRAMECTX_H
+#define FRAMECTX_H
+
+#include <stdint.h>
+
+#include "mqtt.h"
+#include "unwds-mqtt.h"
+
+#define FRAME_MQTT_TOPIC_LEN 128
+#define FRAME_LOGBUF_LEN (MQTT_MAX_MSG_SIZE + 200)
+
+/**
+ * Everything a frame needs on its way from the gate to the broker. Every
+ * thread gets its own context on first use and reuses it for each frame,
+ * so no memory is allocated per frame.
+ *
+ * topic and msg belong to the caller of convert_uplink() and
+ * publish_mqtt_message(), the rest is used by those functions.
+ */
+typedef struct {
+    const char *topic;      /* module name, see convert_to() */
+    char msg[MQTT_MAX_MSG_SIZE];
+
+    mqtt_msg_t values;
+    uint8_t bytes[REPLY_LEN];
+    char mqtt_topic[FRAME_MQTT_TOPIC_LEN];
+    char logbuf[FRAME_LOGBUF_LEN];
+} frame_ctx_t;
+
+/**
+ * Returns context of the calling thread, or NULL if it can't be allocated.
+ * Context is freed when the thread exits.
+ */
+frame_ctx_t *frame_ctx_get(void);
+
+#endif
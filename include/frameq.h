@@ -0,0 +1,91 @@
+/* Copyright (c) 2017 Unwired Devices LLC [info@unwds.com]
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+/**
+ * @defgroup    
+ * @ingroup     
+ * @brief       
+ * @{
+ * @file        frameq.h
+ * @brief       Bounded lock-free queue of gate frames between threads
+ */
+#ifndef FRAMEQ_H
+#define FRAMEQ_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <sys/time.h>
+
+#define FRAMEQ_FRAME_SIZE 1024
+#define FRAMEQ_DEFAULT_SLOTS 64
+
+typedef struct {
+    int source;                 /* number of the gate frame came from */
+    struct timeval rx_time;     /* when it was read from the gate */
+    unsigned len;
+    char data[FRAMEQ_FRAME_SIZE];
+} frameq_frame_t;
+
+typedef struct {
+    atomic_uint seq;            /* slot state, see frameq.c */
+    unsigned pos;               /* position the slot was taken at */
+    frameq_frame_t frame;
+} frameq_slot_t;
+
+typedef struct {
+    frameq_slot_t *slots;
+    unsigned mask;
+
+    /* Producers and consumer touch different cache lines */
+    atomic_uint enqueue_pos __attribute__((aligned(64)));
+    atomic_uint dequeue_pos __attribute__((aligned(64)));
+    atomic_int waiting;         /* consumer is sleeping on efd */
+    int efd;                    /* eventfd to wake up the consumer */
+} frameq_t;
+
+/**
+ * Allocates queue with num_slots slots (rounded up to a power of two).
+ */
+bool frameq_init(frameq_t *q, unsigned num_slots);
+
+void frameq_destroy(frameq_t *q);
+
+/**
+ * Copies the frame received from source at rx_time into the queue, never blocks. Safe to
+ * call from several threads. Returns false if the queue is full or frame is too long.
+ */
+bool frameq_push(frameq_t *q, int source, const struct timeval *rx_time, const char *data, unsigned len);
+
+/**
+ * Takes the oldest frame, blocking until there's one. Frame must be given
+ * back with frameq_release() after use. Single consumer only.
+ */
+frameq_frame_t *frameq_pop(frameq_t *q);
+
+/**
+ * Same as frameq_pop() but returns NULL at once if the queue is empty.
+ */
+frameq_frame_t *frameq_try_pop(frameq_t *q);
+
+void frameq_release(frameq_t *q, frameq_frame_t *frame);
+
+#endif
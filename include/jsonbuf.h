@@ -0,0 +1,131 @@
+/* Copyright (c) 2017 Unwired Devices LLC [info@unwds.com]
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+/**
+ * @defgroup    
+ * @ingroup     
+ * @brief       
+ * @{
+ * @file        jsonbuf.h
+ * @brief       Streaming JSON writer for fixed-size buffers
+ */
+#ifndef JSONBUF_H
+#define JSONBUF_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "textbuf.h"
+
+#define JSONBUF_MAX_DEPTH 16
+
+/**
+ * Writes JSON objects member by member in the layout of the gate messages:
+ * "{ " and " }" around objects, ", " between members, "name": before values.
+ * Closing braces that follow each other are written as "}}".
+ *
+ * Room for the closing braces is reserved when an object is opened, and a
+ * member that doesn't fit is dropped whole, so the result is always valid
+ * JSON. Dropped members set the overflow flag.
+ *
+ * With escape_quotes set every quote of the result is written as \", as if
+ * the finished JSON was escaped once more, for brokers which take messages
+ * as JSON strings.
+ */
+typedef struct {
+    textbuf_t tb;
+    uint8_t depth;
+    uint8_t skipped;        /* objects which didn't fit, their members are ignored */
+    uint32_t has_members;   /* bit per nesting level */
+    bool after_close;
+    bool escape_quotes;
+} jsonbuf_t;
+
+void jsonbuf_init(jsonbuf_t *jb, char *buf, size_t size);
+
+/**
+ * Sets the output policy before anything is written, see jsonbuf_t.
+ */
+static inline void jsonbuf_escape_quotes(jsonbuf_t *jb, bool escape)
+{
+    jb->escape_quotes = escape;
+}
+
+static inline size_t jsonbuf_len(const jsonbuf_t *jb)
+{
+    return jb->tb.len;
+}
+
+static inline bool jsonbuf_overflow(const jsonbuf_t *jb)
+{
+    return jb->tb.overflow;
+}
+
+/**
+ * Opens an object. Name is NULL for the top level object.
+ */
+bool jsonbuf_begin_object(jsonbuf_t *jb, const char *name);
+
+bool jsonbuf_end_object(jsonbuf_t *jb);
+
+bool jsonbuf_int(jsonbuf_t *jb, const char *name, int32_t val);
+
+bool jsonbuf_uint(jsonbuf_t *jb, const char *name, uint32_t val);
+
+/**
+ * Writes val / 10^precision, see textbuf_append_fixed().
+ */
+bool jsonbuf_fixed(jsonbuf_t *jb, const char *name, int32_t val, uint8_t precision);
+
+/**
+ * Writes val with precision digits after the point, null for inf and nan.
+ */
+bool jsonbuf_float(jsonbuf_t *jb, const char *name, double val, uint8_t precision);
+
+/**
+ * Writes a quoted string, escaping quotes, backslashes and control characters.
+ */
+bool jsonbuf_string(jsonbuf_t *jb, const char *name, const char *str);
+
+/**
+ * Writes text which is JSON already: a number, an object or an array.
+ */
+bool jsonbuf_raw(jsonbuf_t *jb, const char *name, const char *json);
+
+/**
+ * Writes a decoder value, quoting it unless it is a number, an object or
+ * an array. Numbers with leading zeros are quoted as JSON doesn't allow them.
+ */
+bool jsonbuf_value(jsonbuf_t *jb, const char *name, const char *value);
+
+/**
+ * Whether jsonbuf_value() takes the decoder value for a number.
+ */
+bool jsonbuf_is_number(const char *value);
+
+/**
+ * Writes a member with a preformatted key, e.g. "\"devEUI\" : ", and a
+ * string value.
+ */
+bool jsonbuf_string_key(jsonbuf_t *jb, const char *key, const char *str);
+
+#endif
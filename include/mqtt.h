@@ -24,6 +24,8 @@
 
 #define UNWDS_MODULE_NOT_FOUND 255
 
+#define REPLY_LEN 1024     /* longest payload from the gate, in bytes */
+
 typedef enum {
 	CMD_PING = 'P',				/* Command to ping/pong with client */
 	CMD_DEVLIST = 'L',			/* Command to get devices list from a gate */
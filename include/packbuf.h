@@ -0,0 +1,114 @@
+/* Copyright (c) 2017 Unwired Devices LLC [info@unwds.com]
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+
+/**
+ * @defgroup    
+ * @ingroup     
+ * @brief       
+ * @{
+ * @file        packbuf.h
+ * @brief       CBOR and MessagePack writer for fixed-size buffers
+ */
+#ifndef PACKBUF_H
+#define PACKBUF_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef enum {
+    PACKBUF_CBOR,       /* RFC 8949 */
+    PACKBUF_MSGPACK,
+} packbuf_format_t;
+
+/**
+ * Writes binary items in the smallest encoding for their value. Overflow
+ * is sticky: once an item doesn't fit, nothing more is written until the
+ * writer is rolled back with packbuf_truncate().
+ */
+typedef struct {
+    uint8_t *buf;
+    size_t size;
+    size_t len;
+    bool overflow;
+    uint8_t format;
+} packbuf_t;
+
+void packbuf_init(packbuf_t *pb, packbuf_format_t format, void *buf, size_t size);
+
+static inline size_t packbuf_len(const packbuf_t *pb)
+{
+    return pb->len;
+}
+
+static inline bool packbuf_overflow(const packbuf_t *pb)
+{
+    return pb->overflow;
+}
+
+/**
+ * Drops everything written after len and clears the overflow flag.
+ */
+void packbuf_truncate(packbuf_t *pb, size_t len);
+
+/**
+ * Starts a map of num key-value pairs, written as items that follow.
+ */
+void packbuf_map(packbuf_t *pb, uint32_t num);
+
+/**
+ * Starts an array of num items.
+ */
+void packbuf_array(packbuf_t *pb, uint32_t num);
+
+/**
+ * Starts a map whose size is not known yet. Returns the mark to pass to
+ * packbuf_map_end() with the number of pairs written, up to 65535.
+ */
+size_t packbuf_map_begin(packbuf_t *pb);
+
+void packbuf_map_end(packbuf_t *pb, size_t mark, uint16_t num);
+
+void packbuf_nil(packbuf_t *pb);
+
+void packbuf_uint(packbuf_t *pb, uint64_t val);
+
+void packbuf_int(packbuf_t *pb, int64_t val);
+
+/**
+ * Writes val as a 32-bit float if it keeps precision digits after the point,
+ * as a 64-bit one otherwise.
+ */
+void packbuf_float(packbuf_t *pb, double val, uint8_t precision);
+
+void packbuf_text(packbuf_t *pb, const char *str, size_t len);
+
+void packbuf_string(packbuf_t *pb, const char *str);
+
+void packbuf_bytes(packbuf_t *pb, const void *data, size_t len);
+
+/**
+ * Copies an item encoded elsewhere in the same format.
+ */
+void packbuf_raw(packbuf_t *pb, const void *data, size_t len);
+
+#endif
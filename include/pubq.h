@@ -0,0 +1,136 @@
+/* Copyright (c) 2017 Unwired Devices LLC [info@unwds.com]
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+
+/**
+ * @defgroup    
+ * @ingroup     
+ * @brief       
+ * @{
+ * @file        pubq.h
+ * @brief       Bounded queue of outgoing MQTT messages
+ */
+#ifndef PUBQ_H
+#define PUBQ_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+#include <pthread.h>
+
+#define PUBQ_DEFAULT_SIZE (256 * 1024)
+
+/* Queued message, stays in place until pubq_consume() */
+typedef struct {
+    uint32_t size;          /* bytes taken in the queue, 0 marks the wrap to its start */
+    uint32_t len;           /* payload length */
+    uint64_t queued_ns;     /* monotonic time of pubq_push() */
+    uint32_t meta_len;      /* caller's data about the message, after the payload */
+    char topic[];           /* NUL-terminated, payload follows */
+} pubq_msg_t;
+
+static inline const void *pubq_msg_payload(const pubq_msg_t *msg)
+{
+    return msg->topic + strlen(msg->topic) + 1;
+}
+
+/**
+ * Returns meta_len bytes given to pubq_push(), not aligned.
+ */
+static inline const void *pubq_msg_meta(const pubq_msg_t *msg)
+{
+    return (const char *)pubq_msg_payload(msg) + msg->len;
+}
+
+typedef struct {
+    unsigned long pushed;
+    unsigned long published;
+    unsigned long dropped;      /* for the lack of room */
+    unsigned depth;             /* messages in the queue */
+    unsigned max_depth;         /* since the last pubq_stats() */
+    unsigned long latency_count;    /* messages consumed since the last pubq_stats() */
+    uint64_t latency_sum_ns;        /* from pubq_push() to pubq_consume() */
+    uint64_t latency_max_ns;
+} pubq_stats_t;
+
+/**
+ * Messages of any size are packed one after another into a byte buffer,
+ * so a burst of small messages doesn't hit a slot limit. Any thread may
+ * push, one thread takes them out.
+ */
+typedef struct {
+    uint8_t *buf;
+    size_t size;
+    size_t head;                /* write offset */
+    size_t tail;                /* read offset */
+    size_t used;                /* bytes taken, including the gap before a wrap */
+    bool paused;                /* consumer doesn't get messages, e.g. broker is away */
+    bool closed;
+    pubq_stats_t stats;
+    pthread_mutex_t mutex;
+    pthread_cond_t data_cond;   /* consumer waits for messages */
+    pthread_cond_t empty_cond;  /* pubq_wait_empty() waits for the consumer */
+} pubq_t;
+
+/**
+ * Allocates the queue of size bytes. It starts paused.
+ */
+bool pubq_init(pubq_t *q, size_t size);
+
+/**
+ * Copies the message and meta_len bytes of meta, which may be NULL, into
+ * the queue. Never waits, returns false if there's no room for it.
+ */
+bool pubq_push(pubq_t *q, const char *topic, const void *payload, size_t len, const void *meta, size_t meta_len);
+
+/**
+ * Returns the oldest message, waiting up to timeout_ms while the queue is
+ * empty or paused. NULL on timeout or when the queue is closed.
+ * Consumer side only.
+ */
+pubq_msg_t *pubq_peek(pubq_t *q, int timeout_ms);
+
+/**
+ * Removes the message returned by pubq_peek() once it's published.
+ */
+void pubq_consume(pubq_t *q, pubq_msg_t *msg);
+
+void pubq_pause(pubq_t *q, bool paused);
+
+/**
+ * Wakes up the consumer for good, messages left are not returned anymore.
+ */
+void pubq_close(pubq_t *q);
+
+bool pubq_closed(pubq_t *q);
+
+/**
+ * Waits until every message pushed so far is consumed.
+ */
+void pubq_wait_empty(pubq_t *q);
+
+/**
+ * Copies the counters and starts a new latency window.
+ */
+void pubq_stats(pubq_t *q, pubq_stats_t *stats);
+
+#endif
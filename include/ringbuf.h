@@ -0,0 +1,88 @@
+/* Copyright (c) 2017 Unwired Devices LLC [info@unwds.com]
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+/**
+ * @defgroup    
+ * @ingroup     
+ * @brief       
+ * @{
+ * @file        ringbuf.h
+ * @brief       Byte ring buffer with line framing for the gate link
+ */
+#ifndef RINGBUF_H
+#define RINGBUF_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+/* Must be a power of two */
+#define RINGBUF_SIZE 4096
+
+typedef struct {
+    uint8_t buf[RINGBUF_SIZE];
+    unsigned head;      /* write index, free-running */
+    unsigned tail;      /* read index, free-running */
+    unsigned scan;      /* frame scanner position, free-running */
+    bool discard;       /* skipping the rest of an oversized frame */
+    char frame[RINGBUF_SIZE + 1]; /* linear copy of a frame wrapped around the buffer end */
+} ringbuf_t;
+
+void ringbuf_init(ringbuf_t *rb);
+
+unsigned ringbuf_used(const ringbuf_t *rb);
+unsigned ringbuf_free(const ringbuf_t *rb);
+
+/**
+ * Reads as much as fits into the buffer from fd with a single readv().
+ * Returns read() result.
+ */
+ssize_t ringbuf_read(ringbuf_t *rb, int fd);
+
+/**
+ * Copies len bytes into the buffer, returns number of bytes actually stored.
+ */
+unsigned ringbuf_write(ringbuf_t *rb, const void *data, unsigned len);
+
+/**
+ * Fills up to two iovecs with buffered data, returns number of iovecs used.
+ */
+int ringbuf_peek(const ringbuf_t *rb, struct iovec *iov);
+
+/**
+ * Drops len bytes from the buffer start.
+ */
+void ringbuf_consume(ringbuf_t *rb, unsigned len);
+
+/**
+ * Returns next complete delim-terminated frame as a NUL-terminated string
+ * without the delimiter and trailing '\r', or NULL if there's no complete
+ * frame yet. The partial frame is kept and scanning resumes where it
+ * stopped on the next call. Frame stays valid until the next
+ * ringbuf_read()/ringbuf_write() call.
+ *
+ * Frames not fitting into the buffer are dropped, dropped is set to true then.
+ */
+char *ringbuf_next_frame(ringbuf_t *rb, char delim, unsigned *len, bool *dropped);
+
+#endif
@@ -0,0 +1,90 @@
+/* Copyright (c) 2017 Unwired Devices LLC [info@unwds.com]
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+
+/**
+ * @defgroup    
+ * @ingroup     
+ * @brief       
+ * @{
+ * @file        textbuf.h
+ * @brief       Cursor-based string builder for fixed-size buffers
+ */
+#ifndef TEXTBUF_H
+#define TEXTBUF_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * Appends to a caller-provided buffer at the remembered end, so every
+ * append costs only the length of what is appended. Buffer is always
+ * zero-terminated. An item that doesn't fit is not appended at all and
+ * the overflow flag is set.
+ */
+typedef struct {
+    char *buf;
+    size_t size;
+    size_t len;
+    bool overflow;
+} textbuf_t;
+
+void textbuf_init(textbuf_t *tb, char *buf, size_t size);
+
+/**
+ * Number of characters that can still be appended.
+ */
+static inline size_t textbuf_avail(const textbuf_t *tb)
+{
+    return tb->size - tb->len - 1;
+}
+
+/**
+ * Cuts the string back to len characters and clears the overflow flag.
+ */
+void textbuf_truncate(textbuf_t *tb, size_t len);
+
+bool textbuf_append(textbuf_t *tb, const char *str);
+
+/**
+ * Appends n bytes as they are, stopping at a zero byte.
+ */
+bool textbuf_append_n(textbuf_t *tb, const char *str, size_t n);
+
+bool textbuf_append_char(textbuf_t *tb, char c);
+
+/**
+ * Appends bytes as lowercase hex, two characters per byte.
+ */
+bool textbuf_append_hex(textbuf_t *tb, const uint8_t *bytes, size_t num_bytes);
+
+bool textbuf_append_uint(textbuf_t *tb, uint32_t val);
+
+bool textbuf_append_int(textbuf_t *tb, int32_t val);
+
+/**
+ * Appends val / 10^precision with precision digits after the point,
+ * e.g. 12345 with precision 2 is "123.45".
+ */
+bool textbuf_append_fixed(textbuf_t *tb, int32_t val, uint8_t precision);
+
+#endif
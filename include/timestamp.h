@@ -0,0 +1,54 @@
+/* Copyright (c) 2017 Unwired Devices LLC [info@unwds.com]
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+/**
+ * @defgroup    
+ * @ingroup     
+ * @brief       
+ * @{
+ * @file        timestamp.h
+ * @brief       Cached formatting of message and log timestamps
+ */
+#ifndef TIMESTAMP_H
+#define TIMESTAMP_H
+
+#include <stddef.h>
+#include <time.h>
+#include <sys/time.h>
+
+#define TIMESTAMP_ISO8601_LEN 32
+#define TIMESTAMP_LOG_LEN 9
+
+/**
+ * Writes tv in UTC as "2017-05-18T12:34:56.123456Z". Microseconds have no
+ * leading zeros, as the "date" field of the messages always had them.
+ * Date and time are formatted once a second per thread.
+ * Returns length written.
+ */
+size_t timestamp_iso8601(const struct timeval *tv, char *buf, size_t size);
+
+/**
+ * Writes local time as "12:34:56" for the log, formatted once a second per
+ * thread. Returns length written.
+ */
+size_t timestamp_log(time_t t, char *buf, size_t size);
+
+#endif
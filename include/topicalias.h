@@ -0,0 +1,84 @@
+/* Copyright (c) 2017 Unwired Devices LLC [info@unwds.com]
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+
+
+/**
+ * @defgroup    
+ * @ingroup     
+ * @brief       
+ * @{
+ * @file        topicalias.h
+ * @brief       MQTT v5 topic aliases for the busiest topics
+ */
+#ifndef TOPICALIAS_H
+#define TOPICALIAS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#define TOPIC_ALIAS_DEFAULT_NUM 64
+#define TOPIC_ALIAS_TOPIC_LEN 128
+
+typedef struct {
+    uint32_t hash;
+    uint32_t hits;
+    bool sent;                  /* broker knows the alias */
+    char topic[TOPIC_ALIAS_TOPIC_LEN];
+} topic_alias_slot_t;
+
+/**
+ * Aliases live as long as the connection and their number is limited by
+ * the broker, so they go to the topics published most often. A new topic
+ * takes a free alias or the one with the fewest hits, hits are halved
+ * after every num replacements so that devices gone silent give way.
+ */
+typedef struct {
+    topic_alias_slot_t *slots;  /* slot i is alias i + 1 */
+    unsigned max;               /* our own limit */
+    unsigned num;               /* current limit, up to what the broker allows */
+    unsigned used;
+    unsigned replaced;          /* since hits were halved last time */
+    pthread_mutex_t mutex;
+} topic_alias_t;
+
+bool topic_alias_init(topic_alias_t *ta, unsigned max);
+
+/**
+ * Forgets every alias, to be called on connect with the broker's Topic
+ * Alias Maximum and on disconnect with 0.
+ */
+void topic_alias_reset(topic_alias_t *ta, unsigned broker_max);
+
+/**
+ * Returns alias for the topic, 0 if it gets none. known tells if the
+ * broker has it already, so the topic itself may be left out.
+ */
+uint16_t topic_alias_get(topic_alias_t *ta, const char *topic, bool *known);
+
+/**
+ * Marks alias as known to the broker once a message carrying both the
+ * topic and the alias is published.
+ */
+void topic_alias_sent(topic_alias_t *ta, uint16_t alias);
+
+#endif
@@ -0,0 +1,75 @@
+/* Copyright (c) 2017 Unwired Devices LLC [info@unwds.com]
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+/**
+ * @defgroup    
+ * @ingroup     
+ * @brief       
+ * @{
+ * @file        transport.h
+ * @brief       Link to the gate: serial port, TCP or Unix socket
+ */
+#ifndef TRANSPORT_H
+#define TRANSPORT_H
+
+#include <stdbool.h>
+
+#define TRANSPORT_URI_LEN 100
+
+typedef struct transport transport_t;
+
+typedef struct {
+    const char *name;
+    int (*open)(transport_t *t);    /* returns connected fd or -1 */
+    bool stream;                    /* EOF means the peer has gone */
+} transport_ops_t;
+
+/**
+ * Gate link. Port URI is one of:
+ *   /dev/ttyATH0                serial port, 115200 8n1
+ *   /dev/ttyUSB0@57600          serial port with given baudrate
+ *   tcp://192.168.1.1:2000      TCP server, e.g. ser2net
+ *   unix:/var/run/gate.sock     Unix stream socket
+ *   null:                       no gate, commands are discarded (replay only)
+ */
+struct transport {
+    const transport_ops_t *ops;
+    char uri[TRANSPORT_URI_LEN];
+    int fd;
+};
+
+/**
+ * Picks a backend for the URI, does not connect yet.
+ */
+bool transport_init(transport_t *t, const char *uri);
+
+/**
+ * Opens the link. Returns fd or -1.
+ */
+int transport_open(transport_t *t);
+
+/**
+ * Reopens broken link keeping the same fd number, so the other thread
+ * using it needs no locking. Returns false if the link is still down.
+ */
+bool transport_reopen(transport_t *t);
+
+#endif
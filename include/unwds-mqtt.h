@@ -24,21 +24,61 @@
 
 #include <stdbool.h>
 #include <stdint.h>
+#include <stddef.h>
+#include <sys/time.h>
 #include <mosquitto.h>
 
+#include "pubq.h"
+#include "topicalias.h"
+
 #define MQTT_MSG_MAX_NUM 50
 #define MQTT_SUBSCRIBE_TO "devices/lora/#"
 #define MQTT_PUBLISH_TO "devices/lora/"
+
+/* MQTT_PUBLISH_TO, 16 hex digits of EUI, "/miso/" and NUL */
+#define MQTT_TOPIC_PREFIX_LEN (sizeof(MQTT_PUBLISH_TO) + 16 + sizeof("/miso/"))
+
 #define MQTT_MAX_MSG_SIZE 2048
 
 typedef enum {
     UNWDS_MQTT_REGULAR = 0,
     UNWDS_MQTT_ESCAPED = 1,
+    UNWDS_MQTT_CBOR = 2,        /* binary, see README for the schema */
+    UNWDS_MQTT_MSGPACK = 3,
 } mqtt_format_t;
 
+typedef enum {
+    MQTT_VALUE_TEXT,    /* decoder text, quoted unless it looks like a number, object or array */
+    MQTT_VALUE_INT,
+    MQTT_VALUE_UINT,
+    MQTT_VALUE_FIXED,   /* integer scaled by 10^precision */
+    MQTT_VALUE_FLOAT,
+    MQTT_VALUE_STRING,
+    MQTT_VALUE_RAW,     /* JSON object or array */
+} mqtt_value_type_t;
+
+typedef struct {
+    const char *name;
+    uint8_t type;
+    uint8_t precision;
+    union {
+        int32_t i;
+        uint32_t u;
+        double f;
+        const char *str;
+    };
+} mqtt_value_t;
+
+/**
+ * Decoded values in the order they were added. Names are borrowed, so they
+ * must be string literals or outlive the list; string values are copied
+ * into the list. Values which don't fit are dropped.
+ */
 typedef struct {
-    char name[40];
-    char value[100];
+    uint8_t num;
+    uint16_t strings_len;
+    mqtt_value_t values[MQTT_MSG_MAX_NUM];
+    char strings[MQTT_MAX_MSG_SIZE];
 } mqtt_msg_t;
 
 typedef struct {
@@ -47,20 +87,145 @@ typedef struct {
     int16_t temperature;
 } mqtt_status_t;
 
+/* What goes along with a message as MQTT v5 properties */
+typedef struct {
+    mqtt_format_t format;
+    bool uplink;                /* fields below are set */
+    uint8_t modid;
+    int16_t rssi;
+    struct timeval rx_time;
+} mqtt_props_t;
+
 extern bool mqtt_retain;
 extern bool mqtt_sepio;
 extern int mqtt_qos;
 
-bool convert_to(uint8_t modid, uint8_t *moddata, int moddatalen, char *topic, mqtt_msg_t *msg);
+/* MQTT v5 only: uplinks expire after mqtt_expiry seconds (0 = never),
+ * mqtt_user_props adds content type and uplink details, topics get
+ * aliases from mqtt_aliases if it's set, which is for QoS 0 only */
+extern int mqtt_version;
+extern unsigned mqtt_expiry;
+extern bool mqtt_user_props;
+extern topic_alias_t *mqtt_aliases;
+
+/* Messages are queued here for the publishing thread when set,
+ * published right away otherwise */
+extern pubq_t *mqtt_pubq;
+
+/**
+ * Decodes module data. topic is set to the module name, which lives as
+ * long as the program, so it's never copied.
+ */
+bool convert_to(uint8_t modid, uint8_t *moddata, int moddatalen, const char **topic, mqtt_msg_t *msg);
 
 bool convert_from(char *type, char *param, char *out, int bufsize);
 
-void publish_mqtt_message(struct mosquitto *mosq, const char *addr, const char *topic, char *msg, const mqtt_format_t format);
+/**
+ * Decodes REPLY_IND data following the device EUI: RSSI, status and module
+ * data as hex. Sets topic as convert_to() does and fills msg (MQTT_MAX_MSG_SIZE), dating
+ * the message with rx_time, or the current time if it's NULL. Fills props
+ * for publish_mqtt_topic() unless it's NULL.
+ * Keeps no state between calls, so it may run on several threads at once.
+ * Returns message length, 0 if the data can't be decoded.
+ */
+size_t convert_uplink(char *str, const char *addr, const struct timeval *rx_time, mqtt_format_t format,
+                      const char **topic, char *msg, mqtt_props_t *props);
+
+/**
+ * Writes the device topic prefix "devices/lora/<addr>/", with "miso/" in
+ * the sepio mode, to prefix (MQTT_TOPIC_PREFIX_LEN bytes).
+ * Returns its length.
+ */
+size_t mqtt_topic_prefix(char *prefix, const char *addr);
 
-void build_mqtt_message(char *msg, const mqtt_msg_t *mqtt_msg, const mqtt_status_t status, const char *addr);
+/**
+ * Publishes len bytes of msg, or queues them to mqtt_pubq if it's set.
+ * JSON messages must be NUL terminated, the escaped format is escaped by
+ * build_mqtt_message() already.
+ */
+void publish_mqtt_message(struct mosquitto *mosq, const char *addr, const char *topic, const char *msg, size_t len,
+                          const mqtt_format_t format);
 
+/**
+ * Same as publish_mqtt_message() with the device topic prefix made by
+ * mqtt_topic_prefix() beforehand, e.g. cached for a known device.
+ */
+void publish_mqtt_topic(struct mosquitto *mosq, const char *prefix, size_t prefix_len, const char *topic,
+                        const char *msg, size_t len, const mqtt_props_t *props);
+
+/**
+ * Publishes or queues a ready message to the full topic, props may be NULL.
+ */
+void publish_mqtt_raw(struct mosquitto *mosq, const char *topic, const void *payload, size_t len,
+                      const mqtt_props_t *props);
+
+/**
+ * Publishes a ready message to the full topic and logs the result. Not
+ * thread-safe with MQTT v5 topic aliases, which must follow the order of
+ * the messages on the wire.
+ * mid gets the message id, 0 if nothing went to libmosquitto, e.g. the
+ * uplink has expired. Returns mosquitto_publish() result.
+ */
+int mqtt_send(struct mosquitto *mosq, int *mid, const char *topic, const void *payload, size_t len,
+              const mqtt_props_t *props);
+
+/**
+ * Writes the message for decoded values into msg (MQTT_MAX_MSG_SIZE).
+ * date is the time the frame was received, NULL for now.
+ * Returns message length.
+ */
+size_t build_mqtt_message(char *msg, const mqtt_msg_t *mqtt_msg, const mqtt_status_t status, const char *addr,
+                          const struct timeval *date, mqtt_format_t format);
+
+/**
+ * Writes decoded values alone, without data and status envelope.
+ * Returns message length.
+ */
+size_t build_mqtt_values(char *msg, const mqtt_msg_t *mqtt_msg, mqtt_format_t format);
+
+/**
+ * Format names as in mqtt.conf: mqtt, mqtt-escaped, cbor, msgpack
+ */
+bool mqtt_format_by_name(const char *name, mqtt_format_t *format);
+const char *mqtt_format_name(mqtt_format_t format);
+
+static inline void mqtt_msg_init(mqtt_msg_t *msg)
+{
+    msg->num = 0;
+    msg->strings_len = 0;
+}
+
+/**
+ * Copies the string into the list, for names built at run time.
+ * Returns NULL if there's no room left.
+ */
+const char *mqtt_msg_strdup(mqtt_msg_t *msg, const char *str);
+
+/**
+ * Adds decoder text, name and value are both copied.
+ */
 void add_value_pair(mqtt_msg_t *msg, char const *name, char const *value);
 
+void add_int_value(mqtt_msg_t *msg, const char *name, int32_t value);
+void add_uint_value(mqtt_msg_t *msg, const char *name, uint32_t value);
+
+/**
+ * Adds value / 10^precision, e.g. 215 with precision 1 is 21.5
+ */
+void add_fixed_value(mqtt_msg_t *msg, const char *name, int32_t value, uint8_t precision);
+
+void add_float_value(mqtt_msg_t *msg, const char *name, double value, uint8_t precision);
+
+/**
+ * Adds a string which is always quoted, even if it looks like a number.
+ */
+void add_string_value(mqtt_msg_t *msg, const char *name, const char *value);
+
+/**
+ * Adds a JSON object or array as it is.
+ */
+void add_raw_value(mqtt_msg_t *msg, const char *name, const char *json);
+
 int unwds_modid_by_name(char *name);
 
 #endif
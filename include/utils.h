@@ -33,6 +33,14 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * Decodes len hex characters into bytes, last byte first if reverse_order is set.
+ * Returns number of bytes decoded, or -1 if len is odd, the string has non-hex
+ * characters or the result does not fit into size bytes.
+ */
+int hex_decode(const char *hexstr, size_t len, uint8_t *bytes, size_t size, bool reverse_order);
 
 bool hex_to_bytes(char *hexstr, uint8_t *bytes, bool reverse_order);
 
@@ -52,6 +60,8 @@ void uint64_swap_bytes(uint64_t *num);
 
 void logprint(char *str);
 
+uint64_t get_time_ms(void);
+
 void int_to_float_str(char *buf, int decimal, uint8_t precision);
 
 bool is_number(char* str);
@@ -0,0 +1,385 @@
+/* Copyright (c) 2017 Unwired Devices LLC [info@unwds.com]
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+/**
+ * @defgroup    
+ * @ingroup     
+ * @brief       
+ * @{
+ * @file        jsonbuf.c
+ * @brief       Streaming JSON writer for fixed-size buffers
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <string.h>
+
+#include "jsonbuf.h"
+
+/* Room kept for " }" of every open object */
+#define CLOSE_LEN 2
+
+static const char hex_chars[] = "0123456789abcdef";
+
+void jsonbuf_init(jsonbuf_t *jb, char *buf, size_t size)
+{
+    textbuf_init(&jb->tb, buf, size);
+    jb->depth = 0;
+    jb->skipped = 0;
+    jb->has_members = 0;
+    jb->after_close = false;
+    jb->escape_quotes = false;
+}
+
+/* Appends n characters, escaping quotes if the policy says so. Like
+ * textbuf_append_n(), appends nothing if the result doesn't fit */
+static void append_n(jsonbuf_t *jb, const char *str, size_t n)
+{
+    if (!jb->escape_quotes) {
+        textbuf_append_n(&jb->tb, str, n);
+        return;
+    }
+
+    textbuf_t *tb = &jb->tb;
+    size_t len = tb->len;
+    size_t i;
+
+    for (i = 0; i < n && str[i]; i++) {
+        bool quote = (str[i] == '"');
+        if (len + 1 + quote >= tb->size) {
+            tb->buf[tb->len] = '\0';
+            tb->overflow = true;
+            return;
+        }
+        if (quote) {
+            tb->buf[len++] = '\\';
+        }
+        tb->buf[len++] = str[i];
+    }
+
+    tb->buf[len] = '\0';
+    tb->len = len;
+}
+
+static void append(jsonbuf_t *jb, const char *str)
+{
+    append_n(jb, str, strlen(str));
+}
+
+/* Writes separator and key, returns position to roll back to */
+static size_t member_begin(jsonbuf_t *jb, const char *name)
+{
+    size_t mark = jb->tb.len;
+    uint32_t level = 1UL << jb->depth;
+
+    if (jb->has_members & level) {
+        textbuf_append(&jb->tb, ", ");
+    }
+
+    if (name) {
+        append(jb, "\"");
+        append(jb, name);
+        append(jb, "\": ");
+    }
+
+    return mark;
+}
+
+static bool member_end(jsonbuf_t *jb, size_t mark)
+{
+    if (jb->tb.overflow) {
+        textbuf_truncate(&jb->tb, mark);
+        jb->tb.overflow = true;
+        return false;
+    }
+
+    jb->has_members |= 1UL << jb->depth;
+    jb->after_close = false;
+    return true;
+}
+
+bool jsonbuf_begin_object(jsonbuf_t *jb, const char *name)
+{
+    if (jb->skipped || jb->depth + 1 >= JSONBUF_MAX_DEPTH ||
+        textbuf_avail(&jb->tb) < CLOSE_LEN) {
+        jb->skipped++;
+        jb->tb.overflow = true;
+        return false;
+    }
+
+    size_t mark = member_begin(jb, name);
+    textbuf_append(&jb->tb, "{ ");
+
+    /* Keep room for the closing brace */
+    jb->tb.size -= CLOSE_LEN;
+    if (jb->tb.len >= jb->tb.size) {
+        jb->tb.overflow = true;
+    }
+    if (!member_end(jb, mark)) {
+        jb->tb.size += CLOSE_LEN;
+        jb->skipped++;
+        return false;
+    }
+
+    jb->depth++;
+    jb->has_members &= ~(1UL << jb->depth);
+
+    return true;
+}
+
+bool jsonbuf_end_object(jsonbuf_t *jb)
+{
+    if (jb->skipped) {
+        jb->skipped--;
+        return false;
+    }
+    if (!jb->depth) {
+        return false;
+    }
+
+    jb->depth--;
+    jb->tb.size += CLOSE_LEN;
+    textbuf_append(&jb->tb, jb->after_close ? "}" : " }");
+    jb->after_close = true;
+
+    return true;
+}
+
+bool jsonbuf_int(jsonbuf_t *jb, const char *name, int32_t val)
+{
+    if (jb->skipped) {
+        return false;
+    }
+
+    size_t mark = member_begin(jb, name);
+    textbuf_append_int(&jb->tb, val);
+    return member_end(jb, mark);
+}
+
+bool jsonbuf_uint(jsonbuf_t *jb, const char *name, uint32_t val)
+{
+    if (jb->skipped) {
+        return false;
+    }
+
+    size_t mark = member_begin(jb, name);
+    textbuf_append_uint(&jb->tb, val);
+    return member_end(jb, mark);
+}
+
+bool jsonbuf_fixed(jsonbuf_t *jb, const char *name, int32_t val, uint8_t precision)
+{
+    if (jb->skipped) {
+        return false;
+    }
+
+    size_t mark = member_begin(jb, name);
+    textbuf_append_fixed(&jb->tb, val, precision);
+    return member_end(jb, mark);
+}
+
+bool jsonbuf_float(jsonbuf_t *jb, const char *name, double val, uint8_t precision)
+{
+    if (jb->skipped) {
+        return false;
+    }
+
+    if (precision > 9) {
+        precision = 9;
+    }
+
+    char buf[64];
+    if (isfinite(val) && fabs(val) < 1e30) {
+        snprintf(buf, sizeof(buf), "%.*f", precision, val);
+    } else {
+        strcpy(buf, "null");
+    }
+
+    size_t mark = member_begin(jb, name);
+    textbuf_append(&jb->tb, buf);
+    return member_end(jb, mark);
+}
+
+static void append_escaped(jsonbuf_t *jb, const char *str)
+{
+    const char *run = str;
+    const char *ptr;
+
+    for (ptr = str; *ptr; ptr++) {
+        unsigned char c = *ptr;
+        if (c >= 0x20 && c != '"' && c != '\\') {
+            continue;
+        }
+
+        /* Copy unescaped characters in one go, there are no quotes among them */
+        textbuf_append_n(&jb->tb, run, ptr - run);
+        run = ptr + 1;
+
+        char esc[7] = { '\\', 0 };
+        switch (c) {
+            case '"':  esc[1] = '"'; break;
+            case '\\': esc[1] = '\\'; break;
+            case '\n': esc[1] = 'n'; break;
+            case '\r': esc[1] = 'r'; break;
+            case '\t': esc[1] = 't'; break;
+            case '\b': esc[1] = 'b'; break;
+            case '\f': esc[1] = 'f'; break;
+            default:
+                memcpy(esc + 1, "u00", 3);
+                esc[4] = hex_chars[c >> 4];
+                esc[5] = hex_chars[c & 0x0F];
+                break;
+        }
+        append(jb, esc);
+    }
+    textbuf_append_n(&jb->tb, run, ptr - run);
+}
+
+bool jsonbuf_string(jsonbuf_t *jb, const char *name, const char *str)
+{
+    if (jb->skipped) {
+        return false;
+    }
+
+    size_t mark = member_begin(jb, name);
+    append(jb, "\"");
+    append_escaped(jb, str);
+    append(jb, "\"");
+    return member_end(jb, mark);
+}
+
+bool jsonbuf_string_key(jsonbuf_t *jb, const char *key, const char *str)
+{
+    if (jb->skipped) {
+        return false;
+    }
+
+    size_t mark = member_begin(jb, NULL);
+    append(jb, key);
+    append(jb, "\"");
+    append_escaped(jb, str);
+    append(jb, "\"");
+    return member_end(jb, mark);
+}
+
+bool jsonbuf_raw(jsonbuf_t *jb, const char *name, const char *json)
+{
+    if (jb->skipped) {
+        return false;
+    }
+
+    size_t mark = member_begin(jb, name);
+    append(jb, json);
+    return member_end(jb, mark);
+}
+
+static bool is_digit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+/*
+ * True if strtof() would consume the whole string. Plain decimals are
+ * checked here, the rare hex, inf and nan forms and leading spaces are
+ * left to strtof() itself.
+ */
+static bool is_number(const char *value, size_t len)
+{
+    const char *ptr = value;
+    const char *end = value + len;
+    int digits = 0;
+
+    if (*ptr == '+' || *ptr == '-') {
+        ptr++;
+    }
+
+    char c = *ptr;
+    if (c == ' ' || (c >= '\t' && c <= '\r') ||
+        c == 'i' || c == 'I' || c == 'n' || c == 'N' ||
+        (c == '0' && (ptr[1] == 'x' || ptr[1] == 'X'))) {
+        char *endptr = NULL;
+        strtof(value, &endptr);
+        return endptr == end;
+    }
+
+    /* Empty value is taken for a number, as strtof() consumes all of it */
+    if (ptr == end) {
+        return ptr == value;
+    }
+
+    for (; is_digit(*ptr); ptr++) {
+        digits++;
+    }
+    if (*ptr == '.') {
+        for (ptr++; is_digit(*ptr); ptr++) {
+            digits++;
+        }
+    }
+    if (!digits) {
+        return false;
+    }
+
+    if (*ptr == 'e' || *ptr == 'E') {
+        ptr++;
+        if (*ptr == '+' || *ptr == '-') {
+            ptr++;
+        }
+        if (!is_digit(*ptr)) {
+            return false;
+        }
+        while (is_digit(*ptr)) {
+            ptr++;
+        }
+    }
+
+    return ptr == end;
+}
+
+bool jsonbuf_is_number(const char *value)
+{
+    /* leading zeros are not allowed for regular numbers in JSON */
+    if (value[0] == '0' && value[1] != '.' && value[1] != '\0') {
+        return false;
+    }
+
+    return is_number(value, strlen(value));
+}
+
+bool jsonbuf_value(jsonbuf_t *jb, const char *name, const char *value)
+{
+    size_t len = strlen(value);
+    bool needs_quotes = !jsonbuf_is_number(value);
+
+    /* objects and arrays are written as they are, their elements
+     * must be escaped by the decoder */
+    if (len && value[0] == '{' && value[len - 1] == '}') {
+        needs_quotes = false;
+    }
+    if (len && value[0] == '[' && value[len - 1] == ']') {
+        needs_quotes = false;
+    }
+
+    if (needs_quotes) {
+        return jsonbuf_string(jb, name, value);
+    }
+    return jsonbuf_raw(jb, name, value);
+}
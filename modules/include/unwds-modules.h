@@ -133,7 +133,4 @@ static const unwds_module_desc_t unwds_modules_list[] = {
     { .id = UNWDS_ST95_MODULE_ID,      .name = "st95",      .cmd = &umdk_st95_command,       .reply = &umdk_st95_reply      },
 };
 
-bool (*umdk_reply_ptr)(uint8_t*, int, mqtt_msg_t*);
-void (*umdk_command_ptr)(char*, char*, int);
-
 #endif
\ No newline at end of file
@@ -39,8 +39,6 @@
 
 bool umdk_4btn_reply(uint8_t *moddata, int moddatalen, mqtt_msg_t *mqtt_msg)
 {
-    char buf[100];
-
     uint8_t btn = moddata[0];
     uint8_t dir = moddata[1];
 
@@ -48,12 +46,11 @@ bool umdk_4btn_reply(uint8_t *moddata, int moddatalen, mqtt_msg_t *mqtt_msg)
         return false;
     }
 
-    snprintf(buf, sizeof(buf), "%d", btn);
-    add_value_pair(mqtt_msg, "btn", buf);
+    add_int_value(mqtt_msg, "btn", btn);
     if (dir) {
-        add_value_pair(mqtt_msg, "state", "released");
+        add_string_value(mqtt_msg, "state", "released");
     } else {
-        add_value_pair(mqtt_msg, "state", "pressed");
+        add_string_value(mqtt_msg, "state", "pressed");
     }
     
     return true;
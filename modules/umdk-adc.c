@@ -71,13 +71,11 @@ void umdk_adc_command(char *param, char *out, int bufsize) {
 
 bool umdk_adc_reply(uint8_t *moddata, int moddatalen, mqtt_msg_t *mqtt_msg)
 {
-    char buf[100];
-
     if (moddatalen == 1) {
         if (moddata[0] == 0) {
-            add_value_pair(mqtt_msg, "msg", "ok");
+            add_string_value(mqtt_msg, "msg", "ok");
         } else {
-            add_value_pair(mqtt_msg, "msg", "error");
+            add_string_value(mqtt_msg, "msg", "error");
         }
         return true;
     }
@@ -91,11 +89,10 @@ bool umdk_adc_reply(uint8_t *moddata, int moddatalen, mqtt_msg_t *mqtt_msg)
         snprintf(ch, sizeof(ch), "adc%d", (i / 2) + 1);
 
         if (sensor == 0xFFFF) {
-            add_value_pair(mqtt_msg, ch, "null");
+            add_string_value(mqtt_msg, mqtt_msg_strdup(mqtt_msg, ch), "null");
         }
         else {
-            snprintf(buf, sizeof(buf), "%d", sensor);
-            add_value_pair(mqtt_msg, ch, buf);
+            add_int_value(mqtt_msg, mqtt_msg_strdup(mqtt_msg, ch), sensor);
         }
     }
     return true;
@@ -52,8 +52,9 @@ void umdk_config_command(char *param, char *out, int bufsize) {
     if (strstr(param, "mod ") == param) {
         param += strlen("mod "); // skip command
 
-        char *name = strtok(param, " ");
-        char *state = strtok(NULL, " ");
+        char *saveptr;
+        char *name = strtok_r(param, " ", &saveptr);
+        char *state = strtok_r(NULL, " ", &saveptr);
         
         int id = 0;
         int onoff = 0;
@@ -97,11 +98,11 @@ bool umdk_config_reply(uint8_t *moddata, int moddatalen, mqtt_msg_t *mqtt_msg)
     
     switch (reply_type) {
         case UMDK_CONFIG_REPLY_OK: {
-            add_value_pair(mqtt_msg, "msg", "ok");
+            add_string_value(mqtt_msg, "msg", "ok");
             break;
         }
         case UMDK_CONFIG_REPLY_ERR: {
-            add_value_pair(mqtt_msg, "msg", "error");
+            add_string_value(mqtt_msg, "msg", "error");
             break;
         }
     }
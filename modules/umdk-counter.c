@@ -73,18 +73,16 @@ void umdk_counter_command(char *param, char *out, int bufsize)
 
 bool umdk_counter_reply(uint8_t *moddata, int moddatalen, mqtt_msg_t *mqtt_msg)
 {
-    char buf[100];
-
     if (moddatalen == 1) {
         switch (moddata[0]) {
             case UMDK_COUNTER_REPLY_OK:
-                add_value_pair(mqtt_msg, "msg", "ok");
+                add_string_value(mqtt_msg, "msg", "ok");
                 break;
             case UMDK_COUNTER_REPLY_UNKNOWN_COMMAND:
-                add_value_pair(mqtt_msg, "msg", "invalid command");
+                add_string_value(mqtt_msg, "msg", "invalid command");
                 break;
             case UMDK_COUNTER_REPLY_INV_PARAMETER:
-                add_value_pair(mqtt_msg, "msg", "invalid parameter");
+                add_string_value(mqtt_msg, "msg", "invalid parameter");
                 break;
         }
         return true;
@@ -115,8 +113,7 @@ bool umdk_counter_reply(uint8_t *moddata, int moddatalen, mqtt_msg_t *mqtt_msg)
     
     for (i = 0; i < 4; i++) {   
         snprintf(ch, sizeof(ch), "v%d", i);
-        snprintf(buf, sizeof(buf), "%u", values[i]);
-        add_value_pair(mqtt_msg, ch, buf);
+        add_uint_value(mqtt_msg, mqtt_msg_strdup(mqtt_msg, ch), values[i]);
     }
     
     return true;
@@ -488,7 +488,6 @@ bool umdk_dali_reply(uint8_t *moddata, int moddatalen, mqtt_msg_t *mqtt_msg)
 {
 	char buf[100];
     char strbuf[20];
-	char buf_addr[10];
 	int i = 0;
 	
 #if DALI_DEBUG	
@@ -502,13 +501,13 @@ bool umdk_dali_reply(uint8_t *moddata, int moddatalen, mqtt_msg_t *mqtt_msg)
 
    if (moddatalen == 1) {
         if (moddata[0] == UMDK_DALI_OK_REPLY) {
-            add_value_pair(mqtt_msg, "msg", "ok");
+            add_string_value(mqtt_msg, "msg", "ok");
         } else if(moddata[0] == UMDK_DALI_ERROR_REPLY){
-            add_value_pair(mqtt_msg, "msg", "error");
+            add_string_value(mqtt_msg, "msg", "error");
 		} else if(moddata[0] == UMDK_DALI_INVALID_CMD_REPLY){
-			add_value_pair(mqtt_msg, "msg", "invalid command");
+			add_string_value(mqtt_msg, "msg", "invalid command");
 		} else if(moddata[0] == UMDK_DALI_WAIT_REPLY){
-			add_value_pair(mqtt_msg, "msg", "please wait");
+			add_string_value(mqtt_msg, "msg", "please wait");
 		}
         return true;
     }	
@@ -522,26 +521,23 @@ bool umdk_dali_reply(uint8_t *moddata, int moddatalen, mqtt_msg_t *mqtt_msg)
 		if((address >> 6) == DALI_GROUP_ADDR) {
 			address = address & DALI_BROADCAST;
 			if(address == DALI_BROADCAST) {
-				snprintf(buf_addr, sizeof(buf_addr), "%d", 127);
-				add_value_pair(mqtt_msg, "address", buf_addr);
+				add_int_value(mqtt_msg, "address", 127);
 			}
 			else if(address < DALI_BROADCAST) {
-				snprintf(buf_addr, sizeof(buf_addr), "%d", address);
-				add_value_pair(mqtt_msg, "group", buf_addr);
+				add_int_value(mqtt_msg, "group", address);
 			}
 		}
 		else if((address >> 6) == DALI_SHORT_ADDR) {
 			address = address & DALI_BROADCAST;
-			snprintf(buf_addr, sizeof(buf_addr), "%d", address);
-			add_value_pair(mqtt_msg, "address", buf_addr);
+			add_int_value(mqtt_msg, "address", address);
 		}
 	}
 
 	if (moddatalen == 2) {
 		if (moddata[0] == UMDK_DALI_OK_REPLY) {
-            add_value_pair(mqtt_msg, "msg", "ok");
+            add_string_value(mqtt_msg, "msg", "ok");
         } else if(moddata[0] == UMDK_DALI_ERROR_REPLY){
-            add_value_pair(mqtt_msg, "msg", "error");
+            add_string_value(mqtt_msg, "msg", "error");
 		}
 
 		return true;
@@ -563,13 +559,12 @@ bool umdk_dali_reply(uint8_t *moddata, int moddatalen, mqtt_msg_t *mqtt_msg)
 	switch(cmd) {
 
 		case DALI_INIT_SINGLE: {
-			snprintf(strbuf, sizeof(strbuf), "%d", data);
-			add_value_pair(mqtt_msg, "init address", strbuf);
+			add_int_value(mqtt_msg, "init address", data);
 			break;
 		}
 		case DALI_INIT_RAND: {
 			if(data == DALI_DATA_ERR) {
-				add_value_pair(mqtt_msg, "init addresses", "not init");
+				add_string_value(mqtt_msg, "init addresses", "not init");
 			}
 			else {
 				strcat(buf, "[ ");
@@ -585,116 +580,116 @@ bool umdk_dali_reply(uint8_t *moddata, int moddatalen, mqtt_msg_t *mqtt_msg)
 
 		case DALI_CMD_QUERY_BALLAST: {
 			if(data == DALI_YES) {
-				add_value_pair(mqtt_msg, "ballast", "yes");
+				add_string_value(mqtt_msg, "ballast", "yes");
 			}
 			else if(data == DALI_NO) {
-				add_value_pair(mqtt_msg, "ballast", "no");
+				add_string_value(mqtt_msg, "ballast", "no");
 			}
 			break;
 		}
 		case DALI_CMD_QUERY_LAMP_FAIL: {
 			if(data == DALI_YES) {
-				add_value_pair(mqtt_msg, "lamp failure", "yes");
+				add_string_value(mqtt_msg, "lamp failure", "yes");
 			}
 			else if(data == DALI_NO) {
-				add_value_pair(mqtt_msg, "lamp failure", "no");
+				add_string_value(mqtt_msg, "lamp failure", "no");
 			}
 			break;
 		}
 		case DALI_CMD_QUERY_LAMP_POWER_ON: {
 			if(data == DALI_YES) {
-				add_value_pair(mqtt_msg, "lamp operating", "yes");
+				add_string_value(mqtt_msg, "lamp operating", "yes");
 			}
 			else if(data == DALI_NO) {
-				add_value_pair(mqtt_msg, "lamp operating", "no");
+				add_string_value(mqtt_msg, "lamp operating", "no");
 			}
 			break;
 		}
 		case DALI_CMD_QUERY_LIMIT_ERROR: {
 			if(data == DALI_YES) {
-				add_value_pair(mqtt_msg, "limit error", "yes");
+				add_string_value(mqtt_msg, "limit error", "yes");
 			}
 			else if(data == DALI_NO) {
-				add_value_pair(mqtt_msg, "limit error", "no");
+				add_string_value(mqtt_msg, "limit error", "no");
 			}
 			break;
 		}
 		case DALI_CMD_QUERY_RESET_STATE: {
 			if(data == DALI_YES) {
-				add_value_pair(mqtt_msg, "reset state", "yes");
+				add_string_value(mqtt_msg, "reset state", "yes");
 			}
 			else if(data == DALI_NO) {
-				add_value_pair(mqtt_msg, "reset state", "no");
+				add_string_value(mqtt_msg, "reset state", "no");
 			}
 			break;
 		}
 		case DALI_CMD_QUERY_MISS_SHORT_ADDR: {
 			if(data == DALI_YES) {
-				add_value_pair(mqtt_msg, "missing address", "yes");
+				add_string_value(mqtt_msg, "missing address", "yes");
 			}
 			else if(data == DALI_NO) {
-				add_value_pair(mqtt_msg, "missing address", "no");
+				add_string_value(mqtt_msg, "missing address", "no");
 			}
 			break;
 		}
 		case DALI_CMD_QUERY_POWER_FAIL:	{
 			if(data == DALI_YES) {
-				add_value_pair(mqtt_msg, "power failure", "yes");
+				add_string_value(mqtt_msg, "power failure", "yes");
 			}
 			else if(data == DALI_NO) {
-				add_value_pair(mqtt_msg, "power failure", "no");
+				add_string_value(mqtt_msg, "power failure", "no");
 			}
 			break;
 		}
 
 		case DALI_CMD_QUERY_STATUS: {
 			if(((data >> 7) & 0x01) == 1) {
-				add_value_pair(mqtt_msg, "power failure", "yes");
+				add_string_value(mqtt_msg, "power failure", "yes");
 			}
 			else {
-				add_value_pair(mqtt_msg, "power failure", "no");
+				add_string_value(mqtt_msg, "power failure", "no");
 			}
 			if(((data >> 6) & 0x01) == 1) {
-				add_value_pair(mqtt_msg, "missing address", "yes");
+				add_string_value(mqtt_msg, "missing address", "yes");
 			}
 			else {
-				add_value_pair(mqtt_msg, "missing address", "no");
+				add_string_value(mqtt_msg, "missing address", "no");
 			}
 			if(((data >> 5) & 0x01) == 1) {
-				add_value_pair(mqtt_msg, "reset state", "yes");
+				add_string_value(mqtt_msg, "reset state", "yes");
 			}
 			else {
-				add_value_pair(mqtt_msg, "reset state", "no");
+				add_string_value(mqtt_msg, "reset state", "no");
 			}
 			if(((data >> 4) & 0x01) == 1) {
-				add_value_pair(mqtt_msg, "fade", "running");
+				add_string_value(mqtt_msg, "fade", "running");
 			}
 			else {
-				add_value_pair(mqtt_msg, "fade", "ready");
+				add_string_value(mqtt_msg, "fade", "ready");
 			}
 			if(((data >> 3) & 0x01) == 1) {
-				add_value_pair(mqtt_msg, "limit error", "yes");
+				add_string_value(mqtt_msg, "limit error", "yes");
 			}
 			else {
-				add_value_pair(mqtt_msg, "limit error", "no");
+				add_string_value(mqtt_msg, "limit error", "no");
 			}
 			if(((data >> 2) & 0x01) == 1) {
-				add_value_pair(mqtt_msg, "power", "on");
+				add_string_value(mqtt_msg, "power", "on");
 			}
 			else {
-				add_value_pair(mqtt_msg, "power", "off");
+				add_string_value(mqtt_msg, "power", "off");
 			}
 			if(((data >> 1) & 0x01) == 1) {
-				add_value_pair(mqtt_msg, "lamp failure", "yes");
+				add_string_value(mqtt_msg, "lamp failure", "yes");
 			}
 			else {
-				add_value_pair(mqtt_msg, "lamp failure", "no");
+				add_string_value(mqtt_msg, "lamp failure", "no");
 			}
 			if(((data >> 0) & 0x01) == 1) {
-				add_value_pair(mqtt_msg, "ballast", "no");
+				add_string_value(mqtt_msg, "ballast", "no");
 			}
 			else {
-				add_value_pair(mqtt_msg, "ballast", "yes");
+				add_string_value(mqtt_msg, "ballast", "yes");
 			}
 			break;
 		}
@@ -704,65 +699,58 @@ bool umdk_dali_reply(uint8_t *moddata, int moddatalen, mqtt_msg_t *mqtt_msg)
 			break;
 		}
 		case DALI_CMD_QUERY_CONTENT_DTR: {
-			snprintf(buf, sizeof(buf), "%d", data);
-			add_value_pair(mqtt_msg, "content", buf);
+			add_int_value(mqtt_msg, "content", data);
 			break;
 		}
 		case DALI_CMD_QUERY_DEVICE_TYPE: {
 			if(data == 0) {
-				add_value_pair(mqtt_msg, "type", "fluorescent lamp");
+				add_string_value(mqtt_msg, "type", "fluorescent lamp");
 			}
 			else if(data == 1) {
-				add_value_pair(mqtt_msg, "type", "emergency lighting");
+				add_string_value(mqtt_msg, "type", "emergency lighting");
 			}
 			else if(data == 2) {
-				add_value_pair(mqtt_msg, "type", "HID lamp");
+				add_string_value(mqtt_msg, "type", "HID lamp");
 			}
 			else if(data == 3) {
-				add_value_pair(mqtt_msg, "type", "dimming bulb");
+				add_string_value(mqtt_msg, "type", "dimming bulb");
 			}
 			else if(data == 4) {
-				add_value_pair(mqtt_msg, "type", "incandescent lamp");
+				add_string_value(mqtt_msg, "type", "incandescent lamp");
 			}
 			else if(data == 5) {
-				add_value_pair(mqtt_msg, "type", "digital signal");
+				add_string_value(mqtt_msg, "type", "digital signal");
 			}
 			else if(data == 6) {
-				add_value_pair(mqtt_msg, "type", "LED");
+				add_string_value(mqtt_msg, "type", "LED");
 			}
 			else {
-				snprintf(buf, sizeof(buf), "%d", data);
-				add_value_pair(mqtt_msg, "type", buf);
+				add_int_value(mqtt_msg, "type", data);
 			}
 			break;
 		}
 		case DALI_CMD_QUERY_PHYS_MIN_LEVEL: {
-			snprintf(buf, sizeof(buf), "%d", data);
-			add_value_pair(mqtt_msg, "physical min", buf);
+			add_int_value(mqtt_msg, "physical min", data);
 			break;
 		}
 		case DALI_CMD_QUERY_MAX_LEVEL: {
 			level = (uint8_t)pow(10.0, ((3*((float)data) - 256) / 253));
-			snprintf(buf, sizeof(buf), "%d", level);
-			add_value_pair(mqtt_msg, "max level", buf);
+			add_int_value(mqtt_msg, "max level", level);
 			break;
 		}
 		case DALI_CMD_QUERY_MIN_LEVEL: {
 			level = (uint8_t)pow(10.0, ((3*((float)data) - 256) / 253));
-			snprintf(buf, sizeof(buf), "%d", level);
-			add_value_pair(mqtt_msg, "min level", buf);
+			add_int_value(mqtt_msg, "min level", level);
 			break;
 		}
 		case DALI_CMD_QUERY_POWER_ON_LEVEL: {
 			level = (uint8_t)pow(10.0, ((3*((float)data) - 256) / 253));
-			snprintf(buf, sizeof(buf), "%d", level);
-			add_value_pair(mqtt_msg, "power on level", buf);
+			add_int_value(mqtt_msg, "power on level", level);
 			break;
 		}
 		case DALI_CMD_QUERY_SYS_FAIL_LEVEL: {
 			level = (uint8_t)pow(10.0, ((3*((float)data) - 256) / 253));
-			snprintf(buf, sizeof(buf), "%d", level);
-			add_value_pair(mqtt_msg, "system failure level", buf);
+			add_int_value(mqtt_msg, "system failure level", level);
 			break;
 		}
 		case DALI_CMD_QUERY_FADE: {
@@ -792,18 +780,17 @@ bool umdk_dali_reply(uint8_t *moddata, int moddatalen, mqtt_msg_t *mqtt_msg)
 			snprintf(buf, sizeof(buf), "%d scene level", scene_tmp);
 			
 			if(data == DALI_DATA_ERR) {
-				add_value_pair(mqtt_msg, buf, "not set");
+				add_string_value(mqtt_msg, mqtt_msg_strdup(mqtt_msg, buf), "not set");
 			}
 			else {
 				level = (uint8_t)pow(10.0, ((3*((float)data) - 256) / 253));
-				snprintf(strbuf, sizeof(strbuf), "%d", level);
-				add_value_pair(mqtt_msg, buf, strbuf);
+				add_int_value(mqtt_msg, mqtt_msg_strdup(mqtt_msg, buf), level);
 			}
 			break;
 		}
 		case DALI_CMD_QUERY_GROUPS_0_7: {
 			if(data == 0) {
-				add_value_pair(mqtt_msg, "groups 0-7", "not belong");
+				add_string_value(mqtt_msg, "groups 0-7", "not belong");
 			}
 			else {
 				strcat(buf, "[ ");
@@ -820,7 +807,7 @@ bool umdk_dali_reply(uint8_t *moddata, int moddatalen, mqtt_msg_t *mqtt_msg)
 		}
 		case DALI_CMD_QUERY_GROUPS_8_15: {
 			if(data == 0) {
-				add_value_pair(mqtt_msg, "groups 8-15", "not belong");
+				add_string_value(mqtt_msg, "groups 8-15", "not belong");
 			}
 			else {
 				strcat(buf, "[ ");
@@ -837,12 +824,11 @@ bool umdk_dali_reply(uint8_t *moddata, int moddatalen, mqtt_msg_t *mqtt_msg)
 		}
 		case DALI_CMD_QUERY_ACTUAL_LEVEL: {
 			if(data == DALI_DATA_ERR) {
-				add_value_pair(mqtt_msg, "actual level", "error");
+				add_string_value(mqtt_msg, "actual level", "error");
 			}
 			else {
 				level = (uint8_t)pow(10.0, ((3*((float)data) - 256) / 253) + UMDK_DALI_PRECISION);
-				snprintf(buf, sizeof(buf), "%d", level);
-				add_value_pair(mqtt_msg, "actual level", buf);			
+				add_int_value(mqtt_msg, "actual level", level);			
 			}
 			break;
 		}
@@ -36,6 +36,7 @@
 
 #include "unwds-modules.h"
 #include "utils.h"
+#include "textbuf.h"
 
 typedef enum {
 	UMDK_GPIO_REPLY_OK_0 = 0,
@@ -119,16 +120,21 @@ bool umdk_gpio_reply(uint8_t *moddata, int moddatalen, mqtt_msg_t *mqtt_msg)
             /* 0b111 means pin not used, 0b110 — AIN, 0b100 — AF */
             
             int i = 0;
-            char buf[100] = {};
-            char status[10];
+            char buf[100];
+            textbuf_t tb;
             
-            strcat(buf, "[ ");
+            textbuf_init(&tb, buf, sizeof(buf));
+            textbuf_append(&tb, "[ ");
             for (i = 0; i < ((moddatalen - 1) * 2); i++) {
+                /* "d, " and the closing bracket */
+                if (textbuf_avail(&tb) < 4) {
+                    break;
+                }
                 int pin_data = (moddata[1 + i/2] >> (4*(i%2))) & 0b111;
-                snprintf(status, sizeof(status), "%d, ", pin_data);
-                strcat(buf, status);
+                textbuf_append_uint(&tb, pin_data);
+                textbuf_append(&tb, ", ");
             }
-            strcat(buf, "]");
+            textbuf_append_char(&tb, ']');
             add_value_pair(mqtt_msg, "gpios", buf);
             
             /*
@@ -163,27 +169,27 @@ bool umdk_gpio_reply(uint8_t *moddata, int moddatalen, mqtt_msg_t *mqtt_msg)
         }
 
         case UMDK_GPIO_REPLY_OK_0: { /*  */
-            add_value_pair(mqtt_msg, "value", "0");
+            add_int_value(mqtt_msg, "value", 0);
             break;
         }
         case UMDK_GPIO_REPLY_OK_1: { /*  */
-            add_value_pair(mqtt_msg, "value", "1");
+            add_int_value(mqtt_msg, "value", 1);
             break;
         }
         case UMDK_GPIO_REPLY_OK: { /*  */
-            add_value_pair(mqtt_msg, "msg", "set ok");
+            add_string_value(mqtt_msg, "msg", "set ok");
             break;
         }
         case UMDK_GPIO_REPLY_ERR_PIN: { /*  */
-            add_value_pair(mqtt_msg, "msg", "invalid pin");
+            add_string_value(mqtt_msg, "msg", "invalid pin");
             break;
         }
         case UMDK_GPIO_REPLY_ERR_FORMAT: { /*  */
-            add_value_pair(mqtt_msg, "msg", "invalid format");
+            add_string_value(mqtt_msg, "msg", "invalid format");
             break;
         }
         case UMDK_GPIO_REPLY_OK_AINAF: {
-            add_value_pair(mqtt_msg, "value", "3");
+            add_int_value(mqtt_msg, "value", 3);
             break;
         }
         default:
@@ -52,10 +52,8 @@ void umdk_gps_command(char *param, char *out, int bufsize) {
 
 bool umdk_gps_reply(uint8_t *moddata, int moddatalen, mqtt_msg_t *mqtt_msg)
 {
-    char buf[100];
-
     if (moddata[0] == UMDK_GPS_DATA) {
-        add_value_pair(mqtt_msg, "valid", (moddata[1] > 0)?"true":"false");
+        add_string_value(mqtt_msg, "valid", (moddata[1] > 0)?"true":"false");
         
         int32_t latitude;
         memcpy((void *)&latitude, &moddata[2], 4);
@@ -73,22 +71,18 @@ bool umdk_gps_reply(uint8_t *moddata, int moddatalen, mqtt_msg_t *mqtt_msg)
         memcpy((void *)&direction, &moddata[12], 2);
         convert_from_be_sam((void *)&direction, sizeof(direction));
         
-        snprintf(buf, sizeof(buf), "%f", (double)latitude/1000000);
-        add_value_pair(mqtt_msg, "lat", buf);
-        snprintf(buf, sizeof(buf), "%f", (double)longitude/1000000);
-        add_value_pair(mqtt_msg, "lon", buf);
-        snprintf(buf, sizeof(buf), "%d", velocity);
-        add_value_pair(mqtt_msg, "vel", buf);
-        snprintf(buf, sizeof(buf), "%f", (double)direction/100);
-        add_value_pair(mqtt_msg, "dir", buf);
+        add_float_value(mqtt_msg, "lat", (double)latitude/1000000, 6);
+        add_float_value(mqtt_msg, "lon", (double)longitude/1000000, 6);
+        add_int_value(mqtt_msg, "vel", velocity);
+        add_float_value(mqtt_msg, "dir", (double)direction/100, 6);
     }
     
     if (moddata[0] == UMDK_GPS_COMMAND) {
-        add_value_pair(mqtt_msg, "msg", "ok");
+        add_string_value(mqtt_msg, "msg", "ok");
     }
 
     if (moddata[0] == UMDK_GPS_REPLY_ERROR) {
-        add_value_pair(mqtt_msg, "msg", "error");
+        add_string_value(mqtt_msg, "msg", "error");
     }
     
     return true;
@@ -98,11 +98,11 @@ bool umdk_hd44780_reply(uint8_t *moddata, int moddatalen, mqtt_msg_t *mqtt_msg)
     uint8_t reply_type = moddata[0];
     switch (reply_type) {
         case UMDK_HD44780_REPLY_OK: { /*  */
-            add_value_pair(mqtt_msg, "msg", "ok");
+            add_string_value(mqtt_msg, "msg", "ok");
             break;
         }
         case UMDK_HD44780_REPLY_ERR: { /*  */
-            add_value_pair(mqtt_msg, "msg", "error");
+            add_string_value(mqtt_msg, "msg", "error");
             break;
         }
         default:
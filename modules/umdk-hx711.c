@@ -70,23 +70,19 @@ void umdk_hx711_command(char *param, char *out, int bufsize) {
 
 bool umdk_hx711_reply(uint8_t *moddata, int moddatalen, mqtt_msg_t *mqtt_msg)
 {
-    char buf[100];
-    
     switch (moddata[0]) {
         case UMDK_HX711_DATA_OK:
-            add_value_pair(mqtt_msg, "msg", "ok");
+            add_string_value(mqtt_msg, "msg", "ok");
             break;
         case UMDK_HX711_DATA_ERROR:
-            add_value_pair(mqtt_msg, "msg", "error");
+            add_string_value(mqtt_msg, "msg", "error");
             break;
         case UMDK_HX711_DATA_DATA: {
             uint32_t weight = moddata[1] | (moddata[2] << 8) | (moddata[3] << 16) | (moddata[4] << 24);
-            snprintf(buf, sizeof(buf), "%" PRIu32, weight);
-            add_value_pair(mqtt_msg, "weight", buf);
+            add_uint_value(mqtt_msg, "weight", weight);
             
             uint32_t raw = moddata[5] | (moddata[6] << 8) | (moddata[7] << 16) | (moddata[8] << 24);
-            snprintf(buf, sizeof(buf), "%" PRIu32, raw);
-            add_value_pair(mqtt_msg, "raw", buf);
+            add_uint_value(mqtt_msg, "raw", raw);
             break;
         }
         default:
@@ -57,10 +57,10 @@ bool umdk_ibutton_reply(uint8_t *moddata, int moddatalen, mqtt_msg_t *mqtt_msg)
 		
     if (moddatalen == 1) {
         if (moddata[0] == UMDK_IBUTTON_OK) {
-            add_value_pair(mqtt_msg, "msg", "OK");
+            add_string_value(mqtt_msg, "msg", "OK");
         } 
 		else {
-            add_value_pair(mqtt_msg, "msg", "ERROR");
+            add_string_value(mqtt_msg, "msg", "ERROR");
         }
         return true;
     }
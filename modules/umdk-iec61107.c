@@ -36,6 +36,7 @@
 
 #include "unwds-modules.h"
 #include "utils.h"
+#include "textbuf.h"
 
 #define IEC61107_DEBUG 0
 
@@ -96,7 +97,7 @@ typedef enum {
     UMDK_IEC61107_INVALID_CMD_REPLY  	= 0xFF,
 } iec61107_reply_t;
 
-static char str_dow[7][4] = { "Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat" };
+static const char str_dow[7][4] = { "Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat" };
 
 void umdk_iec61107_command(char *param, char *out, int bufsize) {
 	uint8_t cmd = 0;		
@@ -429,15 +430,26 @@ void umdk_iec61107_command(char *param, char *out, int bufsize) {
 		
 }
 
+/* Copies text from the meter as is, cut to what fits */
+static void append_reply_text(textbuf_t *tb, const uint8_t *text, int len)
+{
+	if (len <= 0) {
+		return;
+	}
+	if ((size_t)len > textbuf_avail(tb)) {
+		len = textbuf_avail(tb);
+	}
+	textbuf_append_n(tb, (const char *)text, len);
+}
+
 bool umdk_iec61107_reply(uint8_t *moddata, int moddatalen, mqtt_msg_t *mqtt_msg)
 {
 	char buf[100];
-    char strbuf[20];
-	char buf_addr[10];
-	uint16_t num_char = 0;
 	uint16_t i = 0;
-	uint8_t symbol = 0;
 	uint8_t * data_ptr = NULL;
+	textbuf_t tb;
+
+	textbuf_init(&tb, buf, sizeof(buf));
 	
 #if IEC61107_DEBUG	
 	uint8_t ii;
@@ -450,13 +462,13 @@ bool umdk_iec61107_reply(uint8_t *moddata, int moddatalen, mqtt_msg_t *mqtt_msg)
 	
    if (moddatalen == 1) {
         if (moddata[0] == UMDK_IEC61107_OK_REPLY) {
-            add_value_pair(mqtt_msg, "msg", "ok");
+            add_string_value(mqtt_msg, "msg", "ok");
         } else if(moddata[0] == UMDK_IEC61107_ERROR_REPLY){
-            add_value_pair(mqtt_msg, "msg", "error");
+            add_string_value(mqtt_msg, "msg", "error");
 		} else if(moddata[0] == UMDK_IEC61107_INVALID_CMD_REPLY){
-			add_value_pair(mqtt_msg, "msg", "invalid command");
+			add_string_value(mqtt_msg, "msg", "invalid command");
 		} else if(moddata[0] == UMDK_IEC61107_INVALID_FORMAT_REPLY){
-			add_value_pair(mqtt_msg, "msg", "invalid format");
+			add_string_value(mqtt_msg, "msg", "invalid format");
 		}
         return true;
     }	
@@ -468,18 +480,17 @@ bool umdk_iec61107_reply(uint8_t *moddata, int moddatalen, mqtt_msg_t *mqtt_msg)
 	
 	if(cmd < IEC61107_CMD_PROPRIETARY_COMMAND) {
 
-		snprintf(buf_addr, sizeof(buf_addr), "%d", device);
-		add_value_pair(mqtt_msg, "device", buf_addr);
+		add_int_value(mqtt_msg, "device", device);
 										
 		if (moddatalen == 2) {
 			if (code == UMDK_IEC61107_OK_REPLY) {
-				add_value_pair(mqtt_msg, "msg", "ok");
+				add_string_value(mqtt_msg, "msg", "ok");
 			} else if(code == UMDK_IEC61107_ERROR_REPLY){
-				add_value_pair(mqtt_msg, "msg", "error");
+				add_string_value(mqtt_msg, "msg", "error");
 			} else if(code == UMDK_IEC61107_NO_RESPONSE_REPLY){
-				add_value_pair(mqtt_msg, "msg", "no response");					
+				add_string_value(mqtt_msg, "msg", "no response");					
 			} else if(code == UMDK_IEC61107_WAIT_REPLY){
-				add_value_pair(mqtt_msg, "msg", "please wait");					
+				add_string_value(mqtt_msg, "msg", "please wait");					
 			}
 			
 			return true;
@@ -487,25 +498,18 @@ bool umdk_iec61107_reply(uint8_t *moddata, int moddatalen, mqtt_msg_t *mqtt_msg)
 	}
 	else {
 		if(cmd == UMDK_IEC61107_CMD_DATABASE_ADD) {
-			add_value_pair(mqtt_msg, "cmd", "added");
+			add_string_value(mqtt_msg, "cmd", "added");
 		}
 		else if(cmd == UMDK_IEC61107_CMD_DATABASE_REMOVE) {
-			add_value_pair(mqtt_msg, "cmd", "removed");
+			add_string_value(mqtt_msg, "cmd", "removed");
 		}
 		else if(cmd == UMDK_IEC61107_CMD_DATABASE_FIND) {
-			add_value_pair(mqtt_msg, "cmd", "found");
+			add_string_value(mqtt_msg, "cmd", "found");
 		}
 		
-		snprintf(buf_addr, sizeof(buf_addr), "%d", device);
-		add_value_pair(mqtt_msg, "device", buf_addr);
-		
-		uint8_t *address_ptr = moddata + 4;	
+		add_int_value(mqtt_msg, "device", device);
 		
-		for(i = 0; i < (moddatalen - 4); i++) {
-			symbol = *address_ptr;
-			num_char += snprintf(buf + num_char, sizeof(buf) - num_char, "%c", symbol);
-			address_ptr++;
-		}
+		append_reply_text(&tb, moddata + 4, moddatalen - 4);
 		add_value_pair(mqtt_msg, "address", buf);		
 		return true;		
 	}
@@ -513,126 +517,90 @@ bool umdk_iec61107_reply(uint8_t *moddata, int moddatalen, mqtt_msg_t *mqtt_msg)
     if(moddatalen == 4) {
         
     if (code == UMDK_IEC61107_OK_REPLY) {
-        add_value_pair(mqtt_msg, "msg", "ok");
+        add_string_value(mqtt_msg, "msg", "ok");
         			return true;
     } else if(code == UMDK_IEC61107_ERROR_REPLY){
-        add_value_pair(mqtt_msg, "msg", "error");
+        add_string_value(mqtt_msg, "msg", "error");
         			return true;
     } else if(code == UMDK_IEC61107_NO_RESPONSE_REPLY){
-        add_value_pair(mqtt_msg, "msg", "no response");	
+        add_string_value(mqtt_msg, "msg", "no response");	
 			return true;        
     } else if(code == UMDK_IEC61107_WAIT_REPLY){
-        add_value_pair(mqtt_msg, "msg", "please wait");
+        add_string_value(mqtt_msg, "msg", "please wait");
 			return true;        
     }
     
     
     
-        char err_buf[5];
 		uint8_t error = moddata[2];
 		
-		snprintf(err_buf, sizeof(err_buf), "%d", error);
-		add_value_pair(mqtt_msg, "err", err_buf);
+		add_int_value(mqtt_msg, "err", error);
 		
 		if(error == 10) {
-			add_value_pair(mqtt_msg, "msg", "invalid number of parameters");
+			add_string_value(mqtt_msg, "msg", "invalid number of parameters");
 		}
 		else if(error == 11) {
-			add_value_pair(mqtt_msg, "msg", "not supported");
+			add_string_value(mqtt_msg, "msg", "not supported");
 		}
 		else if(error == 12) {
-			add_value_pair(mqtt_msg, "msg", "unknown parameter");
+			add_string_value(mqtt_msg, "msg", "unknown parameter");
 		}
 		else if(error == 13) {
-			add_value_pair(mqtt_msg, "msg", "invalid format");
+			add_string_value(mqtt_msg, "msg", "invalid format");
 		}
 		else if(error == 14) {
-			add_value_pair(mqtt_msg, "msg", "not initialized");
+			add_string_value(mqtt_msg, "msg", "not initialized");
 		}
 		else if(error == 15) {
-			add_value_pair(mqtt_msg, "msg", "access denied");
+			add_string_value(mqtt_msg, "msg", "access denied");
 		}
 		else if(error == 16) {
-			add_value_pair(mqtt_msg, "msg", "no programming rights");
+			add_string_value(mqtt_msg, "msg", "no programming rights");
 		}
 		else if(error == 17) {
-			add_value_pair(mqtt_msg, "msg", "invalid parameter value");
+			add_string_value(mqtt_msg, "msg", "invalid parameter value");
 		}
 		else if(error == 18) {
-			add_value_pair(mqtt_msg, "msg", "nonexistent parameter value");
+			add_string_value(mqtt_msg, "msg", "nonexistent parameter value");
 		}
     }
  
 	if(cmd == IEC61107_CMD_TIME) {
-		data_ptr = moddata + 4;	
-		for(i = 4; i < moddatalen; i++) {
-			symbol = *data_ptr;
-			num_char += snprintf(buf + num_char, sizeof(buf) - num_char, "%c", symbol);
-			data_ptr++;
-		}
+		append_reply_text(&tb, moddata + 4, moddatalen - 4);
 	
 		add_value_pair(mqtt_msg, "time", buf);				
 	}
 	else if(cmd == IEC61107_CMD_DATE) {
 		uint8_t dow = ( moddata[4] - 0x30) * 10 + ( moddata[5] - 0x30);
-		data_ptr = moddata + 7;	
 		add_value_pair(mqtt_msg, "day", str_dow[dow]);			
 			
-		for(i = 4; i < moddatalen; i++) {
-			symbol = *data_ptr;
-			num_char += snprintf(buf + num_char, sizeof(buf) - num_char, "%c", symbol);
-			data_ptr++;
-		}
+		/* Day of week and separator go first */
+		append_reply_text(&tb, moddata + 7, moddatalen - 7);
 	
 		add_value_pair(mqtt_msg, "date", buf);
 	}				
 	else if(cmd == IEC61107_CMD_SERIAL) {
-		data_ptr = moddata + 4;	
-		for(i = 4; i < moddatalen; i++) {
-			symbol = *data_ptr;
-			num_char += snprintf(buf + num_char, sizeof(buf) - num_char, "%c", symbol);
-			data_ptr++;
-		}
+		append_reply_text(&tb, moddata + 4, moddatalen - 4);
 	
 		add_value_pair(mqtt_msg, "serial", buf);
 	}
 	else if(cmd == IEC61107_CMD_ID_DEV) {
-		data_ptr = moddata + 4;	
-		for(i = 4; i < moddatalen; i++) {
-			symbol = *data_ptr;
-			num_char += snprintf(buf + num_char, sizeof(buf) - num_char, "%c", symbol);
-			data_ptr++;
-		}
+		append_reply_text(&tb, moddata + 4, moddatalen - 4);
 	
 		add_value_pair(mqtt_msg, "id device", buf);
 	}			
 	else if(cmd == IEC61107_CMD_GET_VOLT) {
-		data_ptr = moddata + 4;	
-		for(i = 4; i < moddatalen; i++) {
-			symbol = *data_ptr;
-			num_char += snprintf(buf + num_char, sizeof(buf) - num_char, "%c", symbol);
-			data_ptr++;
-		}
+		append_reply_text(&tb, moddata + 4, moddatalen - 4);
 	
 		add_value_pair(mqtt_msg, "voltage", buf);
 	}			
 	else if(cmd == IEC61107_CMD_GET_CURR) {
-		data_ptr = moddata + 4;	
-		for(i = 4; i < moddatalen; i++) {
-			symbol = *data_ptr;
-			num_char += snprintf(buf + num_char, sizeof(buf) - num_char, "%c", symbol);
-			data_ptr++;
-		}
+		append_reply_text(&tb, moddata + 4, moddatalen - 4);
 	
 		add_value_pair(mqtt_msg, "current", buf);
 	}			
 	else if(cmd == IEC61107_CMD_GET_POWER) {
-		data_ptr = moddata + 4;	
-		for(i = 4; i < moddatalen; i++) {
-			symbol = *data_ptr;
-			num_char += snprintf(buf + num_char, sizeof(buf) - num_char, "%c", symbol);
-			data_ptr++;
-		}
+		append_reply_text(&tb, moddata + 4, moddatalen - 4);
 	
 		add_value_pair(mqtt_msg, "power", buf);
 	}		
@@ -653,14 +621,13 @@ bool umdk_iec61107_reply(uint8_t *moddata, int moddatalen, mqtt_msg_t *mqtt_msg)
 		}	
 		
 		for(i = num_schedule; i < 12; i++) {
-			add_value_pair(mqtt_msg, "T00", "00:00");			
+			add_string_value(mqtt_msg, "T00", "00:00");			
 		}	
 	}			
 	else if(cmd == IEC61107_CMD_HOLIDAYS) {
 		uint8_t list = moddata[4];
 		
 		char list_str[5] = { };
-		char schedule_str[10] = { };
 		uint8_t num_holidays = (moddatalen  - 5) / 2;			
 		uint8_t day = 0;
 		uint8_t month = 0;
@@ -675,12 +642,10 @@ bool umdk_iec61107_reply(uint8_t *moddata, int moddatalen, mqtt_msg_t *mqtt_msg)
 			schedule = moddata[6 + 2*i] & 0x3F;
 			snprintf(buf, sizeof(buf), "%02d.%02d", day, month);
 
-			snprintf(schedule_str, sizeof(schedule_str), "%d", schedule);		
-
-			add_value_pair(mqtt_msg, buf, schedule_str);			
+			add_int_value(mqtt_msg, mqtt_msg_strdup(mqtt_msg, buf), schedule);			
 		}
 		for(i = num_holidays; i < 16; i++) {
-			add_value_pair(mqtt_msg, "00.00", "0");			
+			add_int_value(mqtt_msg, "00.00", 0);			
 		}
 		
 	}			
@@ -696,13 +661,9 @@ bool umdk_iec61107_reply(uint8_t *moddata, int moddatalen, mqtt_msg_t *mqtt_msg)
 		char tariff[5] = { };
 		for(i = 1; i < 5; i++) {
 			snprintf(tariff, sizeof(tariff), "T%02d", i);
-			int_to_float_str(strbuf, value[i], 2);
-			snprintf(buf, sizeof(buf), "%s", strbuf);
-			add_value_pair(mqtt_msg, tariff, buf);								
+			add_fixed_value(mqtt_msg, mqtt_msg_strdup(mqtt_msg, tariff), value[i], 2);								
 		}
-		int_to_float_str(strbuf, value[0], 2);
-		snprintf(buf, sizeof(buf), "%s", strbuf);
-		add_value_pair(mqtt_msg, "Total", buf);		
+		add_fixed_value(mqtt_msg, "Total", value[0], 2);		
 	}	
 	else if(cmd == IEC61107_CMD_TARIFF_DEFAULT) {
 		data_ptr = moddata + 4;	
@@ -739,105 +700,106 @@ bool umdk_iec61107_reply(uint8_t *moddata, int moddatalen, mqtt_msg_t *mqtt_msg)
 		snprintf(curr_tariff, sizeof(curr_tariff), "T%02d", curr_tar);
 		add_value_pair(mqtt_msg, "current tariff", curr_tariff);
 		
-		num_char = snprintf(buf, sizeof(buf), "[ ");		
+		textbuf_append(&tb, "[ ");
 		for(i = 0; i < 4; i++) {
 			if(tariff_sch & (1 << i)) {
-				num_char += snprintf(buf + num_char, sizeof(buf) - num_char, "%d, ", i + 1);
+				textbuf_append_uint(&tb, i + 1);
+				textbuf_append(&tb, ", ");
 			}									
 		}	
-		num_char += snprintf(buf + num_char, sizeof(buf) - num_char, "]");
+		textbuf_append(&tb, "]");
 		add_value_pair(mqtt_msg, "schedule tariffs", buf);
 		
 		if(err_schedule == 0x01){
-			add_value_pair(mqtt_msg, "schedule status", "error");			
+			add_string_value(mqtt_msg, "schedule status", "error");			
 		}
 		else if(err_schedule == 0x00) {
-			add_value_pair(mqtt_msg, "schedule status", "normal");
+			add_string_value(mqtt_msg, "schedule status", "normal");
 		}		
 		
 		if(season == 0x01){
-			add_value_pair(mqtt_msg, "season", "summer");			
+			add_string_value(mqtt_msg, "season", "summer");			
 		}
 		else if(season == 0x00) {
-			add_value_pair(mqtt_msg, "season", "winter");
+			add_string_value(mqtt_msg, "season", "winter");
 		}		
 		
 		if(stat_time == 0x01){
-			add_value_pair(mqtt_msg, "time status", "failure");			
+			add_string_value(mqtt_msg, "time status", "failure");			
 		}
 		else if(stat_time == 0x00) {
-			add_value_pair(mqtt_msg, "time status", "normal");
+			add_string_value(mqtt_msg, "time status", "normal");
 		}					
 		if(correct_time == 0x01){
-			add_value_pair(mqtt_msg, "time correction", "not allowed");			
+			add_string_value(mqtt_msg, "time correction", "not allowed");			
 		}
 		else if(correct_time == 0x00) {
-			add_value_pair(mqtt_msg, "time correction", "allowed");
+			add_string_value(mqtt_msg, "time correction", "allowed");
 		}			
 		
 		if(stat_batt == 0x01){
-			add_value_pair(mqtt_msg, "battery status", "discharged");			
+			add_string_value(mqtt_msg, "battery status", "discharged");			
 		}
 		else if(stat_batt == 0x00) {
-			add_value_pair(mqtt_msg, "battery status", "charged");
+			add_string_value(mqtt_msg, "battery status", "charged");
 		}
 		if(life_batt == 0x01){
-			add_value_pair(mqtt_msg, "battery lifetime", "expired");			
+			add_string_value(mqtt_msg, "battery lifetime", "expired");			
 		}
 		else if(life_batt == 0x00) {
-			add_value_pair(mqtt_msg, "battery lifetime", "normal");
+			add_string_value(mqtt_msg, "battery lifetime", "normal");
 		}		
 
 		if(stat_volt == 0x01){
-			add_value_pair(mqtt_msg, "voltage status", "overvoltage");			
+			add_string_value(mqtt_msg, "voltage status", "overvoltage");			
 		}
 		else if(stat_volt == 0x00) {
-			add_value_pair(mqtt_msg, "voltage status", "normal");
+			add_string_value(mqtt_msg, "voltage status", "normal");
 		}	
 		else if(stat_volt == 0x02) {
-			add_value_pair(mqtt_msg, "voltage status", "undervoltage");
+			add_string_value(mqtt_msg, "voltage status", "undervoltage");
 		}			
 		
 		if(load == 0x01){
-			add_value_pair(mqtt_msg, "load", "inductive");			
+			add_string_value(mqtt_msg, "load", "inductive");			
 		}
 		else if(load == 0x00) {
-			add_value_pair(mqtt_msg, "load", "capacitive");
+			add_string_value(mqtt_msg, "load", "capacitive");
 		}			
 		
 		if(energy_direct == 0x01){
-			add_value_pair(mqtt_msg, "direction", "reverse");			
+			add_string_value(mqtt_msg, "direction", "reverse");			
 		}
 		else if(energy_direct == 0x00) {
-			add_value_pair(mqtt_msg, "direction", "direct");
+			add_string_value(mqtt_msg, "direction", "direct");
 		}		
 			
 		if(cs_energy == 0x01){
-			add_value_pair(mqtt_msg, "energy values", "checksum error");			
+			add_string_value(mqtt_msg, "energy values", "checksum error");			
 		}
 		else if(cs_energy == 0x00) {
-			add_value_pair(mqtt_msg, "energy values", "normal");
+			add_string_value(mqtt_msg, "energy values", "normal");
 		}				
 		
 		if(stat_cover == 0x01){
-			add_value_pair(mqtt_msg, "tamper", "failure");			
+			add_string_value(mqtt_msg, "tamper", "failure");			
 		}
 		else if(stat_cover == 0x00) {
-			add_value_pair(mqtt_msg, "tamper", "normal");
+			add_string_value(mqtt_msg, "tamper", "normal");
 		}						
 		
 		if(cs_mem == 0x01){
-			add_value_pair(mqtt_msg, "program memory", "checksum error");			
+			add_string_value(mqtt_msg, "program memory", "checksum error");			
 		}
 		else if(cs_mem == 0x00) {
-			add_value_pair(mqtt_msg, "program memory", "normal");
+			add_string_value(mqtt_msg, "program memory", "normal");
 		}		
 
 		if(cs_metrolog == 0x01){
-			add_value_pair(mqtt_msg, "metrology", "checksum error");			
+			add_string_value(mqtt_msg, "metrology", "checksum error");			
 		}
 		else if(cs_metrolog == 0x00) {
-			add_value_pair(mqtt_msg, "metrology", "normal");
+			add_string_value(mqtt_msg, "metrology", "normal");
 		}		
 		
 	}
@@ -849,31 +811,31 @@ bool umdk_iec61107_reply(uint8_t *moddata, int moddatalen, mqtt_msg_t *mqtt_msg)
 		// add_value_pair(mqtt_msg, "err", err_buf);
 		
 		// if(error == 10) {
-			// add_value_pair(mqtt_msg, "msg", "invalid number of parameters");
+			// add_string_value(mqtt_msg, "msg", "invalid number of parameters");
 		// }
 		// else if(error == 11) {
-			// add_value_pair(mqtt_msg, "msg", "not supported");
+			// add_string_value(mqtt_msg, "msg", "not supported");
 		// }
 		// else if(error == 12) {
-			// add_value_pair(mqtt_msg, "msg", "unknown parameter");
+			// add_string_value(mqtt_msg, "msg", "unknown parameter");
 		// }
 		// else if(error == 13) {
-			// add_value_pair(mqtt_msg, "msg", "invalid format");
+			// add_string_value(mqtt_msg, "msg", "invalid format");
 		// }
 		// else if(error == 14) {
-			// add_value_pair(mqtt_msg, "msg", "not initialized");
+			// add_string_value(mqtt_msg, "msg", "not initialized");
 		// }
 		// else if(error == 15) {
-			// add_value_pair(mqtt_msg, "msg", "access denied");
+			// add_string_value(mqtt_msg, "msg", "access denied");
 		// }
 		// else if(error == 16) {
-			// add_value_pair(mqtt_msg, "msg", "no programming rights");
+			// add_string_value(mqtt_msg, "msg", "no programming rights");
 		// }
 		// else if(error == 17) {
-			// add_value_pair(mqtt_msg, "msg", "invalid parameter value");
+			// add_string_value(mqtt_msg, "msg", "invalid parameter value");
 		// }
 		// else if(error == 18) {
-			// add_value_pair(mqtt_msg, "msg", "nonexistent parameter value");
+			// add_string_value(mqtt_msg, "msg", "nonexistent parameter value");
 		// }
 	}
 				
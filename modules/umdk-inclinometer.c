@@ -45,7 +45,7 @@ bool umdk_inclinometer_reply(uint8_t *moddata, int moddatalen, mqtt_msg_t *mqtt_
     }
 
     if (state == 1) {
-        add_value_pair(mqtt_msg, "state", "opened");
+        add_string_value(mqtt_msg, "state", "opened");
     }
     
     return true;
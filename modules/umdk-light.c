@@ -65,23 +65,20 @@ void umdk_light_command(char *param, char *out, int bufsize) {
 
 bool umdk_light_reply(uint8_t *moddata, int moddatalen, mqtt_msg_t *mqtt_msg)
 {
-    char buf[100];
-    
     if (moddata[0] == UMDK_LIGHT_DATA) {
         uint16_t lum;
         memcpy((void *)&lum, &moddata[1], 2);
         convert_from_be_sam((void *)&lum, sizeof(lum));
         
-        snprintf(buf, sizeof(buf), "%d", lum);
-        add_value_pair(mqtt_msg, "luminocity", buf);
+        add_int_value(mqtt_msg, "luminocity", lum);
     }
 
     if (moddata[0] == UMDK_LIGHT_CMD_COMMAND) {
-        add_value_pair(mqtt_msg, "msg", "ok");
+        add_string_value(mqtt_msg, "msg", "ok");
     }
     
     if (moddata[0] == UMDK_LIGHT_CMD_FAIL) {
-        add_value_pair(mqtt_msg, "msg", "error");
+        add_string_value(mqtt_msg, "msg", "error");
     }
 
 	return true;
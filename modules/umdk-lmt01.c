@@ -59,13 +59,11 @@ void umdk_lmt01_command(char *param, char *out, int bufsize) {
 
 bool umdk_lmt01_reply(uint8_t *moddata, int moddatalen, mqtt_msg_t *mqtt_msg)
 {
-    char buf[100];
-
     if (moddatalen == 1) {
         if (moddata[0] == 0) {
-            add_value_pair(mqtt_msg, "msg", "ok");
+            add_string_value(mqtt_msg, "msg", "ok");
         } else {
-            add_value_pair(mqtt_msg, "msg", "error");
+            add_string_value(mqtt_msg, "msg", "error");
         }
         return true;
     }
@@ -80,11 +78,10 @@ bool umdk_lmt01_reply(uint8_t *moddata, int moddatalen, mqtt_msg_t *mqtt_msg)
         snprintf(ch, sizeof(ch), "s%d", (i / 2) + 1);
 
         if (sensor == 0x7FFF) {
-            add_value_pair(mqtt_msg, ch, "null");
+            add_string_value(mqtt_msg, mqtt_msg_strdup(mqtt_msg, ch), "null");
         }
         else {
-            int_to_float_str(buf, sensor, 1);
-            add_value_pair(mqtt_msg, ch, buf);
+            add_fixed_value(mqtt_msg, mqtt_msg_strdup(mqtt_msg, ch), sensor, 1);
         }
     }
     return true;
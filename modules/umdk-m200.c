@@ -91,7 +91,7 @@ typedef enum {
 	M200_INVALID_CMD_REPLY 	= 0xFF,
 } m200_reply_t;
 
-static char str_dow[8][4] = { "Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat", "Hol" };
+static const char str_dow[8][4] = { "Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat", "Hol" };
 
 void umdk_m200_command(char *param, char *out, int bufsize) {
 	uint32_t destination;
@@ -406,8 +406,6 @@ void umdk_m200_command(char *param, char *out, int bufsize) {
 bool umdk_m200_reply(uint8_t *moddata, int moddatalen, mqtt_msg_t *mqtt_msg)
 {
 	char buf[100];
-    char strbuf[20];
-	char buf_addr[30];
 	
 	// uint8_t ii;
     // printf("[m200] RX data:  ");
@@ -418,12 +416,12 @@ bool umdk_m200_reply(uint8_t *moddata, int moddatalen, mqtt_msg_t *mqtt_msg)
 
    if (moddatalen == 1) {
         if (moddata[0] == M200_OK_REPLY) {
-            add_value_pair(mqtt_msg, "msg", "ok");
+            add_string_value(mqtt_msg, "msg", "ok");
         } else if(moddata[0] == M200_ERROR_REPLY){
-            add_value_pair(mqtt_msg, "msg", "error");
+            add_string_value(mqtt_msg, "msg", "error");
 		}
 		else if(moddata[0] == M200_INVALID_CMD_REPLY){
-			add_value_pair(mqtt_msg, "msg", "invalid command");
+			add_string_value(mqtt_msg, "msg", "invalid command");
 		}
         return true;
     }	
@@ -433,16 +431,15 @@ bool umdk_m200_reply(uint8_t *moddata, int moddatalen, mqtt_msg_t *mqtt_msg)
 	if(cmd < M200_CMD_PROPRIETARY_COMMAND) {
 				
 		uint32_t address = moddata[2] | moddata[3] << 8 | moddata[4] << 16 | moddata[5] << 24;	
-		snprintf(buf_addr, sizeof(buf_addr), "%u", address);
-		add_value_pair(mqtt_msg, "Address", buf_addr);
+		add_uint_value(mqtt_msg, "Address", address);
 		
 		if (moddatalen == 6) {
 			if (moddata[1] == M200_OK_REPLY) {
-				add_value_pair(mqtt_msg, "msg", "ok");
+				add_string_value(mqtt_msg, "msg", "ok");
 			} else if(moddata[1] == M200_ERROR_REPLY){
-				add_value_pair(mqtt_msg, "msg", "error");
+				add_string_value(mqtt_msg, "msg", "error");
 			} else if(moddata[1] == M200_NO_RESPONSE_REPLY){
-				add_value_pair(mqtt_msg, "msg", "no response");					
+				add_string_value(mqtt_msg, "msg", "no response");					
 			}
 			return true;
 		}
@@ -465,12 +462,11 @@ bool umdk_m200_reply(uint8_t *moddata, int moddatalen, mqtt_msg_t *mqtt_msg)
 					uint32_to_le(address_dev);			
 
 					snprintf(number, sizeof(number), "Address %d", cnt);		
-					snprintf(buf_addr, sizeof(buf_addr), "%u", *address_dev);	
-					add_value_pair(mqtt_msg, number, buf_addr);								
+					add_uint_value(mqtt_msg, mqtt_msg_strdup(mqtt_msg, number), *address_dev);								
 				}
 			}
 			if(cnt == 0) {
-				add_value_pair(mqtt_msg, "msg", "empty");				
+				add_string_value(mqtt_msg, "msg", "empty");				
 				}
 			return true;
 			break;
@@ -479,16 +475,14 @@ bool umdk_m200_reply(uint8_t *moddata, int moddatalen, mqtt_msg_t *mqtt_msg)
 		case M200_CMD_GET_SERIAL: {
 			uint32_t *serial = (uint32_t *)(&moddata[6]);
 			uint32_to_le(serial);      
-			snprintf(buf, sizeof(buf), "%u", *serial);
-			add_value_pair(mqtt_msg, "Serial number", buf);		
+			add_uint_value(mqtt_msg, "Serial number", *serial);		
 			return true;
 			break;
 		}
 		
 		case M200_CMD_GET_NUM_TARIFFS: {
 			uint8_t number = moddata[6];  	
-			snprintf(buf, sizeof(buf), "%u", number);
-			add_value_pair(mqtt_msg, "Tariffs", buf);		
+			add_uint_value(mqtt_msg, "Tariffs", number);		
 			return true;
 			break;
 		}
@@ -504,13 +498,9 @@ bool umdk_m200_reply(uint8_t *moddata, int moddatalen, mqtt_msg_t *mqtt_msg)
 			char tariff[5] = { };
 			for(i = 0; i < 4; i++) {
 				snprintf(tariff, sizeof(tariff), "T%02d", i + 1);
-                int_to_float_str(strbuf, value[i], 2);
-				snprintf(buf, sizeof(buf), "%s", strbuf);
-				add_value_pair(mqtt_msg, tariff, buf);								
+                add_fixed_value(mqtt_msg, mqtt_msg_strdup(mqtt_msg, tariff), value[i], 2);								
 			}
-            int_to_float_str(strbuf, value[4], 2);
-			snprintf(buf, sizeof(buf), "%s", strbuf);
-			add_value_pair(mqtt_msg, "Total", buf);		
+            add_fixed_value(mqtt_msg, "Total", value[4], 2);		
 			
 			return true;
 			break;
@@ -527,13 +517,9 @@ bool umdk_m200_reply(uint8_t *moddata, int moddatalen, mqtt_msg_t *mqtt_msg)
 			char tariff[5] = { };
 			for(i = 0; i < 4; i++) {
 				snprintf(tariff, sizeof(tariff), "T%02d", i + 1);
-                int_to_float_str(strbuf, value[i], 2);
-				snprintf(buf, sizeof(buf), "%s", strbuf);
-				add_value_pair(mqtt_msg, tariff, buf);				
+                add_fixed_value(mqtt_msg, mqtt_msg_strdup(mqtt_msg, tariff), value[i], 2);				
 			}
-            int_to_float_str(strbuf, value[4], 2);
-			snprintf(buf, sizeof(buf), "%s", strbuf);
-			add_value_pair(mqtt_msg, "Total", buf);		
+            add_fixed_value(mqtt_msg, "Total", value[4], 2);		
 	
 			return true;
 			break;
@@ -635,7 +621,7 @@ bool umdk_m200_reply(uint8_t *moddata, int moddatalen, mqtt_msg_t *mqtt_msg)
 				add_value_pair(mqtt_msg, "Date", time_buf);
 			}
 			else {
-				add_value_pair(mqtt_msg, "msg", "Not support");
+				add_string_value(mqtt_msg, "msg", "Not support");
 			}
 			
 			return true;
@@ -661,7 +647,7 @@ bool umdk_m200_reply(uint8_t *moddata, int moddatalen, mqtt_msg_t *mqtt_msg)
 				add_value_pair(mqtt_msg, "Date", time_buf);
 			}
 			else {
-				add_value_pair(mqtt_msg, "msg", "Not support");
+				add_string_value(mqtt_msg, "msg", "Not support");
 			}
 			
 			return true;
@@ -688,11 +674,9 @@ bool umdk_m200_reply(uint8_t *moddata, int moddatalen, mqtt_msg_t *mqtt_msg)
             tlb += ( moddata[11] & 0x0F) * 1;
             tlb = tlb & 0x00FFFFFF;
  
-			snprintf(buf, sizeof(buf), "%u", tl);	
-			add_value_pair(mqtt_msg, "Working time under voltage", buf);
+			add_uint_value(mqtt_msg, "Working time under voltage", tl);
 			
-			snprintf(buf, sizeof(buf), "%u", tlb);	
-			add_value_pair(mqtt_msg, "Working time without voltage", buf);
+			add_uint_value(mqtt_msg, "Working time without voltage", tlb);
 			
 			return true;
 			break;			
@@ -707,17 +691,13 @@ bool umdk_m200_reply(uint8_t *moddata, int moddatalen, mqtt_msg_t *mqtt_msg)
             voltage += ( moddata[6] & 0x0F) * 100;
             voltage += ( moddata[7] >> 4) * 10;
             voltage += ( moddata[7] & 0x0F) * 1;
-			int_to_float_str(strbuf, voltage, 1);
-			snprintf(buf, sizeof(buf), "%s", strbuf);
-			add_value_pair(mqtt_msg, "Voltage", buf);
+			add_fixed_value(mqtt_msg, "Voltage", voltage, 1);
 			
             current =  ( moddata[8] >> 4) * 1000;
             current += ( moddata[8] & 0x0F) * 100;
             current += ( moddata[9] >> 4) * 10;
             current += ( moddata[9] & 0x0F) * 1;
-			int_to_float_str(strbuf, current, 2);
-			snprintf(buf, sizeof(buf), "%s", strbuf);
-			add_value_pair(mqtt_msg, "Current", buf);
+			add_fixed_value(mqtt_msg, "Current", current, 2);
 
             power =  ( moddata[10] >> 4) * 100000;
             power += ( moddata[10] & 0x0F) * 10000;
@@ -727,8 +707,7 @@ bool umdk_m200_reply(uint8_t *moddata, int moddatalen, mqtt_msg_t *mqtt_msg)
             power += ( moddata[12] & 0x0F) * 1;
             power = power & 0x00FFFFFF;
 
-			snprintf(buf, sizeof(buf), "%u", power);	
-			add_value_pair(mqtt_msg, "Power", buf);
+			add_uint_value(mqtt_msg, "Power", power);
 			
 			return true;
 			break;						
@@ -742,9 +721,7 @@ bool umdk_m200_reply(uint8_t *moddata, int moddatalen, mqtt_msg_t *mqtt_msg)
             power += ( moddata[7] >> 4) * 10;
             power += ( moddata[7] & 0x0F) * 1;
 			
-			int_to_float_str(strbuf, power, 2);
-			snprintf(buf, sizeof(buf), "%s", strbuf);
-			add_value_pair(mqtt_msg, "Current power", buf);
+			add_fixed_value(mqtt_msg, "Current power", power, 2);
 			
 			return true;
 			break;				
@@ -758,9 +735,7 @@ bool umdk_m200_reply(uint8_t *moddata, int moddatalen, mqtt_msg_t *mqtt_msg)
             power += ( moddata[7] >> 4) * 10;
             power += ( moddata[7] & 0x0F) * 1;
 			
-			int_to_float_str(strbuf, power, 2);
-			snprintf(buf, sizeof(buf), "%s", strbuf);
-			add_value_pair(mqtt_msg, "Power limit", buf);
+			add_fixed_value(mqtt_msg, "Power limit", power, 2);
 			return true;
 			break;				
 		}		
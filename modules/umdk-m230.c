@@ -127,8 +127,8 @@ typedef enum {
 #define UMDK_M230_BEGIN_ADDR_HOLIDAYS 0x1D00
 #define UMDK_M230_OFFSET_HOLIDAYS 5
 
-static char season[2][7] = { "Summer", "Winter" };
-static char dow[8][4] = { "Mon", "Tue", "Wed", "Thu", "Fri", "Sat", "Sun", "Hol" };
+static const char season[2][7] = { "Summer", "Winter" };
+static const char dow[8][4] = { "Mon", "Tue", "Wed", "Thu", "Fri", "Sat", "Sun", "Hol" };
 
 void umdk_m230_command(char *param, char *out, int bufsize) {
 		
@@ -603,7 +603,6 @@ void umdk_m230_command(char *param, char *out, int bufsize) {
 bool umdk_m230_reply(uint8_t *moddata, int moddatalen, mqtt_msg_t *mqtt_msg)
 {
 	char buf[100];
-    char strbuf[20];
 	char buf_addr[30];
 		
 	// uint8_t ii;
@@ -616,13 +615,13 @@ bool umdk_m230_reply(uint8_t *moddata, int moddatalen, mqtt_msg_t *mqtt_msg)
 	
    if (moddatalen == 1) {
 		if (moddata[0] == M230_OK_REPLY) {
-			add_value_pair(mqtt_msg, "msg", "ok");
+			add_string_value(mqtt_msg, "msg", "ok");
 		} 
 		else if(moddata[0] == M230_ERROR_REPLY){
-			add_value_pair(mqtt_msg, "msg", "error");
+			add_string_value(mqtt_msg, "msg", "error");
 		}
 		else if(moddata[0] == M230_ERROR_CMD){
-			add_value_pair(mqtt_msg, "msg", "invalid command");
+			add_string_value(mqtt_msg, "msg", "invalid command");
 		}
 		return true;
 	}	
@@ -633,34 +632,33 @@ bool umdk_m230_reply(uint8_t *moddata, int moddatalen, mqtt_msg_t *mqtt_msg)
 		
 		uint8_t address = moddata[2];
 
-		snprintf(buf_addr, sizeof(buf_addr), "%u", address);	
-		add_value_pair(mqtt_msg, "Address", buf_addr);
+		add_uint_value(mqtt_msg, "Address", address);
 							
 		if (moddatalen == 3) {
 			if (moddata[1] == M230_OK_REPLY) {
-				add_value_pair(mqtt_msg, "msg", "ok");
+				add_string_value(mqtt_msg, "msg", "ok");
 			} else if(moddata[1] == M230_ERROR_REPLY){
-				add_value_pair(mqtt_msg, "msg", "error");
+				add_string_value(mqtt_msg, "msg", "error");
 			} else if(moddata[1] == M230_NO_RESPONSE_REPLY){
-				add_value_pair(mqtt_msg, "msg", "no response");					
+				add_string_value(mqtt_msg, "msg", "no response");					
 			} else if(moddata[1] == M230_ERROR_NOT_FOUND){
-				add_value_pair(mqtt_msg, "msg", "device not found");					
+				add_string_value(mqtt_msg, "msg", "device not found");					
 			} else if(moddata[1] == M230_ERROR_OFFLINE){
-				add_value_pair(mqtt_msg, "msg", "offline");					
+				add_string_value(mqtt_msg, "msg", "offline");					
 			} else if(moddata[1] == M230_WRONG_CMD){
-				add_value_pair(mqtt_msg, "msg", "invalid parameter");							
+				add_string_value(mqtt_msg, "msg", "invalid parameter");							
 			} else if(moddata[1] == M230_INTERNAL_ERROR){
-				add_value_pair(mqtt_msg, "msg", "internal error");							
+				add_string_value(mqtt_msg, "msg", "internal error");							
 			} else if(moddata[1] == M230_ACCESS_ERROR){
-				add_value_pair(mqtt_msg, "msg", "access error");					
+				add_string_value(mqtt_msg, "msg", "access error");					
 			} else if(moddata[1] == M230_TIME_CORRECTED){
-				add_value_pair(mqtt_msg, "msg", "time already corrected");
+				add_string_value(mqtt_msg, "msg", "time already corrected");
 			} else if(moddata[1] == M230_OFFLINE){
-				add_value_pair(mqtt_msg, "msg", "offline");					
+				add_string_value(mqtt_msg, "msg", "offline");					
 			} else if(moddata[1] == M230_OK){
-				add_value_pair(mqtt_msg, "msg", "ok");					
+				add_string_value(mqtt_msg, "msg", "ok");					
 			} else if(moddata[1] == M230_WAIT_REPLY){
-				add_value_pair(mqtt_msg, "msg", "please wait");
+				add_string_value(mqtt_msg, "msg", "please wait");
 			}
 			return true;
 		// }
@@ -680,30 +678,22 @@ bool umdk_m230_reply(uint8_t *moddata, int moddatalen, mqtt_msg_t *mqtt_msg)
 				value[i] = (moddata[4*i + 4] << 24) + (moddata[4*i + 3] << 16) + (moddata[4*i + 6] << 8)  + (moddata[4*i + 5] << 0);
             }
 
-			int_to_float_str(strbuf, value[0], 3);
-			snprintf(buf, sizeof(buf), "%s", strbuf);
-			add_value_pair(mqtt_msg, "A+", buf);
+			add_fixed_value(mqtt_msg, "A+", value[0], 3);
  
 			if(value[1] != 0xFFFFFFFF) {			
-				int_to_float_str(strbuf, value[1], 3);
-				snprintf(buf, sizeof(buf), "%s", strbuf);
-				add_value_pair(mqtt_msg, "A-", buf);		
+				add_fixed_value(mqtt_msg, "A-", value[1], 3);		
 			}
 			else {
-				add_value_pair(mqtt_msg, "A-", "N/A");									
+				add_string_value(mqtt_msg, "A-", "N/A");									
 			}
 			
-			int_to_float_str(strbuf, value[2], 3);
-			snprintf(buf, sizeof(buf), "%s", strbuf);
-			add_value_pair(mqtt_msg, "R+", buf);
+			add_fixed_value(mqtt_msg, "R+", value[2], 3);
 			
 			if(value[3] != 0xFFFFFFFF) {						
-				int_to_float_str(strbuf, value[3], 3);
-				snprintf(buf, sizeof(buf), "%s", strbuf);
-				add_value_pair(mqtt_msg, "R-", buf);						
+				add_fixed_value(mqtt_msg, "R-", value[3], 3);						
 			}
 			else {
-				add_value_pair(mqtt_msg, "R-", "N/A");					
+				add_string_value(mqtt_msg, "R-", "N/A");					
 			}
 			
 			return true;
@@ -713,9 +703,7 @@ bool umdk_m230_reply(uint8_t *moddata, int moddatalen, mqtt_msg_t *mqtt_msg)
 		case M230_CMD_GET_POWER_LIMIT: {			
 			uint32_t power_limit = ((moddata[3] << 16) + (moddata[5] << 8) + moddata[4]) &  0x00FFFFFF; 
 
-			int_to_float_str(strbuf, power_limit, 2);
-			snprintf(buf, sizeof(buf), "%s", strbuf);
-			add_value_pair(mqtt_msg, "Power limit", buf);
+			add_fixed_value(mqtt_msg, "Power limit", power_limit, 2);
 			
 			return true;
 			break;			
@@ -724,9 +712,7 @@ bool umdk_m230_reply(uint8_t *moddata, int moddatalen, mqtt_msg_t *mqtt_msg)
 		case M230_CMD_GET_ENERGY_LIMIT: {			
 			uint32_t energy_limit = (moddata[4] << 24) + (moddata[3] << 16) + (moddata[6] << 8) + moddata[5]; 
 			
-			int_to_float_str(strbuf, energy_limit, 3);
-			snprintf(buf, sizeof(buf), "%s", strbuf);
-			add_value_pair(mqtt_msg, "Energy limit", buf);
+			add_fixed_value(mqtt_msg, "Energy limit", energy_limit, 3);
 			
 			return true;
 			break;			
@@ -777,31 +763,31 @@ bool umdk_m230_reply(uint8_t *moddata, int moddatalen, mqtt_msg_t *mqtt_msg)
 			uint8_t powerload_on_off = (moddata[4] >> 1) & 0x01;;
 			
 			if(mode_limit_energy == 1) {
-				add_value_pair(mqtt_msg, "Energy limit control", "Allowed");
+				add_string_value(mqtt_msg, "Energy limit control", "Allowed");
 			}
 			else if(mode_limit_energy == 0) {
-				add_value_pair(mqtt_msg, "Energy limit control", "Not allowed");				
+				add_string_value(mqtt_msg, "Energy limit control", "Not allowed");				
 			}		
 
 			if(mode_limit_power == 1) {
-				add_value_pair(mqtt_msg, "Power limit control", "Allowed");
+				add_string_value(mqtt_msg, "Power limit control", "Allowed");
 			}
 			else if(mode_limit_power == 0) {
-				add_value_pair(mqtt_msg, "Power limit control", "Not allowed");				
+				add_string_value(mqtt_msg, "Power limit control", "Not allowed");				
 			}						
 			
 			if(mode_load == 1) {
-				add_value_pair(mqtt_msg, "Pulse output mode", "Load");
+				add_string_value(mqtt_msg, "Pulse output mode", "Load");
 			}
 			else if(mode_load == 0) {
-				add_value_pair(mqtt_msg, "Pulse output mode", "Telemetry");				
+				add_string_value(mqtt_msg, "Pulse output mode", "Telemetry");				
 			}			
 			
 			if(powerload_on_off == 1) {
-				add_value_pair(mqtt_msg, "Load control", "Off");
+				add_string_value(mqtt_msg, "Load control", "Off");
 			}
 			else if(powerload_on_off == 0) {
-				add_value_pair(mqtt_msg, "Load control", "On");				
+				add_string_value(mqtt_msg, "Load control", "On");				
 			}
 			
 			
@@ -814,10 +800,10 @@ bool umdk_m230_reply(uint8_t *moddata, int moddatalen, mqtt_msg_t *mqtt_msg)
 			uint8_t mode_tariff =  moddata[4] & 0x01;
 			
 			if(mode_tariff == 0) {
-				add_value_pair(mqtt_msg, "Mode", "Multi-tariff");
+				add_string_value(mqtt_msg, "Mode", "Multi-tariff");
 			}
 			else if(mode_tariff == 1) {
-				add_value_pair(mqtt_msg, "Mode", "One-tariff");				
+				add_string_value(mqtt_msg, "Mode", "One-tariff");				
 			}
 						
 			snprintf(buf_addr, sizeof(buf_addr), "T%02d", current_tariff + 1);	
@@ -846,7 +832,7 @@ bool umdk_m230_reply(uint8_t *moddata, int moddatalen, mqtt_msg_t *mqtt_msg)
 			}
 			
 			if(flag_error == 0) {
-				add_value_pair(mqtt_msg, "Error", "No");	
+				add_string_value(mqtt_msg, "Error", "No");	
 			}
 			
 			return true;
@@ -928,7 +914,7 @@ bool umdk_m230_reply(uint8_t *moddata, int moddatalen, mqtt_msg_t *mqtt_msg)
 				add_value_pair(mqtt_msg, "Holidays", buf);
 			}			
 			else if(flag_holiday == 0) {
-				add_value_pair(mqtt_msg, "Holidays", "None");	
+				add_string_value(mqtt_msg, "Holidays", "None");	
 			}			
 			
 			break;					
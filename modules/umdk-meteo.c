@@ -57,8 +57,6 @@ void umdk_meteo_command(char *param, char *out, int bufsize) {
 
 bool umdk_meteo_reply(uint8_t *moddata, int moddatalen, mqtt_msg_t *mqtt_msg)
 {
-    char buf[100];
-    
     if (moddata[0] == UMDK_METEO_DATA) {
         int16_t temp;
         memcpy((void *)&temp, &moddata[1], 2);
@@ -72,22 +70,19 @@ bool umdk_meteo_reply(uint8_t *moddata, int moddatalen, mqtt_msg_t *mqtt_msg)
         memcpy((void *)&press, &moddata[5], 2);
         convert_from_be_sam((void *)&press, sizeof(press));
     
-        int_to_float_str(buf, temp, 1);
-        add_value_pair(mqtt_msg, "temperature", buf);
+        add_fixed_value(mqtt_msg, "temperature", temp, 1);
         
-        int_to_float_str(buf, hum, 1);
-        add_value_pair(mqtt_msg, "humidity", buf);
+        add_fixed_value(mqtt_msg, "humidity", hum, 1);
         
-        snprintf(buf, sizeof(buf), "%d", press);
-        add_value_pair(mqtt_msg, "pressure", buf);
+        add_int_value(mqtt_msg, "pressure", press);
     }
     
     if (moddata[0] == UMDK_METEO_COMMAND) {
-        add_value_pair(mqtt_msg, "msg", "ok");
+        add_string_value(mqtt_msg, "msg", "ok");
     }
 
     if (moddata[0] == UMDK_METEO_FAIL) {
-        add_value_pair(mqtt_msg, "msg", "error");
+        add_string_value(mqtt_msg, "msg", "error");
     }
     
     return true;
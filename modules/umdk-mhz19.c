@@ -70,32 +70,27 @@ void umdk_mhz19_command(char *param, char *out, int bufsize) {
 bool umdk_mhz19_reply(uint8_t *moddata, int moddatalen, mqtt_msg_t *mqtt_msg)
 {
     uint8_t reply_type = moddata[0];
-    char buf[20];
     
     if (moddatalen == 1) {
         switch (reply_type) {
             case UMDK_MHZ19_REPLY_OK: {
-                snprintf(buf, 5, "%d", UMDK_MHZ19_REPLY_OK);
-                add_value_pair(mqtt_msg, "type", buf);
-                add_value_pair(mqtt_msg, "msg", "ok");
+                add_int_value(mqtt_msg, "type", UMDK_MHZ19_REPLY_OK);
+                add_string_value(mqtt_msg, "msg", "ok");
                 break;
             }
             case UMDK_MHZ19_REPLY_ERR_OVF: {
-                snprintf(buf, 5, "%d", UMDK_MHZ19_REPLY_ERR_OVF);
-                add_value_pair(mqtt_msg, "type", buf);
-                add_value_pair(mqtt_msg, "msg", "overflow error");
+                add_int_value(mqtt_msg, "type", UMDK_MHZ19_REPLY_ERR_OVF);
+                add_string_value(mqtt_msg, "msg", "overflow error");
                 break;
             }
             case UMDK_MHZ19_REPLY_ERR_FMT: {
-                snprintf(buf, 5, "%d", UMDK_MHZ19_REPLY_ERR_FMT);
-                add_value_pair(mqtt_msg, "type", buf);
-                add_value_pair(mqtt_msg, "msg", "format error");
+                add_int_value(mqtt_msg, "type", UMDK_MHZ19_REPLY_ERR_FMT);
+                add_string_value(mqtt_msg, "msg", "format error");
                 break;
             }
             case UMDK_MHZ19_ERR: {
-                snprintf(buf, 5, "%d", UMDK_MHZ19_ERR);
-                add_value_pair(mqtt_msg, "type", buf);
-                add_value_pair(mqtt_msg, "msg", "error");
+                add_int_value(mqtt_msg, "type", UMDK_MHZ19_ERR);
+                add_string_value(mqtt_msg, "msg", "error");
                 break;
             }
         }
@@ -108,14 +103,11 @@ bool umdk_mhz19_reply(uint8_t *moddata, int moddatalen, mqtt_msg_t *mqtt_msg)
         
         uint8_t is_data_valid = moddata[4];
         
-        snprintf(buf, 5, "%d", co2);
-        add_value_pair(mqtt_msg, "co2", buf);
+        add_int_value(mqtt_msg, "co2", co2);
         
-        int_to_float_str(buf, temp, 1);
-        add_value_pair(mqtt_msg, "temp", buf);
+        add_fixed_value(mqtt_msg, "temp", temp, 1);
         
-        snprintf(buf, 4, "%d", is_data_valid);
-        add_value_pair(mqtt_msg, "valid", buf);
+        add_int_value(mqtt_msg, "valid", is_data_valid);
     }
     return true;
 }
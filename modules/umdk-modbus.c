@@ -35,6 +35,7 @@
 
 #include "unwds-modules.h"
 #include "utils.h"
+#include "textbuf.h"
 
 #define MODBUS_DEBUG 0
 
@@ -470,36 +471,34 @@ bool umdk_modbus_reply(uint8_t *moddata, int moddatalen, mqtt_msg_t *mqtt_msg)
 	
    if (moddatalen == 1) {
         if (moddata[0] == MODBUS_OK_REPLY) {
-            add_value_pair(mqtt_msg, "msg", "ok");
+            add_string_value(mqtt_msg, "msg", "ok");
         } else if(moddata[0] == MODBUS_ERROR_REPLY){
-            add_value_pair(mqtt_msg, "msg", "error");
+            add_string_value(mqtt_msg, "msg", "error");
 		} else if(moddata[0] == MODBUS_INVALID_CMD_REPLY){
-			add_value_pair(mqtt_msg, "msg", "invalid command");
+			add_string_value(mqtt_msg, "msg", "invalid command");
 		} else if(moddata[0] == MODBUS_INVALID_FORMAT){
-			add_value_pair(mqtt_msg, "msg", "invalid format");
+			add_string_value(mqtt_msg, "msg", "invalid format");
 		}
         return true;
     }
 	
 	char buf[100] = { 0 };
-	char buf_addr[5] = { 0 };
 	char buf_exc[5] = { 0 };
 	
 	uint8_t addr = moddata[0];
     uint8_t cmd = moddata[1];
 
-	snprintf(buf_addr, sizeof(buf_addr), "%d", addr);
-	add_value_pair(mqtt_msg, "address", buf_addr);
+	add_int_value(mqtt_msg, "address", addr);
 										
 	if (moddatalen == 2) {
 		if (moddata[0] == MODBUS_OK_REPLY) {
-			add_value_pair(mqtt_msg, "msg", "ok");
+			add_string_value(mqtt_msg, "msg", "ok");
 		} else if(moddata[0] == MODBUS_ERROR_REPLY){
-			add_value_pair(mqtt_msg, "msg", "error");
+			add_string_value(mqtt_msg, "msg", "error");
 		} else if(moddata[0] == MODBUS_NO_RESPONSE_REPLY){
-			add_value_pair(mqtt_msg, "msg", "no response");
+			add_string_value(mqtt_msg, "msg", "no response");
 		} else if(moddata[0] == MODBUS_OVERFLOW_REPLY){
-			add_value_pair(mqtt_msg, "msg", "rx buffer overflow");
+			add_string_value(mqtt_msg, "msg", "rx buffer overflow");
 		}
 		return true;
 	}
@@ -510,45 +509,47 @@ bool umdk_modbus_reply(uint8_t *moddata, int moddatalen, mqtt_msg_t *mqtt_msg)
 		add_value_pair(mqtt_msg, "exception", buf_exc);
 
 		if(exception == ILLEGAL_FUNCTION) {
-			add_value_pair(mqtt_msg, "msg", "illegal function");
+			add_string_value(mqtt_msg, "msg", "illegal function");
 		}
 		else if(exception == ILLEGAL_ADDRESS) {
-			add_value_pair(mqtt_msg, "msg", "illegal address");
+			add_string_value(mqtt_msg, "msg", "illegal address");
 		}
 		else if(exception == ILLEGAL_VALUE) {
-			add_value_pair(mqtt_msg, "msg", "illegal value");
+			add_string_value(mqtt_msg, "msg", "illegal value");
 		}
 		else if(exception == DEVICE_FAILURE) {
-			add_value_pair(mqtt_msg, "msg", "device failure");
+			add_string_value(mqtt_msg, "msg", "device failure");
 		}
 		else if(exception == ACK) {
-			add_value_pair(mqtt_msg, "msg", "ack");
+			add_string_value(mqtt_msg, "msg", "ack");
 		}
 		else if(exception == DEVICE_BUSY) {
-			add_value_pair(mqtt_msg, "msg", "device busy");
+			add_string_value(mqtt_msg, "msg", "device busy");
 		}
 		else if(exception == NAK) {
-			add_value_pair(mqtt_msg, "msg", "nak");
+			add_string_value(mqtt_msg, "msg", "nak");
 		}
 		else if(exception == MEMORY_ERROR) {
-			add_value_pair(mqtt_msg, "msg", "memory error");
+			add_string_value(mqtt_msg, "msg", "memory error");
 		}
 		else if(exception == GATEWAY_UNAVAILABLE) {
-			add_value_pair(mqtt_msg, "msg", "gateway unavailable");
+			add_string_value(mqtt_msg, "msg", "gateway unavailable");
 		}
 		else if(exception == GATEWAY_FAILED) {
-			add_value_pair(mqtt_msg, "msg", "gateway no response");
+			add_string_value(mqtt_msg, "msg", "gateway no response");
 		}
 		
 		return true;
 	}
 	
-	uint8_t i = 0;		
-	char byte[10];
-	for(i = 2; i < moddatalen; i++) {	
-		 snprintf(byte, sizeof(byte), "%02x", moddata[i]);
-         strcat(buf, byte);
+	/* Longer replies are cut to what fits into the value */
+	textbuf_t tb;
+	textbuf_init(&tb, buf, sizeof(buf));
+	size_t num_bytes = moddatalen - 2;
+	if (num_bytes > textbuf_avail(&tb) / 2) {
+		num_bytes = textbuf_avail(&tb) / 2;
 	}
+	textbuf_append_hex(&tb, moddata + 2, num_bytes);
 	add_value_pair(mqtt_msg, "data", buf);
 
 	return true;
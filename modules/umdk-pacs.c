@@ -78,10 +78,10 @@ bool umdk_pacs_reply(uint8_t *moddata, int moddatalen, mqtt_msg_t *mqtt_msg)
 		
     if (moddatalen == 1) {
         if (cmd == UMDK_PACS_OK) {
-            add_value_pair(mqtt_msg, "msg", "OK");
+            add_string_value(mqtt_msg, "msg", "OK");
         } 
 		else {
-            add_value_pair(mqtt_msg, "msg", "ERROR");
+            add_string_value(mqtt_msg, "msg", "ERROR");
         }
         return true;
     }
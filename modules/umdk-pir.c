@@ -39,15 +39,12 @@
 
 bool umdk_pir_reply(uint8_t *moddata, int moddatalen, mqtt_msg_t *mqtt_msg)
 {
-    char buf[100];
-    
     uint8_t pir = moddata[0];
 
     if (moddatalen != 1) {
         return false;
     }
 
-    snprintf(buf, sizeof(buf), "%d", pir);
-    add_value_pair(mqtt_msg, "pir", buf);
+    add_int_value(mqtt_msg, "pir", pir);
     return true;
 }
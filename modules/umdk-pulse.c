@@ -35,6 +35,7 @@
 
 #include "unwds-modules.h"
 #include "utils.h"
+#include "textbuf.h"
 
 typedef enum {
     UMDK_PULSE_CMD_SET_PERIOD,
@@ -137,19 +138,19 @@ bool umdk_pulse_reply(uint8_t *moddata, int moddatalen, mqtt_msg_t *mqtt_msg)
 
     switch (moddata[0]) {
         case UMDK_PULSE_REPLY_OK:
-            add_value_pair(mqtt_msg, "msg", "ok");
+            add_string_value(mqtt_msg, "msg", "ok");
             break;
         case UMDK_PULSE_REPLY_UNKNOWN_COMMAND:
-            add_value_pair(mqtt_msg, "msg", "invalid command");
+            add_string_value(mqtt_msg, "msg", "invalid command");
             break;
         case UMDK_PULSE_REPLY_INV_PARAMETER:
-            add_value_pair(mqtt_msg, "msg", "invalid parameter");
+            add_string_value(mqtt_msg, "msg", "invalid parameter");
             break;
         case UMDK_PULSE_REPLY_LEAK:
-            add_value_pair(mqtt_msg, "msg", "leak");
+            add_string_value(mqtt_msg, "msg", "leak");
             break;
         case UMDK_PULSE_REPLY_TAMPER:
-            add_value_pair(mqtt_msg, "msg", "tamper");
+            add_string_value(mqtt_msg, "msg", "tamper");
             break;
         case UMDK_PULSE_REPLY_DATA: {
             uint8_t tamper = moddata[1] & (1<<7);
@@ -167,8 +168,8 @@ bool umdk_pulse_reply(uint8_t *moddata, int moddatalen, mqtt_msg_t *mqtt_msg)
             }
             /* most recent absolute data are in values[i].num now */
                         
-            /* let's decode hourly data */
-            uint32_t history[channels][hours];
+            /* let's decode hourly data, keep one slot for the hours == 0 case */
+            uint32_t history[channels][hours ? hours : 1];
             for (i = 0; i < channels; i++) {
                 for (k = 0; k < hours - 1; k++) {
                     uint16_t tmp16 = moddata[2 + channels*4 + i*2*(hours - 1) + k*2] | (moddata[2 + channels*4 + i*2*(hours - 1) + k*2] << 8);
@@ -188,19 +189,27 @@ bool umdk_pulse_reply(uint8_t *moddata, int moddatalen, mqtt_msg_t *mqtt_msg)
             /* now history[i] holds absolute values for counter `i` for `hours` hours */
             
             char ch[10];
-            char strtmp[10];
             
             for (i = 0; i < channels; i++) {
-                snprintf(buf, 3, "[ ");
+                textbuf_t tb;
+                textbuf_init(&tb, buf, sizeof(buf));
+                textbuf_append(&tb, "[ ");
                 for (k = 0; k < hours; k++) {
-                    snprintf(strtmp, 10, "%" PRIu32, history[i][k]);
-                    strcat(buf, strtmp);
-                    if (k < hours - 1 ) {
-                        strcat(buf, ",");
+                    size_t mark = tb.len;
+                    textbuf_append_uint(&tb, history[i][k]);
+                    textbuf_append(&tb, (k < hours - 1) ? ", " : " ");
+                    /* long histories don't fit into the value, drop the oldest hours */
+                    if (tb.overflow || textbuf_avail(&tb) < 1) {
+                        if (mark > 2) {
+                            textbuf_truncate(&tb, mark - 2);
+                            textbuf_append_char(&tb, ' ');
+                        } else {
+                            textbuf_truncate(&tb, mark);
+                        }
+                        break;
                     }
-                    strcat(buf, " ");
                 }
-                strcat(buf, "]");
+                textbuf_append_char(&tb, ']');
                 snprintf(ch, 10, "P%d", i+1);
                 add_value_pair(mqtt_msg, ch, buf);
             }
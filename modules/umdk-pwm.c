@@ -106,10 +106,10 @@ bool umdk_pwm_reply(uint8_t *moddata, int moddatalen, mqtt_msg_t *mqtt_msg)
     if (moddata[0] == UMDK_PWM_COMMAND) {
         switch (moddata[1]) {
             case UMDK_PWM_OK:
-                add_value_pair(mqtt_msg, "msg", "ok");
+                add_string_value(mqtt_msg, "msg", "ok");
                 break;
             case UMDK_PWM_FAIL:
-                add_value_pair(mqtt_msg, "msg", "error");
+                add_string_value(mqtt_msg, "msg", "error");
                 break;
             default:
                 break;
@@ -45,7 +45,6 @@ void umdk_rssiecho_command(char *param, char *out, int bufsize) {
 
 bool umdk_rssiecho_reply(uint8_t *moddata, int moddatalen, mqtt_msg_t *mqtt_msg)
 {
-    char buf[100];
     if (moddatalen < 2) {
         return false;
     }
@@ -62,8 +61,7 @@ bool umdk_rssiecho_reply(uint8_t *moddata, int moddatalen, mqtt_msg_t *mqtt_msg)
         rssi += (moddata[0] << 8);
     }
 
-    snprintf(buf, sizeof(buf), "%d", rssi);
-    add_value_pair(mqtt_msg, "rssi", buf);
+    add_int_value(mqtt_msg, "rssi", rssi);
     
     return true;
 }
@@ -35,6 +35,7 @@
 
 #include "unwds-modules.h"
 #include "utils.h"
+#include "textbuf.h"
 
 #define UMDK_ST95_ERROR 0x01
 
@@ -49,19 +50,21 @@ bool umdk_st95_reply(uint8_t *moddata, int moddatalen, mqtt_msg_t *mqtt_msg)
 
     if (moddatalen == 1) {
         if (moddata[0] == UMDK_ST95_ERROR) {
-            add_value_pair(mqtt_msg, "msg", "invalid uid");
+            add_string_value(mqtt_msg, "msg", "invalid uid");
         }
         else {
-            add_value_pair(mqtt_msg, "msg", "error");
+            add_string_value(mqtt_msg, "msg", "error");
         }
         return true;
     }
     
-    uint8_t num_char = 0;
-    int i;
-    for(i = 0; i < moddatalen; i++) {
-        num_char += snprintf(buf + num_char, sizeof(buf) - num_char, "%02x", moddata[i]);
+    textbuf_t tb;
+    textbuf_init(&tb, buf, sizeof(buf));
+    size_t num_bytes = moddatalen;
+    if (num_bytes > textbuf_avail(&tb) / 2) {
+        num_bytes = textbuf_avail(&tb) / 2;
     }
+    textbuf_append_hex(&tb, moddata, num_bytes);
        
     add_value_pair(mqtt_msg, "uid", buf);
     
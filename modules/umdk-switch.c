@@ -81,9 +81,9 @@ bool umdk_switch_reply(uint8_t *moddata, int moddatalen, mqtt_msg_t *mqtt_msg)
             uint8_t val = (sw >> 7);
             
             if (val) {
-                add_value_pair(mqtt_msg, buf, "1");
+                add_int_value(mqtt_msg, mqtt_msg_strdup(mqtt_msg, buf), 1);
             } else {
-                add_value_pair(mqtt_msg, buf, "0");
+                add_int_value(mqtt_msg, mqtt_msg_strdup(mqtt_msg, buf), 0);
             }
             
             break;
@@ -110,15 +110,15 @@ bool umdk_switch_reply(uint8_t *moddata, int moddatalen, mqtt_msg_t *mqtt_msg)
             break;
         }
         case UMDK_SWITCH_REPLY_OK: { /*  */
-            add_value_pair(mqtt_msg, "msg", "set ok");
+            add_string_value(mqtt_msg, "msg", "set ok");
             break;
         }
         case UMDK_SWITCH_REPLY_UNKNOWN_COMMAND: { /*  */
-            add_value_pair(mqtt_msg, "msg", "invalid command");
+            add_string_value(mqtt_msg, "msg", "invalid command");
             break;
         }
         case UMDK_SWITCH_REPLY_INV_PARAMETER: { /*  */
-            add_value_pair(mqtt_msg, "msg", "invalid parameter");
+            add_string_value(mqtt_msg, "msg", "invalid parameter");
             break;
         }
         default:
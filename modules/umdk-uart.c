@@ -36,6 +36,7 @@
 
 #include "unwds-modules.h"
 #include "utils.h"
+#include "textbuf.h"
 
 void umdk_uart_command(char *param, char *out, int bufsize) {
     if (strstr(param, "send ") == param) {
@@ -90,41 +91,44 @@ bool umdk_uart_reply(uint8_t *moddata, int moddatalen, mqtt_msg_t *mqtt_msg)
 
     switch (reply_type) {
         case 0: /* UMDK_UART_REPLY_SENT */
-            add_value_pair(mqtt_msg, "type", "0");
-            add_value_pair(mqtt_msg, "msg", "sent ok");
+            add_int_value(mqtt_msg, "type", 0);
+            add_string_value(mqtt_msg, "msg", "sent ok");
             return true;
 
         case 1: { /* UMDK_UART_REPLY_RECEIVED */
-            char hexbuf[255] = { 0 };
-            char hex[3] = { 0 };
-            int k;
-            for (k = 0; k < moddatalen - 1; k++) {
-                snprintf(hex, 3, "%02x", moddata[k+1]);
-                strcat(hexbuf, hex);
+            char hexbuf[100];
+            textbuf_t tb;
+            textbuf_init(&tb, hexbuf, sizeof(hexbuf));
+
+            /* Data that doesn't fit into the value is dropped */
+            size_t num_bytes = (moddatalen > 1) ? moddatalen - 1 : 0;
+            if (num_bytes > textbuf_avail(&tb) / 2) {
+                num_bytes = textbuf_avail(&tb) / 2;
             }
-            add_value_pair(mqtt_msg, "type", "1");
+            textbuf_append_hex(&tb, moddata + 1, num_bytes);
+            add_int_value(mqtt_msg, "type", 1);
             add_value_pair(mqtt_msg, "msg", hexbuf);
             return true;
         }
 
         case 2:
-            add_value_pair(mqtt_msg, "type", "2");
-            add_value_pair(mqtt_msg, "msg", "baud rate set");
+            add_int_value(mqtt_msg, "type", 2);
+            add_string_value(mqtt_msg, "msg", "baud rate set");
             return true;
 
         case 253: /* UMDK_UART_REPLY_ERR_OVF */
-            add_value_pair(mqtt_msg, "type", "253");
-            add_value_pair(mqtt_msg, "msg", "rx buffer overrun");
+            add_int_value(mqtt_msg, "type", 253);
+            add_string_value(mqtt_msg, "msg", "rx buffer overrun");
             return true;
 
         case 254: /* UMDK_UART_REPLY_ERR_FMT */
-            add_value_pair(mqtt_msg, "type", "254");
-            add_value_pair(mqtt_msg, "msg", "invalid format");
+            add_int_value(mqtt_msg, "type", 254);
+            add_string_value(mqtt_msg, "msg", "invalid format");
             return true;
 
         case 255: /* UMDK_UART_REPLY_ERR */
-            add_value_pair(mqtt_msg, "type", "255");
-            add_value_pair(mqtt_msg, "msg", "UART interface error");
+            add_int_value(mqtt_msg, "type", 255);
+            add_string_value(mqtt_msg, "msg", "UART interface error");
             return true;
     }
 
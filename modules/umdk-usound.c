@@ -44,7 +44,6 @@ void umdk_usound_command(char *param, char *out, int bufsize) {
 
 bool umdk_usound_reply(uint8_t *moddata, int moddatalen, mqtt_msg_t *mqtt_msg)
 {
-    char buf[100];
     if (moddatalen < 2) {
         return false;
     }
@@ -54,8 +53,7 @@ bool umdk_usound_reply(uint8_t *moddata, int moddatalen, mqtt_msg_t *mqtt_msg)
     
     uint32_to_le((uint32_t *)&value);
 
-    snprintf(buf, sizeof(buf), "%d", value);
-    add_value_pair(mqtt_msg, "distance", buf);
+    add_int_value(mqtt_msg, "distance", value);
     
     return true;
 }
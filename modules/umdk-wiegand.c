@@ -114,13 +114,13 @@ bool umdk_wiegand_reply(uint8_t *moddata, int moddatalen, mqtt_msg_t *mqtt_msg)
 	
 	if (moddatalen == 1) {
 		if (moddata[0] == UMDK_WIEGAND_OK_REPLY) {
-			add_value_pair(mqtt_msg, "msg", "ok");
+			add_string_value(mqtt_msg, "msg", "ok");
 		} else if(moddata[0] == UMDK_WIEGAND_ERROR_REPLY){
-			add_value_pair(mqtt_msg, "msg", "error");
+			add_string_value(mqtt_msg, "msg", "error");
 		} else if(moddata[0] == UMDK_WIEGAND_INVALID_CMD_REPLY){
-			add_value_pair(mqtt_msg, "msg", "invalid command");
+			add_string_value(mqtt_msg, "msg", "invalid command");
 		} else if(moddata[0] == UMDK_WIEGAND_NOT_SUPP_REPLY){
-			add_value_pair(mqtt_msg, "msg", "not support format");
+			add_string_value(mqtt_msg, "msg", "not support format");
 		}
 		return true;
 	}
@@ -144,23 +144,23 @@ bool umdk_wiegand_reply(uint8_t *moddata, int moddatalen, mqtt_msg_t *mqtt_msg)
 	
 	switch(cmd) {
 		case UMDK_WIEGAND_CMD_DATABASE_ADD: {
-			add_value_pair(mqtt_msg, "action", "added");
+			add_string_value(mqtt_msg, "action", "added");
 			break;
 		}
 		case UMDK_WIEGAND_CMD_DATABASE_REMOVE: {
-			add_value_pair(mqtt_msg, "action", "removed");
+			add_string_value(mqtt_msg, "action", "removed");
 			break;
 		}
 		case UMDK_WIEGAND_REMOVED_REPLY: {
-			add_value_pair(mqtt_msg, "action", "removed by timer");
+			add_string_value(mqtt_msg, "action", "removed by timer");
 			break;
 		}
 		case UMDK_WIEGAND_GRANTED_REPLY: {
-			add_value_pair(mqtt_msg, "action", "granted");
+			add_string_value(mqtt_msg, "action", "granted");
 			break;
 		}
 		case UMDK_WIEGAND_DENIED_REPLY: {
-			add_value_pair(mqtt_msg, "action", "denied");
+			add_string_value(mqtt_msg, "action", "denied");
 			break;
 		}
 		default:
@@ -36,19 +36,33 @@
 #include <termios.h>
 #include <unistd.h>
 #include <syslog.h>
-#include <sys/msg.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/uio.h>
 #include <sys/queue.h>
+#include <sys/time.h>
 
 #define __STDC_FORMAT_MACROS
 #include <inttypes.h>
+#include <stdatomic.h>
 
 #include "mqtt.h"
 #include "unwds-mqtt.h"
+#include "framectx.h"
 #include "utils.h"
+#include "ringbuf.h"
+#include "frameq.h"
+#include "cmdq.h"
+#include "pubq.h"
+#include "batch.h"
+#include "transport.h"
+#include "capture.h"
 
 #define VERSION "2.3.1"
 
 #define MAX_PENDING_NODES 1000
+#define MAX_GATES 4
+#define MAX_WORKERS 32
 
 #define INVITE_TIMEOUT_S 45
 
@@ -57,31 +71,87 @@
 
 #define UART_POLLING_INTERVAL 100    // milliseconds
 #define QUEUE_POLLING_INTERVAL 5     // milliseconds
-#define REPLY_LEN 1024
+#define DISPATCH_RETRY_INTERVAL 200  // microseconds, worker queue is full
 
-int msgqid;
 extern int errno;
 
-struct msg_buf {
-  long mtype;
-  char mtext[REPLY_LEN];
-} msg_rx;
-
 static struct mosquitto *mosq = NULL;
-static int uart = 0;
 
-static pthread_t publisher_thread;
-static pthread_t reader_thread;
+/* Decoding and publishing threads, frames of one device always go to the same one */
+typedef struct {
+    int num;
+    frameq_t rx_queue;              /* frames from the readers */
+    pthread_t thread;
+    atomic_uint queued;             /* frames pushed and not yet served */
+} worker_t;
+
+static worker_t workers[MAX_WORKERS];
+static int num_workers = 1;
+
 static pthread_t pending_thread;
 
-static pthread_mutex_t mutex_uart;
-static pthread_mutex_t mutex_pending;
+/* Raw gate traffic log, fd is -1 when capture is off */
+static capture_t capture = { .fd = -1 };
+
+/* Replay of captured traffic instead of real gates */
+static const char *replay_name = NULL;
+static double replay_speed = 1;         /* 0 for as fast as possible */
+static bool replay_sink = false;        /* don't connect to the broker */
+static pthread_t replay_thread;
+
+/* Messages on their way to the broker */
+#define PUBLISH_STATS_INTERVAL 60       /* seconds */
+#define PUBLISH_RETRY_INTERVAL 100      /* ms, broker connection is being lost */
+#define PUBLISH_MAX_INFLIGHT 20         /* libmosquitto's default */
+static pubq_t publish_queue;
+static size_t publish_queue_size = PUBQ_DEFAULT_SIZE;
+
+/* Messages handed to libmosquitto and not yet acked (or sent, for QoS 0).
+ * Past the limit the rest wait in the publish queue, so it's the queue
+ * that holds the backlog of a slow broker and drops what doesn't fit. */
+static unsigned publish_inflight = 0;
+static unsigned publish_inflight_max = PUBLISH_MAX_INFLIGHT;
+static pthread_mutex_t publish_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t publish_cond = PTHREAD_COND_INITIALIZER;
+
+/* Uplinks collected into one message, see README */
+#define MQTT_BATCH_TOPIC MQTT_PUBLISH_TO "batch"
+static batch_t uplink_batch;
+static unsigned batch_interval = 0;     /* ms, 0 when batching is off */
+static unsigned batch_items = BATCH_DEFAULT_ITEMS;
+static size_t batch_size = BATCH_DEFAULT_SIZE;
+static bool batch_devices = true;       /* device topics are published as well */
+
+/* MQTT v5 topic aliases, see README */
+static topic_alias_t topic_aliases;
+static unsigned topic_aliases_max = TOPIC_ALIAS_DEFAULT_NUM;
+
+/* Classes of published topics, each may have its own format */
+typedef enum {
+    TOPIC_DATA = 0,     /* decoded uplinks */
+    TOPIC_DEVICE,       /* joins, kicks and other device events */
+    TOPIC_LIST,         /* devices list */
+    NUM_TOPIC_CLASSES,
+} topic_class_t;
+
+static const char *topic_class_names[NUM_TOPIC_CLASSES] = { "data", "device", "list" };
 
 static uint8_t mqtt_format;
+static int8_t topic_format[NUM_TOPIC_CLASSES];     /* -1 for mqtt_format */
 static int tx_delay;
 static int tx_maxretr;
 
-char logbuf[REPLY_LEN + 100];
+/* How the gate is asked for pending replies */
+typedef enum {
+    UART_FLUSH_POLL = 0,    /* CMD_FLUSH every uart_flush_interval ms (legacy behaviour) */
+    UART_FLUSH_PENDING,     /* CMD_FLUSH only when the gate has something to say, uart_flush_interval ms idle fallback */
+    UART_FLUSH_PUSH,        /* gate pushes replies by itself, CMD_FLUSH is never sent */
+} uart_flush_t;
+
+static uart_flush_t uart_flush;
+static int uart_flush_interval;
+
+#define LOGBUF_LEN (REPLY_LEN + 100)
 
 typedef struct entry {
     TAILQ_ENTRY(entry) entries;   /* Circular queue. */    
@@ -96,13 +166,17 @@ static bool m_dequeue(fifo_t *l, char *v);
 static bool is_fifo_empty(fifo_t *l);
 
 /* Pending messages queue pool */
-static bool pending_free[MAX_PENDING_NODES];
 typedef struct {
     uint64_t nodeid;
     fifo_t pending_fifo;
     
     time_t last_msg;
     time_t last_inv;
+    time_t last_seen;   /* last frame from the device through this gate */
+
+    char eui[17];                           /* nodeid as the gate prints it */
+    char topic[MQTT_TOPIC_PREFIX_LEN];      /* devices/lora/<eui>/ */
+    unsigned short topic_len;
     
     unsigned short nodeclass;
     bool has_been_invited;
@@ -111,12 +185,32 @@ typedef struct {
     unsigned short num_pending;
 } pending_item_t;
 
-static pending_item_t pending[MAX_PENDING_NODES];
+/* Gate connected to one of the ports, each with its own reader, writer and devices */
+typedef struct {
+    int num;                        /* gate number, starting with 0 */
+
+    transport_t uart;               /* serial port or socket, see transport.h */
+    ringbuf_t uart_rx;
+    cmdq_t tx_queue;                /* commands to the gate, sent by the writer thread */
+
+    pthread_t reader_thread;
+    pthread_t writer_thread;
+
+    pthread_mutex_t mutex_pending;
+    bool pending_free[MAX_PENDING_NODES];
+    pending_item_t pending[MAX_PENDING_NODES];
+
+    /* The devices list is requested for gate needs, so don't post in MQTT it's results */
+    bool list_for_gate;
+    bool devlist_needed;
+    bool static_devices_list_sent;
+} gate_t;
 
-/* The devices list is requested for gate needs, so don't post in MQTT it's results */
-static bool list_for_gate = false;
-static bool devlist_needed = false;
-static void devices_list(bool internal);
+static gate_t *gates[MAX_GATES];
+static int num_gates = 0;
+
+static void devices_list(gate_t *gate, bool internal);
+static void *replay(void *arg);
 
 /* If too many pings was skipped by gate, the connection might be faulty */
 /*
@@ -124,8 +218,6 @@ static int pings_skipped = 0;
 static const int MIN_PINGS_SKIPPED = 10;
 */
 
-static bool static_devices_list_sent = false;
-
 static char *get_node_class(unsigned short nodeclass) {
     switch (nodeclass) {
         case 0:
@@ -142,38 +234,113 @@ static char *get_node_class(unsigned short nodeclass) {
     }
 }
 
-static void init_pending(void) {
+static mqtt_format_t format_of(topic_class_t topic)
+{
+    return (mqtt_format_t) (topic_format[topic] < 0 ? mqtt_format : topic_format[topic]);
+}
+
+/* Publishes { "key": val, "str_key": "str" } to the device topic, str_key may be NULL */
+static void publish_device_event(const char *addr, const char *key, int32_t val, const char *str_key, const char *str)
+{
+    frame_ctx_t *ctx = frame_ctx_get();
+    if (!ctx) {
+        puts("[error] Unable to allocate memory");
+        return;
+    }
+
+    mqtt_msg_init(&ctx->values);
+    add_int_value(&ctx->values, key, val);
+    if (str_key) {
+        add_string_value(&ctx->values, str_key, str);
+    }
+
+    mqtt_format_t format = format_of(TOPIC_DEVICE);
+    mqtt_status_t status = { 0 };
+    size_t len = build_mqtt_message(ctx->msg, &ctx->values, status, addr, NULL, format);
+    publish_mqtt_message(mosq, addr, "device", ctx->msg, len, format);
+}
+
+static void init_pending(gate_t *gate) {
     int i;    
     for (i = 0; i < MAX_PENDING_NODES; i++) {
-        pending_free[i] = true;
-        pending[i].nodeid = 0;
-        pending[i].nodeclass = 0;
-        pending[i].last_msg = 0;
-        pending[i].last_inv = 0;
-        pending[i].num_retries = 0;
-        pending[i].can_send = false;
-        pending[i].num_pending = 0;
+        gate->pending_free[i] = true;
+        gate->pending[i].nodeid = 0;
+        gate->pending[i].nodeclass = 0;
+        gate->pending[i].last_msg = 0;
+        gate->pending[i].last_inv = 0;
+        gate->pending[i].last_seen = 0;
+        gate->pending[i].num_retries = 0;
+        gate->pending[i].can_send = false;
+        gate->pending[i].num_pending = 0;
     }
 }
 
-static pending_item_t *pending_to_nodeid(uint64_t nodeid) {
+static pending_item_t *pending_to_nodeid(gate_t *gate, uint64_t nodeid) {
     int i;    
     for (i = 0; i < MAX_PENDING_NODES; i++) {
-        if (pending_free[i])
+        if (gate->pending_free[i])
             continue;
 
-        if (pending[i].nodeid == nodeid) {
-            return &pending[i];
+        if (gate->pending[i].nodeid == nodeid) {
+            return &gate->pending[i];
         }
     }    
 
     return NULL;
 }
 
-static bool add_device(uint64_t nodeid, unsigned short nodeclass, bool was_joined) {
-    pthread_mutex_lock(&mutex_pending);
+/* Finds the gate that heard the device last, NULL if none knows it.
+ * Device record may be gone by the time the caller locks the gate, so
+ * it's looked up again under the lock. */
+static gate_t *route_to_nodeid(uint64_t nodeid) {
+    gate_t *found = NULL;
+    time_t found_seen = 0;
+    int i;
+
+    for (i = 0; i < num_gates; i++) {
+        pthread_mutex_lock(&gates[i]->mutex_pending);
+
+        pending_item_t *e = pending_to_nodeid(gates[i], nodeid);
+        if (e != NULL && (found == NULL || e->last_seen > found_seen)) {
+            found = gates[i];
+            found_seen = e->last_seen;
+        }
+
+        pthread_mutex_unlock(&gates[i]->mutex_pending);
+    }
+
+    return found;
+}
+
+/* Remembers that the device was heard through this gate. Copies device
+ * topic prefix to topic if it's not NULL, returns its length or 0 for
+ * an unknown device */
+static size_t device_seen(gate_t *gate, uint64_t nodeid, char *topic) {
+    size_t len = 0;
+
+    pthread_mutex_lock(&gate->mutex_pending);
+
+    pending_item_t *e = pending_to_nodeid(gate, nodeid);
+    if (e != NULL) {
+        e->last_seen = time(NULL);
+        if (topic) {
+            memcpy(topic, e->topic, e->topic_len + 1);
+            len = e->topic_len;
+        }
+    }
+
+    pthread_mutex_unlock(&gate->mutex_pending);
+
+    return len;
+}
+
+/* heard is set when the device itself has just talked to the gate, not when
+ * it's only listed by it, so downlinks follow the gate that heard it last */
+static bool add_device(gate_t *gate, uint64_t nodeid, unsigned short nodeclass, bool was_joined, bool heard) {
+    char logbuf[LOGBUF_LEN];
+    pthread_mutex_lock(&gate->mutex_pending);
 
-    pending_item_t *e = pending_to_nodeid(nodeid);
+    pending_item_t *e = pending_to_nodeid(gate, nodeid);
 
     /* Update device info for existing record */
     if (e != NULL) {
@@ -188,10 +355,13 @@ static bool add_device(uint64_t nodeid, unsigned short nodeclass, bool was_joine
         }
 
         e->nodeclass = nodeclass;
-        pthread_mutex_unlock(&mutex_pending);
+        if (heard) {
+            e->last_seen = time(NULL);
+        }
 
         /* Reset number of retransmission/invite attempts */
         e->num_retries = 0;
+        pthread_mutex_unlock(&gate->mutex_pending);
 
         return true;
     }
@@ -199,55 +369,60 @@ static bool add_device(uint64_t nodeid, unsigned short nodeclass, bool was_joine
     int i;
     for (i = 0; i < MAX_PENDING_NODES; i++) {
         /* Free cell found, occupy */
-        if (pending_free[i]) {
-            pending_free[i] = false;
+        if (gate->pending_free[i]) {
+            gate->pending_free[i] = false;
 
             /* Initialize cell */
-            pending[i].nodeid = nodeid;
-            pending[i].nodeclass = nodeclass;
-            pending[i].has_been_invited = !was_joined; /* Node added without actual join via invitation */
+            gate->pending[i].nodeid = nodeid;
+            gate->pending[i].nodeclass = nodeclass;
+            gate->pending[i].has_been_invited = !was_joined; /* Node added without actual join via invitation */
+
+            gate->pending[i].last_msg = 0;
+            gate->pending[i].last_inv = 0;
+            gate->pending[i].last_seen = heard ? time(NULL) : 0;
+            gate->pending[i].num_retries = 0;
+            gate->pending[i].can_send = false;
+            gate->pending[i].num_pending = 0;
 
-            pending[i].last_msg = 0;
-            pending[i].last_inv = 0;
-            pending[i].num_retries = 0;
-            pending[i].can_send = false;
-            pending[i].num_pending = 0;
+            /* Topic is the same for every message, format it once */
+            snprintf(gate->pending[i].eui, sizeof(gate->pending[i].eui), "%016" PRIx64, nodeid);
+            gate->pending[i].topic_len = mqtt_topic_prefix(gate->pending[i].topic, gate->pending[i].eui);
 
             /* Initialize queue in cell */
-            TAILQ_INIT(&pending[i].pending_fifo);
+            TAILQ_INIT(&gate->pending[i].pending_fifo);
 
-            pthread_mutex_unlock(&mutex_pending);
+            pthread_mutex_unlock(&gate->mutex_pending);
             return true;
         }
     }
 
-    pthread_mutex_unlock(&mutex_pending);
+    pthread_mutex_unlock(&gate->mutex_pending);
     return false;
 }
 
-static bool kick_device(uint64_t nodeid) {
-    pthread_mutex_lock(&mutex_pending);
+static bool kick_device(gate_t *gate, uint64_t nodeid) {
+    pthread_mutex_lock(&gate->mutex_pending);
 
     int i;
     for (i = 0; i < MAX_PENDING_NODES; i++) {
-        if (pending_free[i])
+        if (gate->pending_free[i])
             continue;
 
-        if (pending[i].nodeid != nodeid)
+        if (gate->pending[i].nodeid != nodeid)
             continue;
 
         /* Device found, kick */
-        pending_free[i] = true;
+        gate->pending_free[i] = true;
 
         /* Empty the pending queue */
-        while (m_dequeue(&pending[i].pending_fifo, NULL)) {}
+        while (m_dequeue(&gate->pending[i].pending_fifo, NULL)) {}
 
-        pthread_mutex_unlock(&mutex_pending);
+        pthread_mutex_unlock(&gate->mutex_pending);
 
         return true;
     }    
 
-    pthread_mutex_unlock(&mutex_pending);
+    pthread_mutex_unlock(&gate->mutex_pending);
 
     return false;
 }
@@ -306,65 +481,8 @@ static bool is_fifo_empty(fifo_t *l)
     return false;
 }
 
-static int set_interface_attribs (int fd, int speed, int parity)
-{
-        struct termios tty;
-        memset (&tty, 0, sizeof tty);
-        if (tcgetattr (fd, &tty) != 0)
-        {
-                fprintf(stderr, "error %d from tcgetattr", errno);
-                return -1;
-        }
-
-        cfsetospeed (&tty, speed);
-        cfsetispeed (&tty, speed);
-
-        tty.c_cflag = (tty.c_cflag & ~CSIZE) | CS8;     // 8-bit chars
-        // disable IGNBRK for mismatched speed tests; otherwise receive break
-        // as \000 chars
-        // tty.c_iflag &= ~IGNBRK;         // disable break processing
-        tty.c_iflag |= IGNBRK;         // disable break processing
-        tty.c_lflag = 0;                // no signaling chars, no echo,
-                                        // no canonical processing
-        tty.c_oflag = 0;                // no remapping, no delays
-        tty.c_cc[VMIN]  = 0;            // read doesn't block
-        tty.c_cc[VTIME] = 5;            // 0.5 seconds read timeout
-
-        tty.c_iflag &= ~(IXON | IXOFF | IXANY); // shut off xon/xoff ctrl
-
-        tty.c_cflag |= (CLOCAL | CREAD);// ignore modem controls,
-                                        // enable reading
-        tty.c_cflag &= ~(PARENB | PARODD);      // shut off parity
-        tty.c_cflag |= parity;
-        tty.c_cflag &= ~CSTOPB;
-        tty.c_cflag &= ~CRTSCTS;
-
-        if (tcsetattr (fd, TCSANOW, &tty) != 0)
-        {
-                fprintf(stderr, "error %d from tcsetattr\n", errno);
-                return -1;
-        }
-        return 0;
-}
-
-static void set_blocking (int fd, int should_block)
-{
-        struct termios tty;
-        memset (&tty, 0, sizeof tty);
-        if (tcgetattr (fd, &tty) != 0)
-        {
-                fprintf(stderr, "error %d from tggetattr", errno);
-                return;
-        }
-
-        tty.c_cc[VMIN]  = should_block ? 1 : 0;
-        tty.c_cc[VTIME] = 5;            // 0.5 seconds read timeout
-
-        if (tcsetattr (fd, TCSANOW, &tty) != 0)
-                fprintf(stderr, "error %d setting term attributes", errno);
-}
-
-static void serve_reply(char *str) {
+static void serve_reply(gate_t *gate, char *str, const struct timeval *rx_time) {
+    char logbuf[LOGBUF_LEN];
     puts("[info] Gate reply received");
 
     /*
@@ -430,7 +548,7 @@ static void serve_reply(char *str) {
             }
 
             /* Refresh our internal device list info for that node */
-            if (!add_device(nodeid, cl, true)) {
+            if (!add_device(gate, nodeid, cl, true, false)) {
                 snprintf(logbuf, sizeof(logbuf), "[error] Was unable to add device 0x%s with nodeclass %s to our device list!\n", addr, nodeclass);
                 logprint(logbuf);
                 return;
@@ -438,16 +556,22 @@ static void serve_reply(char *str) {
 
 
             /* The device list was requested by gate, don't post results in MQTT then */
-            if (list_for_gate) 
+            if (gate->list_for_gate) 
                 return;
 
-            char *msg = (char *) malloc(MQTT_MAX_MSG_SIZE);
-            if (msg) {
-                snprintf(msg, MQTT_MAX_MSG_SIZE, "{ \"appid64\": \"0x%s\", \"last_seen\": %d, \"nodeclass\": %d }", 
-                        appid, (unsigned) lseen, (unsigned) cl);
+            frame_ctx_t *ctx = frame_ctx_get();
+            if (ctx) {
+                char appid_str[20];
+                snprintf(appid_str, sizeof(appid_str), "0x%s", appid);
+
+                mqtt_msg_init(&ctx->values);
+                add_string_value(&ctx->values, "appid64", appid_str);
+                add_uint_value(&ctx->values, "last_seen", lseen);
+                add_uint_value(&ctx->values, "nodeclass", cl);
 
-                publish_mqtt_message(mosq, addr, "list/", msg, (mqtt_format_t) mqtt_format);
-                free(msg);
+                mqtt_format_t format = format_of(TOPIC_LIST);
+                size_t len = build_mqtt_values(ctx->msg, &ctx->values, format);
+                publish_mqtt_message(mosq, addr, "list/", ctx->msg, len, format);
             }
         }
         break;
@@ -466,91 +590,32 @@ static void serve_reply(char *str) {
                 return;
             }
 
-            int16_t rssi;
-            if (!hex_to_bytesn(str, 4, (uint8_t *) &rssi, !is_big_endian())) {
-                snprintf(logbuf, sizeof(logbuf), "[error] Unable to parse RSSI from gate reply: %s\n", str);
-                logprint(logbuf);
-                return;
-            }
-
-            /* Skip RSSI hex */
-            str += 4;
-            
-            uint8_t status;
-            if (!hex_to_bytesn(str, 2, &status, !is_big_endian())) {
-                snprintf(logbuf, sizeof(logbuf), "[error] Unable to parse status from gate reply: %s\n", str);
-                logprint(logbuf);
-                return;
-            }
-            
-            /* Skip status hex */
-            str += 2;
-
-            uint8_t bytes[REPLY_LEN] = {};
-            if (!hex_to_bytes(str,  (uint8_t *) &bytes, false)) {
-                snprintf(logbuf, sizeof(logbuf), "[error] Unable to parse payload bytes gate reply: \"%s\" | len: %zu\n", str, strlen(str));
-                logprint(logbuf);
-                return;
+            char prefix[MQTT_TOPIC_PREFIX_LEN];
+            size_t prefix_len = device_seen(gate, nodeid, prefix);
+            if (!prefix_len) {
+                prefix_len = mqtt_topic_prefix(prefix, addr);
             }
-            
-            int moddatalen = strlen(str + 1) / 2;
 
-            uint8_t modid = bytes[0];
-            uint8_t *moddata = bytes + 1;
-
-            char *topic = (char *)malloc(64);
-            if (!topic) {
+            frame_ctx_t *ctx = frame_ctx_get();
+            if (!ctx) {
                 snprintf(logbuf, sizeof(logbuf), "[error] Unable to allocate memory\n");
                 logprint(logbuf);
                 return;
             }
-            
-            char *msg = (char *)malloc(MQTT_MAX_MSG_SIZE);
-            if (!msg) {
-                free(topic);
-                snprintf(logbuf, sizeof(logbuf), "[error] Unable to allocate memory\n");
-                logprint(logbuf);
+
+            mqtt_format_t format = format_of(TOPIC_DATA);
+            mqtt_props_t props;
+            size_t len = convert_uplink(str, addr, rx_time, format, &ctx->topic, ctx->msg, &props);
+            if (!len) {
                 return;
             }
 
-            mqtt_msg_t *mqtt_msg = (mqtt_msg_t *)malloc(MQTT_MSG_MAX_NUM * sizeof(mqtt_msg_t));
-            if (!mqtt_msg) {
-                free(msg);
-                free(topic);
-                snprintf(logbuf, sizeof(logbuf), "[error] Unable to allocate memory\n");
-                logprint(logbuf);
-                return;
+            if (batch_interval) {
+                batch_add(&uplink_batch, ctx->topic, ctx->msg, len);
             }
-            
-            memset((void *)mqtt_msg, 0, MQTT_MSG_MAX_NUM * sizeof(mqtt_msg_t));
-            
-            mqtt_status_t mqtt_status;           
-            mqtt_status.rssi = rssi;
-            mqtt_status.battery = 2000 + (50*(status & 0x1F));
-            mqtt_status.temperature = 20*(status >> 5) - 30;
-            
-            if (modid == UNWDS_MODULE_NOT_FOUND) {
-                strcpy(topic, "device");
-                strcat(mqtt_msg[0].name, "error");
-                char mqtt_val[50];
-                snprintf(mqtt_val, 50, "module ID %d is not available", moddata[0]);
-                strcat(mqtt_msg[0].value, mqtt_val);
-            } else {
-                if (!convert_to(modid, moddata, moddatalen, topic, mqtt_msg)) {
-                    snprintf(logbuf, sizeof(logbuf), "[error] Unable to convert gate reply \"%s\" for module %d\n", str, modid);
-                    logprint(logbuf);
-                    free(topic);
-                    free(msg);
-                    free(mqtt_msg);
-                    return;
-                }
+            if (!batch_interval || batch_devices) {
+                publish_mqtt_topic(mosq, prefix, prefix_len, ctx->topic, ctx->msg, len, &props);
             }
-
-            build_mqtt_message(msg, mqtt_msg, mqtt_status, addr);           
-            publish_mqtt_message(mosq, addr, topic, msg, (mqtt_format_t) mqtt_format);
-            free(topic);
-            free(msg);
-            free(mqtt_msg);
         }
         break;
 
@@ -574,44 +639,20 @@ static void serve_reply(char *str) {
                      nodeid, cl);
             logprint(logbuf);
             
-            mqtt_msg_t *mqtt_msg = (mqtt_msg_t *)malloc(MQTT_MSG_MAX_NUM * sizeof(mqtt_msg_t));
-            if (!mqtt_msg) {
-                snprintf(logbuf, sizeof(logbuf), "[error] Unable to allocate memory\n");
-                logprint(logbuf);
-                return;
-            }
-            memset((void *)mqtt_msg, 0, MQTT_MSG_MAX_NUM * sizeof(mqtt_msg_t));
-            
-            add_value_pair(mqtt_msg, "joined", "1");            
-            add_value_pair(mqtt_msg, "class", cl);
+            publish_device_event(addr, "joined", 1, "class", cl);
 
-            mqtt_status_t status = { 0 };
-            
-            char *msg = (char *)malloc(MQTT_MAX_MSG_SIZE);
-            if (!msg) {
-                free(mqtt_msg);
-                snprintf(logbuf, sizeof(logbuf), "[error] Unable to allocate memory\n");
-                logprint(logbuf);
-                return;
-            }
-            
-            build_mqtt_message(msg, mqtt_msg, status, addr);           
-            publish_mqtt_message(mosq, addr, "device", msg, (mqtt_format_t) mqtt_format);
-            free(msg);
-            free(mqtt_msg);
-
-            add_device(nodeid, nodeclass, true);
-
-            pending_item_t *e = pending_to_nodeid(nodeid);
-            if (e != NULL) {
-                /* If device is rejoined, check the pending messages */
-                if (e->num_pending) {
-                    /* Notify gate about pending messages */
-                    pthread_mutex_lock(&mutex_uart);
-                    dprintf(uart, "%c%" PRIx64 "%02x\r", CMD_HAS_PENDING, 
-                            nodeid, e->num_pending);
-                    pthread_mutex_unlock(&mutex_uart);    
-                }                
+            add_device(gate, nodeid, nodeclass, true, true);
+
+            pthread_mutex_lock(&gate->mutex_pending);
+            pending_item_t *e = pending_to_nodeid(gate, nodeid);
+            unsigned short num_pending = e ? e->num_pending : 0;
+            pthread_mutex_unlock(&gate->mutex_pending);
+
+            /* If device is rejoined, check the pending messages */
+            if (num_pending) {
+                /* Notify gate about pending messages */
+                cmdq_printf(&gate->tx_queue, "%c%" PRIx64 "%02x\r", CMD_HAS_PENDING, 
+                            nodeid, num_pending);
             }
         }
         break;
@@ -629,36 +670,11 @@ static void serve_reply(char *str) {
                 return;
             }
 
-            pending_item_t *e = pending_to_nodeid(nodeid);
-            if (e == NULL)
-                break;
-
-            if (kick_device(nodeid)) {
+            if (kick_device(gate, nodeid)) {
                 snprintf(logbuf, sizeof(logbuf), "[kick] Device with id = 0x%" PRIx64 " kicked due to long silence\n", nodeid);
                 logprint(logbuf);
                 
-                mqtt_msg_t *mqtt_msg = (mqtt_msg_t *)malloc(MQTT_MSG_MAX_NUM * sizeof(mqtt_msg_t));
-                if (!mqtt_msg) {
-                    snprintf(logbuf, sizeof(logbuf), "[error] Unable to allocate memory\n");
-                    logprint(logbuf);
-                    return;
-                }
-                
-                memset((void *)mqtt_msg, 0, MQTT_MSG_MAX_NUM * sizeof(mqtt_msg_t));
-                add_value_pair(mqtt_msg, "joined", "0");            
-                mqtt_status_t status = { 0 };
-                
-                char *msg = (char *)malloc(MQTT_MAX_MSG_SIZE);
-                if (!msg) {
-                    free(mqtt_msg);
-                    snprintf(logbuf, sizeof(logbuf), "[error] Unable to allocate memory\n");
-                    logprint(logbuf);
-                    return;
-                }
-                build_mqtt_message(msg, mqtt_msg, status, addr);           
-                publish_mqtt_message(mosq, addr, "device", msg, (mqtt_format_t) mqtt_format);
-                free(msg);
-                free(mqtt_msg);
+                publish_device_event(addr, "joined", 0, NULL, NULL);
             }
         }
         break;
@@ -680,11 +696,15 @@ static void serve_reply(char *str) {
             snprintf(logbuf, sizeof(logbuf), "[ack] ACK received from %" PRIx64 "\n", nodeid);
             logprint(logbuf);
 
-            pending_item_t *e = pending_to_nodeid(nodeid);
-            if (e == NULL)
+            device_seen(gate, nodeid, NULL);
+
+            pthread_mutex_lock(&gate->mutex_pending);
+            pending_item_t *e = pending_to_nodeid(gate, nodeid);
+            if (e == NULL) {
+                pthread_mutex_unlock(&gate->mutex_pending);
                 break;
+            }
 
-            pthread_mutex_lock(&mutex_pending);
             /* No need to invite device */
             e->has_been_invited = false;
 
@@ -696,7 +716,7 @@ static void serve_reply(char *str) {
                 e->num_pending--;
 
             e->num_retries = 0;
-            pthread_mutex_unlock(&mutex_pending);            
+            pthread_mutex_unlock(&gate->mutex_pending);            
         }
         break;
 
@@ -714,19 +734,21 @@ static void serve_reply(char *str) {
                 return;
             }
 
-            pending_item_t *e = pending_to_nodeid(nodeid);
-            if (e != NULL) {
-                /* Check if there's pending frames for this class A device */
-                if (e->nodeclass == LS_ED_CLASS_A && e->num_pending > 0) {
-                    snprintf(logbuf, sizeof(logbuf), "[pending] Gate requested next pending frame for 0x%" PRIx64 "\n", nodeid);
-                    logprint(logbuf);                    
-
-                    pthread_mutex_lock(&mutex_pending);
-                    e->can_send = true;
-                    e->last_msg = 0; /* Force immediate sending */
-                    pthread_mutex_unlock(&mutex_pending);        
-                }
-            }            
+            device_seen(gate, nodeid, NULL);
+
+            pthread_mutex_lock(&gate->mutex_pending);
+            pending_item_t *e = pending_to_nodeid(gate, nodeid);
+            /* Check if there's pending frames for this class A device */
+            if (e != NULL && e->nodeclass == LS_ED_CLASS_A && e->num_pending > 0) {
+                e->can_send = true;
+                e->last_msg = 0; /* Force immediate sending */
+                pthread_mutex_unlock(&gate->mutex_pending);
+
+                snprintf(logbuf, sizeof(logbuf), "[pending] Gate requested next pending frame for 0x%" PRIx64 "\n", nodeid);
+                logprint(logbuf);
+            } else {
+                pthread_mutex_unlock(&gate->mutex_pending);
+            }
         }
         break;
         default:
@@ -735,190 +757,119 @@ static void serve_reply(char *str) {
     }
 }
 
-static void invite_mote(uint64_t addr) 
+static void invite_mote(gate_t *gate, pending_item_t *e) 
 {
-    snprintf(logbuf, sizeof(logbuf), "[inv] Sending invitation to node with address 0x%" PRIx64 "\n", addr);
+    char logbuf[LOGBUF_LEN];
+    snprintf(logbuf, sizeof(logbuf), "[inv] Sending invitation to node with address 0x%" PRIx64 "\n", e->nodeid);
     logprint(logbuf);
     
-    mqtt_msg_t *mqtt_msg = (mqtt_msg_t *)malloc(MQTT_MSG_MAX_NUM * sizeof(mqtt_msg_t));
-    if (!mqtt_msg) {
-        snprintf(logbuf, sizeof(logbuf), "[error] Unable to allocate memory\n");
-        logprint(logbuf);
-        return;
-    }
-
-    memset((void *)mqtt_msg, 0, MQTT_MSG_MAX_NUM * sizeof(mqtt_msg_t));
-    add_value_pair(mqtt_msg, "invited", "1");
-    add_value_pair(mqtt_msg, "message", "sending invitation to the node");
-    mqtt_status_t status = { 0 };
-    
-    char *msg = (char *)malloc(MQTT_MAX_MSG_SIZE);
-    if (!msg) {
-        free(mqtt_msg);
-        snprintf(logbuf, sizeof(logbuf), "[error] Unable to allocate memory\n");
-        logprint(logbuf);
-        return;
-    }
-    
-    char hexbuf[40];
-    snprintf(hexbuf, sizeof(hexbuf), "%" PRIx64, addr);
-    build_mqtt_message(msg, mqtt_msg, status, hexbuf);
-    publish_mqtt_message(mosq, hexbuf, "device", msg, (mqtt_format_t) mqtt_format);
+    publish_device_event(e->eui, "invited", 1, "message", "sending invitation to the node");
 
-    free(msg);
-    free(mqtt_msg);
-
-    pthread_mutex_lock(&mutex_uart);
-    dprintf(uart, "%c%" PRIx64 "\r", CMD_INVITE, addr);
-    pthread_mutex_unlock(&mutex_uart);
+    cmdq_printf(&gate->tx_queue, "%c%" PRIx64 "\r", CMD_INVITE, e->nodeid);
 }
 
-static void* pending_worker(void *arg) {
-    (void) arg;
+static void pending_gate(gate_t *gate) {
+    char logbuf[LOGBUF_LEN];
+    pthread_mutex_lock(&gate->mutex_pending);
 
-    while (1) {
-        pthread_mutex_lock(&mutex_pending);
+    int i;    
+    for (i = 0; i < MAX_PENDING_NODES; i++) {
+        if (gate->pending_free[i]) {
+            continue;
+        }
 
-        int i;    
-        for (i = 0; i < MAX_PENDING_NODES; i++) {
-            if (pending_free[i]) {
-                continue;
-            }
+        pending_item_t *e = &gate->pending[i];
+        time_t current = time(NULL);
 
-            pending_item_t *e = &pending[i];
-            time_t current = time(NULL);
+        if (is_fifo_empty(&e->pending_fifo)) {
+            continue;
+        }
 
-            if (is_fifo_empty(&e->pending_fifo)) {
-                continue;
-            }
+        /* Messages for Class A devices will be sent only on demand */
+        if (e->nodeclass == LS_ED_CLASS_A && !e->can_send) {
+            continue;
+        }
 
-            /* Messages for Class A devices will be sent only on demand */
-            if (e->nodeclass == LS_ED_CLASS_A && !e->can_send) {
-                continue;
-            }
+        /* Must wait for device to join before sending messages */
+        if (e->nodeclass == LS_ED_CLASS_C && e->has_been_invited) {
+            if (e->num_retries > NUM_RETRIES_INV) {
+                snprintf(logbuf, sizeof(logbuf), "[fail] Unable to invite node 0x%" PRIx64 " to network after %u attempts, giving up\n", e->nodeid, NUM_RETRIES_INV);
+                logprint(logbuf);
 
-            /* Must wait for device to join before sending messages */
-            if (e->nodeclass == LS_ED_CLASS_C && e->has_been_invited) {
-                if (e->num_retries > NUM_RETRIES_INV) {
-                    snprintf(logbuf, sizeof(logbuf), "[fail] Unable to invite node 0x%" PRIx64 " to network after %u attempts, giving up\n", e->nodeid, NUM_RETRIES_INV);
-                    logprint(logbuf);
+                publish_device_event(e->eui, "invited", 0, "message", "failed to invite node");
 
-                    mqtt_msg_t *mqtt_msg = (mqtt_msg_t *)malloc(MQTT_MSG_MAX_NUM * sizeof(mqtt_msg_t));
-                    if (!mqtt_msg) {
-                        snprintf(logbuf, sizeof(logbuf), "[error] Unable to allocate memory\n");
-                        logprint(logbuf);
-                        continue;
-                    }
-                    
-                    memset((void *)mqtt_msg, 0, MQTT_MSG_MAX_NUM * sizeof(mqtt_msg_t));
-                    add_value_pair(mqtt_msg, "invited", "0");
-                    add_value_pair(mqtt_msg, "message", "failed to invite node");
-                    mqtt_status_t status = { 0 };
-                    
-                    char *msg = (char *)malloc(MQTT_MAX_MSG_SIZE);
-                    if (!msg) {
-                        free(mqtt_msg);
-                        snprintf(logbuf, sizeof(logbuf), "[error] Unable to allocate memory\n");
-                        logprint(logbuf);
-                        continue;
-                    }
-                    
-                    char hexbuf[40];
-                    snprintf(hexbuf, 40, "%" PRIx64, e->nodeid);
-                    build_mqtt_message(msg, mqtt_msg, status, hexbuf);
-                    publish_mqtt_message(mosq, hexbuf, "device", msg, (mqtt_format_t) mqtt_format);
-
-                    free(msg);
-                    free(mqtt_msg);
-
-                    e->num_retries = 0;
-                    m_dequeue(&e->pending_fifo, NULL);                        
-                } else
-                if (current - e->last_inv > e->num_retries * INVITE_TIMEOUT_S) {
-                    /* Retry invitation */
-                    invite_mote(e->nodeid);
-
-                    e->num_retries++;
-                    e->last_inv = current;
-
-                    if (e->num_retries <= NUM_RETRIES_INV) {
-                        snprintf(logbuf, sizeof(logbuf), "[inv] [%d/%d] Next invitation retry after %d seconds\n", 
-                                        e->num_retries, NUM_RETRIES_INV, e->num_retries * INVITE_TIMEOUT_S);
-                        logprint(logbuf);
-                    }
-                }
+                e->num_retries = 0;
+                m_dequeue(&e->pending_fifo, NULL);                        
+            } else
+            if (current - e->last_inv > e->num_retries * INVITE_TIMEOUT_S) {
+                /* Retry invitation */
+                invite_mote(gate, e);
 
-                continue;
-            }
+                e->num_retries++;
+                e->last_inv = current;
 
-            if (current - e->last_msg > tx_delay) {
-                if (e->num_retries > NUM_RETRIES) {
-                    snprintf(logbuf, sizeof(logbuf), "[fail] Unable to send message to 0x%" PRIx64 " after %u attempts, giving up\n", 
-                              e->nodeid, NUM_RETRIES);
+                if (e->num_retries <= NUM_RETRIES_INV) {
+                    snprintf(logbuf, sizeof(logbuf), "[inv] [%d/%d] Next invitation retry after %d seconds\n", 
+                                    e->num_retries, NUM_RETRIES_INV, e->num_retries * INVITE_TIMEOUT_S);
                     logprint(logbuf);
-                    
-                    mqtt_msg_t *mqtt_msg = (mqtt_msg_t *)malloc(MQTT_MSG_MAX_NUM * sizeof(mqtt_msg_t));
-                    if (!mqtt_msg) {
-                        snprintf(logbuf, sizeof(logbuf), "[error] Unable to allocate memory\n");
-                        logprint(logbuf);
-                        continue;
-                    }
-                    
-                    memset((void *)mqtt_msg, 0, MQTT_MSG_MAX_NUM * sizeof(mqtt_msg_t));
-                    add_value_pair(mqtt_msg, "sent", "0");
-                    add_value_pair(mqtt_msg, "message", "failed to send message to the node");
-                    mqtt_status_t status = { 0 };
-                    
-                    char *msg = (char *)malloc(MQTT_MAX_MSG_SIZE);
-                    if (!msg) {
-                        free(mqtt_msg);
-                        snprintf(logbuf, sizeof(logbuf), "[error] Unable to allocate memory\n");
-                        logprint(logbuf);
-                        continue;
-                    }
-                    char hexbuf[40];
-                    snprintf(hexbuf, 40, "%" PRIx64, e->nodeid);
-                    build_mqtt_message(msg, mqtt_msg, status, hexbuf);
-                    publish_mqtt_message(mosq, hexbuf, "device", msg, (mqtt_format_t) mqtt_format);
-
-                    free(msg);
-                    free(mqtt_msg);
-                    
-                    e->num_retries = 0;
-                    m_dequeue(&e->pending_fifo, NULL);
-
-                    continue;
                 }
+            }
 
-                char buf[REPLY_LEN] = {};
-                if (!m_peek(&e->pending_fifo, buf)) /* Peek message from queue but don't remove. Will be removed on acknowledge */
-                    continue;
+            continue;
+        }
 
-                snprintf(logbuf, sizeof(logbuf), "[pending] [%d/%d] Sending message to 0x%" PRIx64 ": %s\n", 
-                    e->num_retries + 1, (e->num_retries < tx_maxretr) ? tx_maxretr : NUM_RETRIES,
-                    e->nodeid, buf);
+        if (current - e->last_msg > tx_delay) {
+            if (e->num_retries > NUM_RETRIES) {
+                snprintf(logbuf, sizeof(logbuf), "[fail] Unable to send message to 0x%" PRIx64 " after %u attempts, giving up\n", 
+                          e->nodeid, NUM_RETRIES);
                 logprint(logbuf);
+                
+                publish_device_event(e->eui, "sent", 0, "message", "failed to send message to the node");
+                
+                e->num_retries = 0;
+                m_dequeue(&e->pending_fifo, NULL);
 
-                e->num_retries++;
+                continue;
+            }
 
-                /* Send */
-                pthread_mutex_lock(&mutex_uart);
-                dprintf(uart, "%s\r", buf);
-                pthread_mutex_unlock(&mutex_uart);
+            char buf[REPLY_LEN] = {};
+            if (!m_peek(&e->pending_fifo, buf)) /* Peek message from queue but don't remove. Will be removed on acknowledge */
+                continue;
 
-                /* Send invitation after tx_maxretr retransmissions */
-                if (e->nodeclass == LS_ED_CLASS_C && e->num_retries == tx_maxretr) {
-                    e->num_retries = 1;
-                    e->last_inv = current;
-                    e->has_been_invited = true;
-                }
+            snprintf(logbuf, sizeof(logbuf), "[pending] [%d/%d] Sending message to 0x%" PRIx64 ": %s\n", 
+                e->num_retries + 1, (e->num_retries < tx_maxretr) ? tx_maxretr : NUM_RETRIES,
+                e->nodeid, buf);
+            logprint(logbuf);
+
+            e->num_retries++;
 
-                e->can_send = false;
-                e->last_msg = current;            
+            /* Send */
+            cmdq_printf(&gate->tx_queue, "%s\r", buf);
+
+            /* Send invitation after tx_maxretr retransmissions */
+            if (e->nodeclass == LS_ED_CLASS_C && e->num_retries == tx_maxretr) {
+                e->num_retries = 1;
+                e->last_inv = current;
+                e->has_been_invited = true;
             }
+
+            e->can_send = false;
+            e->last_msg = current;            
+        }
+    }
+
+    pthread_mutex_unlock(&gate->mutex_pending);
+}
+
+static void* pending_worker(void *arg) {
+    (void) arg;
+
+    while (1) {
+        int i;
+        for (i = 0; i < num_gates; i++) {
+            pending_gate(gates[i]);
         }
 
-        pthread_mutex_unlock(&mutex_pending);
         usleep(1e3 * QUEUE_POLLING_INTERVAL);
     }
 
@@ -928,20 +879,99 @@ static void* pending_worker(void *arg) {
 /* Publishes messages into MQTT */
 static void *publisher(void *arg)
 { 
+    worker_t *worker = (worker_t *)arg;
+
     while(1) {
         /* Wait for a message to arrive */
-        if (msgrcv(msgqid, &msg_rx, sizeof(msg_rx.mtext), 0, 0) < 0) {
-            puts("[error] Failed to receive internal message");
-            continue;
-        } else {
-            puts("[info] Internal message received");
-        }
-        serve_reply(msg_rx.mtext);
+        frameq_frame_t *frame = frameq_pop(&worker->rx_queue);
+        puts("[info] Internal message received");
+
+        serve_reply(gates[frame->source], frame->data, &frame->rx_time);
+        frameq_release(&worker->rx_queue, frame);
+        atomic_fetch_sub(&worker->queued, 1);
     }    
     
     return NULL;
 }
 
+/* Picks the worker by the device EUI that follows the reply type */
+static worker_t *worker_for_frame(const char *data, unsigned len)
+{
+    uint64_t eui;
+
+    if (num_workers == 1 || len < 17 || !hex_to_bytesn((char *)data + 1, 16, (uint8_t *)&eui, false)) {
+        return &workers[0];
+    }
+
+    /* Fibonacci hashing spreads sequential EUIs evenly */
+    return &workers[((eui * 0x9E3779B97F4A7C15ULL) >> 32) % num_workers];
+}
+
+/* Hands the frame over to its worker, waits if the worker is lagging behind */
+static bool dispatch_frame(int source, const struct timeval *rx_time, const char *data, unsigned len)
+{
+    if (len >= FRAMEQ_FRAME_SIZE) {
+        return false;
+    }
+
+    worker_t *worker = worker_for_frame(data, len);
+    atomic_fetch_add(&worker->queued, 1);
+
+    /* Wait for the worker like msgsnd() did */
+    if (!frameq_push(&worker->rx_queue, source, rx_time, data, len)) {
+        puts("[warning] Internal queue is full, waiting");
+        while (!frameq_push(&worker->rx_queue, source, rx_time, data, len)) {
+            usleep(DISPATCH_RETRY_INTERVAL);
+        }
+    }
+
+    return true;
+}
+
+/* Waits until every dispatched frame is served */
+static void workers_wait_idle(void)
+{
+    int i;
+    for (i = 0; i < num_workers; i++) {
+        while (atomic_load(&workers[i].queued)) {
+            usleep(1e3);
+        }
+    }
+}
+
+static int start_workers(void)
+{
+    char logbuf[LOGBUF_LEN];
+    int i;
+
+    for (i = 0; i < num_workers; i++) {
+        worker_t *worker = &workers[i];
+        worker->num = i;
+        atomic_init(&worker->queued, 0);
+
+        if (!frameq_init(&worker->rx_queue, FRAMEQ_DEFAULT_SLOTS)) {
+            puts("Failed to create message queue");
+            return -1;
+        }
+
+        if (pthread_create(&worker->thread, NULL, publisher, worker)) {
+            snprintf(logbuf, sizeof(logbuf), "Error creating publisher thread\n");
+            logprint(logbuf);
+            return -1;
+        }
+
+        char name[16];
+        if (num_workers == 1) {
+            snprintf(name, sizeof(name), "publisher");
+        } else {
+            snprintf(name, sizeof(name), "publisher%d", i);
+        }
+        pthread_setname_np(worker->thread, name);
+    }
+
+    return 0;
+}
+
 #define STATIC_DEVS_LIST_FILE "/etc/lora-mqtt/static-devs.conf"
 
 /* 
@@ -960,11 +990,10 @@ static void *publisher(void *arg)
  * NB: each device line must be 54 characters long
  *
  */
-static void send_static_devices_list(void) {
+static void send_static_devices_list(gate_t *gate) {
+    char logbuf[LOGBUF_LEN];
     /* Clear list */
-    pthread_mutex_lock(&mutex_uart);
-    dprintf(uart, "%c\r", CMD_KICK_ALL_STATIC);
-    pthread_mutex_unlock(&mutex_uart);
+    cmdq_printf_wait(&gate->tx_queue, "%c\r", CMD_KICK_ALL_STATIC);
 
     /* Send list of statically personalized devices */
     FILE *list = fopen(STATIC_DEVS_LIST_FILE, "r");
@@ -986,9 +1015,7 @@ static void send_static_devices_list(void) {
                 sscanf(line, "%s %s %s %s %s", eui64, appid64, addr, devnonce, nochannel);
 
                 /* Send item to the gate */
-                pthread_mutex_lock(&mutex_uart);
-                dprintf(uart, "%c%s%s%s%s%s\r", CMD_ADD_STATIC_DEV, eui64, appid64, addr, devnonce, nochannel);
-                pthread_mutex_unlock(&mutex_uart);
+                cmdq_printf_wait(&gate->tx_queue, "%c%s%s%s%s%s\r", CMD_ADD_STATIC_DEV, eui64, appid64, addr, devnonce, nochannel);
 
                 num++;
             }
@@ -1001,154 +1028,240 @@ static void send_static_devices_list(void) {
         return;
     }
 
-    snprintf(logbuf, sizeof(logbuf), "[gate] List of statically personalized devices (%i pcs) sent", num);    
+    snprintf(logbuf, sizeof(logbuf), "[gate] List of statically personalized devices (%i pcs) sent to %s", num, gate->uart.uri);    
     logprint(logbuf);
 }
 
-/* Periodic read data from UART */
-static void *uart_reader(void *arg)
+static void uart_request_flush(gate_t *gate)
 {
-    puts("[gate] UART reading thread created");
+    cmdq_printf(&gate->tx_queue, "%c\r", CMD_FLUSH);
+}
 
-    while(1) {
-        char buf[REPLY_LEN] = { '\0', };
-        char c;
-        int r = 0, i = 0;
+/* Calculates poll() timeout and sends CMD_FLUSH if it's time to */
+static int uart_flush_timeout(gate_t *gate, uint64_t *next_flush)
+{
+    uint64_t now = get_time_ms();
 
-        pthread_mutex_lock(&mutex_uart);
-        
-        //puts("[info] Requesting data");
+    switch (uart_flush) {
+        case UART_FLUSH_POLL:
+        case UART_FLUSH_PENDING:
+            if (uart_flush_interval <= 0) {
+                return -1;
+            }
 
-        dprintf(uart, "%c\r", CMD_FLUSH);
+            if (now >= *next_flush) {
+                uart_request_flush(gate);
+                *next_flush = now + uart_flush_interval;
+            }
+            return *next_flush - now;
 
-        while ((r = read(uart, &c, 1)) != 0) {
-            buf[i++] = c;
-        }
+        case UART_FLUSH_PUSH:
+        default:
+            return -1;
+    }
+}
 
-        pthread_mutex_unlock(&mutex_uart);
+/* Waits for data from UART */
+static void *uart_reader(void *arg)
+{
+    char logbuf[LOGBUF_LEN];
+    gate_t *gate = (gate_t *)arg;
 
-        buf[i] = '\0';
+    snprintf(logbuf, sizeof(logbuf), "[gate] UART reading thread created for %s", gate->uart.uri);
+    logprint(logbuf);
 
-        if (strlen(buf) > 0) {
-            char *running = strdup(buf), *token;
-            const char *delims = "\n";
-            
-            while ((token = strsep(&running, delims)) != NULL) {
-                if (strlen(token) == 0) {
-                    continue;
-                }
-                
-                if((strlen(token) + 1 ) > sizeof(msg_rx.mtext)) {
-                    puts("[error] Oversized message, unable to send");
-                    continue;
-                }
-                
-                printf("[info] Received: 0x");
-                int t = 0;
-                for (t = 0; t < strlen(token); t++) {
-                    printf("%02x", token[t]);
-                }
-                printf("\n");
-                
-                msg_rx.mtype = 1;
-                memcpy(msg_rx.mtext, token, strlen(token) + 1);
-                
-                puts("[info] Sending internal message");
-                
-                if (msgsnd(msgqid, &msg_rx, sizeof(msg_rx.mtext), 0) < 0) {
-                    perror( strerror(errno) );
-                    puts("[error] Failed to send internal message");
-                    continue;
-                } else {
-                    puts("[info] Internal message sent");
-                }
+    struct pollfd pfd = { .fd = gate->uart.fd, .events = POLLIN };
+    uint64_t next_flush = 0;
+
+    ringbuf_init(&gate->uart_rx);
+
+    while(1) {
+        int timeout = uart_flush_timeout(gate, &next_flush);
+
+        /* Wake up at once if there's some housekeeping to do */
+        if (gate->devlist_needed || !gate->static_devices_list_sent) {
+            timeout = 0;
+        }
+
+        int res = poll(&pfd, 1, timeout);
+        if (res < 0) {
+            if (errno != EINTR) {
+                snprintf(logbuf, sizeof(logbuf), "[error] Unable to poll UART: %s", strerror(errno));
+                logprint(logbuf);
+                sleep(1);
+            }
+            continue;
+        }
+
+        bool link_lost = false;
+
+        if (pfd.revents & (POLLERR | POLLHUP | POLLNVAL)) {
+            puts("[error] UART port error");
+            link_lost = true;
+        }
+
+        /* Frames completed by this read are dated by it */
+        struct timeval rx_time;
+        gettimeofday(&rx_time, NULL);
+
+        if (pfd.revents & POLLIN) {
+            if (uart_flush == UART_FLUSH_PENDING) {
+                /* Gate has something for us, pick up all of it */
+                uart_request_flush(gate);
+                next_flush = get_time_ms() + uart_flush_interval;
+            }
+
+            ssize_t n = ringbuf_read(&gate->uart_rx, gate->uart.fd);
+            if (n < 0 && errno != EAGAIN && errno != EINTR) {
+                snprintf(logbuf, sizeof(logbuf), "[error] Unable to read UART: %s", strerror(errno));
+                logprint(logbuf);
+            }
+
+            /* Sockets report a closed connection with EOF */
+            if (n == 0 && gate->uart.ops->stream) {
+                link_lost = true;
+            }
+        }
+
+        if (link_lost) {
+            sleep(1);
+            if (!transport_reopen(&gate->uart)) {
+                continue;
+            }
+
+            /* Drop partial frame and resync devices with the gate */
+            ringbuf_init(&gate->uart_rx);
+            gate->devlist_needed = true;
+            continue;
+        }
+
+        char *token;
+        unsigned len;
+        bool dropped = false;
+
+        while ((token = ringbuf_next_frame(&gate->uart_rx, '\n', &len, &dropped)) != NULL) {
+            if (len == 0) {
+                continue;
+            }
+            
+            if((len + 1) > FRAMEQ_FRAME_SIZE) {
+                puts("[error] Oversized message, unable to send");
+                continue;
+            }
+
+            capture_write(&capture, CAPTURE_RX, gate->num, token, len);
+            
+            printf("[info] Received: 0x");
+            int t = 0;
+            for (t = 0; t < len; t++) {
+                printf("%02x", token[t]);
             }
+            printf("\n");
+            
+            puts("[info] Sending internal message");
+            dispatch_frame(gate->num, &rx_time, token, len);
+            puts("[info] Internal message sent");
+        }
+
+        if (dropped) {
+            puts("[error] Oversized message, unable to send");
         }
-        usleep(1e3 * UART_POLLING_INTERVAL);
         
         /* Request devices list on demand */
-        if (devlist_needed) {
+        if (gate->devlist_needed) {
             puts("[!] Device list requested");
-            devlist_needed = false; /* No more devices lists needed */
-            devices_list(true);
+            gate->devlist_needed = false; /* No more devices lists needed */
+            devices_list(gate, true);
 
             usleep(1e3 * 150);
         }
 
-        if (!static_devices_list_sent) {
-            send_static_devices_list();
-            static_devices_list_sent = true;
+        if (!gate->static_devices_list_sent) {
+            send_static_devices_list(gate);
+            gate->static_devices_list_sent = true;
+        }
+    }
+
+    return NULL;
+}
+
+/* Sends queued commands to the gate */
+static void *uart_writer(void *arg)
+{
+    char logbuf[LOGBUF_LEN];
+    gate_t *gate = (gate_t *)arg;
+
+    snprintf(logbuf, sizeof(logbuf), "[gate] UART writing thread created for %s", gate->uart.uri);
+    logprint(logbuf);
+
+    while (1) {
+        struct iovec iov[2];
+        int iovcnt = cmdq_wait(&gate->tx_queue, iov);
+
+        /* Everything queued so far goes out in one syscall */
+        ssize_t res = writev(gate->uart.fd, iov, iovcnt);
+        if (res < 0) {
+            if (errno != EINTR && errno != EAGAIN) {
+                snprintf(logbuf, sizeof(logbuf), "[error] Unable to write to UART: %s", strerror(errno));
+                logprint(logbuf);
+                sleep(1);
+            }
+            continue;
         }
+
+        capture_writev(&capture, CAPTURE_TX, gate->num, iov, iovcnt, res);
+        cmdq_consume(&gate->tx_queue, res);
     }
 
     return NULL;
 }
 
-static void devices_list(bool internal) 
+static void devices_list(gate_t *gate, bool internal) 
 {
-    list_for_gate = internal;
+    gate->list_for_gate = internal;
 
-    pthread_mutex_lock(&mutex_uart);
-    dprintf(uart, "%c\r", CMD_DEVLIST);
-    pthread_mutex_unlock(&mutex_uart);
+    cmdq_printf(&gate->tx_queue, "%c\r", CMD_DEVLIST);
 }
 
 static void message_to_mote(uint64_t addr, char *payload) 
 {
+    char logbuf[LOGBUF_LEN];
     snprintf(logbuf, sizeof(logbuf), "[gate] Sending individual message to the mote with address \"%" PRIx64 "\": \"%s\"\n", 
                     addr, payload);    
     logprint(logbuf);
 
-    pending_item_t *e = pending_to_nodeid(addr);
-    if (e == NULL) {
+    /* Downlink goes through the gate which heard the device last */
+    gate_t *gate = route_to_nodeid(addr);
+    if (gate == NULL) {
         snprintf(logbuf, sizeof(logbuf), "[error] Mote with id = %" PRIx64 " is not in network, an invite will be sent\n", addr);
         logprint(logbuf);
-        mqtt_msg_t *mqtt_msg = (mqtt_msg_t *)malloc(MQTT_MSG_MAX_NUM * sizeof(mqtt_msg_t));
-        if (!mqtt_msg) {
-            free(mqtt_msg);
-            snprintf(logbuf, sizeof(logbuf), "[error] Unable to allocate memory\n");
-            logprint(logbuf);
-            return;
-        }
-        memset((void *)mqtt_msg, 0, MQTT_MSG_MAX_NUM * sizeof(mqtt_msg_t));
-        add_value_pair(mqtt_msg, "sent", "2");
-        add_value_pair(mqtt_msg, "message", "node not in the network");
-        mqtt_status_t status = { 0 };
-                    
-        char *msg = (char *)malloc(MQTT_MAX_MSG_SIZE);
-        if (!msg) {
-            free(mqtt_msg);
-            snprintf(logbuf, sizeof(logbuf), "[error] Unable to allocate memory\n");
-            logprint(logbuf);
-            return;
-        }
-
         char hexbuf[40];
-        snprintf(hexbuf, sizeof(hexbuf), "%" PRIx64, addr);
-        build_mqtt_message(msg, mqtt_msg, status, hexbuf);
-        publish_mqtt_message(mosq, hexbuf, "device", msg, (mqtt_format_t) mqtt_format);
-
-        free(msg);
-        free(mqtt_msg);
+        snprintf(hexbuf, sizeof(hexbuf), "%016" PRIx64, addr);
+        publish_device_event(hexbuf, "sent", 2, "message", "node not in the network");
         
-        add_device(addr, LS_ED_CLASS_C, false);
-        e = pending_to_nodeid(addr);
+        /* Unknown device is invited by the first gate */
+        gate = gates[0];
+        add_device(gate, addr, LS_ED_CLASS_C, false, false);
     }
 
+    /* Enqueue the frame as a gate command */
+    char buf[REPLY_LEN] = {};
+    snprintf(buf, sizeof(buf), "%c%" PRIx64 "%s", CMD_IND, addr, payload);
+
+    pthread_mutex_lock(&gate->mutex_pending);
+
+    /* Workers may have kicked the device or reused its record meanwhile */
+    pending_item_t *e = pending_to_nodeid(gate, addr);
     if (e == NULL) {
+        pthread_mutex_unlock(&gate->mutex_pending);
         puts("[error] Unable to add new device. Is devices list overflowed?\n");    
         return;
     }
 
-    /* Enqueue the frame as a gate command */
-    char buf[REPLY_LEN] = {};
-    snprintf(buf, sizeof(buf), "%c%" PRIx64 "%s", CMD_IND, addr, payload);
-
-    pthread_mutex_lock(&mutex_pending);
     if (!m_enqueue(&e->pending_fifo, buf)) {
         snprintf(logbuf, sizeof(logbuf), "[error] Out of memory when adding message to downlink queue for mote with id %" PRIx64 "!\n", addr);
         logprint(logbuf);
-        pthread_mutex_unlock(&mutex_pending);
+        pthread_mutex_unlock(&gate->mutex_pending);
         return;
     }
 
@@ -1158,26 +1271,27 @@ static void message_to_mote(uint64_t addr, char *payload)
         e->num_pending++;
         
         /* Notify gate about pending messages */
-        pthread_mutex_lock(&mutex_uart);
-        dprintf(uart, "%c%" PRIx64 "%02x\r", CMD_HAS_PENDING, addr, e->num_pending);
-        pthread_mutex_unlock(&mutex_uart);        
+        cmdq_printf(&gate->tx_queue, "%c%" PRIx64 "%02x\r", CMD_HAS_PENDING, addr, e->num_pending);
     }
 
-    pthread_mutex_unlock(&mutex_pending);
+    pthread_mutex_unlock(&gate->mutex_pending);
 }
 
 static void message_broadcast(char *payload) {
+    char logbuf[LOGBUF_LEN];
     snprintf(logbuf, sizeof(logbuf), "[gate] Sending broadcast message: \"%s\"\n", payload);    
     logprint(logbuf);
 
-    /* Send gate command */
-    pthread_mutex_lock(&mutex_uart);
-    dprintf(uart, "%c%s\r", CMD_BROADCAST, payload);
-    pthread_mutex_unlock(&mutex_uart);    
+    /* Send gate command to every gate */
+    int i;
+    for (i = 0; i < num_gates; i++) {
+        cmdq_printf(&gates[i]->tx_queue, "%c%s\r", CMD_BROADCAST, payload);
+    }
 }
 
 static void my_message_callback(struct mosquitto *m, void *userdata, const struct mosquitto_message *message)
 {
+    char logbuf[LOGBUF_LEN];
     /* Ignore messages published by gate itself */
     /* Doesn't work with QoS 0 */
     if (message->mid != 0) {
@@ -1214,7 +1328,10 @@ static void my_message_callback(struct mosquitto *m, void *userdata, const struc
 
     if (topic_count == 3 && memcmp(topics[2], "get", 3) == 0) {
         puts("[mqtt] Devices list requested");
-        devices_list(false);
+        int i;
+        for (i = 0; i < num_gates; i++) {
+            devices_list(gates[i], false);
+        }
     }
     
     /* commands to change gate settings */
@@ -1264,10 +1381,18 @@ static void my_message_callback(struct mosquitto *m, void *userdata, const struc
             return;
         }
         
-        if (!payload) {
-            dprintf(uart, "%c\r", command);
-        } else {
-            dprintf(uart, "%c%s\r", command, payload);
+        /* devices/lora/gate/<command>/<gate number> addresses only one of the gates */
+        int i;
+        for (i = 0; i < num_gates; i++) {
+            if (topic_count > 4 && atoi(topics[4]) != i) {
+                continue;
+            }
+
+            if (!payload) {
+                cmdq_printf(&gates[i]->tx_queue, "%c\r", command);
+            } else {
+                cmdq_printf(&gates[i]->tx_queue, "%c%s\r", command, payload);
+            }
         }
     }
 
@@ -1320,6 +1445,7 @@ static void my_message_callback(struct mosquitto *m, void *userdata, const struc
 
 static void my_connect_callback(struct mosquitto *m, void *userdata, int result)
 {
+    char logbuf[LOGBUF_LEN];
 //    int i;
     if(!result){
         /* Subscribe to broker information topics on successful connect. */
@@ -1327,14 +1453,112 @@ static void my_connect_callback(struct mosquitto *m, void *userdata, int result)
         logprint(logbuf);
 
         mosquitto_subscribe(mosq, NULL, MQTT_SUBSCRIBE_TO, 2);
+
+        if (mqtt_pubq) {
+            pubq_pause(mqtt_pubq, false);
+        }
+
+        /* Replay starts once the messages have somewhere to go */
+        static bool replay_started = false;
+        if (replay_name && !replay_started) {
+            replay_started = true;
+            if (pthread_create(&replay_thread, NULL, replay, NULL)) {
+                snprintf(logbuf, sizeof(logbuf), "Error creating replay thread\n");
+                logprint(logbuf);
+            } else {
+                pthread_setname_np(replay_thread, "replay");
+            }
+        }
     }else{
         snprintf(logbuf, sizeof(logbuf), "Connect failed\n");
         logprint(logbuf);
     }
 }
 
+static void my_disconnect_callback(struct mosquitto *m, void *userdata, int result)
+{
+    char logbuf[LOGBUF_LEN];
+
+    /* Messages wait in the queue until libmosquitto reconnects */
+    if (mqtt_pubq) {
+        pubq_pause(mqtt_pubq, true);
+    }
+
+    /* Aliases are valid for one connection only */
+    if (mqtt_aliases) {
+        topic_alias_reset(mqtt_aliases, 0);
+    }
+
+    /* Unsent QoS 0 messages are dropped on reconnect with no callback,
+     * QoS 1 and 2 ones are resent and acked later */
+    if (mqtt_qos == 0) {
+        pthread_mutex_lock(&publish_mutex);
+        publish_inflight = 0;
+        pthread_cond_signal(&publish_cond);
+        pthread_mutex_unlock(&publish_mutex);
+    }
+
+    snprintf(logbuf, sizeof(logbuf), "[mqtt] Disconnected from the broker: %s\n", mosquitto_strerror(result));
+    logprint(logbuf);
+}
+
+/* Called along with my_connect_callback() for MQTT v5 */
+static void my_connect_v5_callback(struct mosquitto *m, void *userdata, int result, int flags,
+                                   const mosquitto_property *props)
+{
+    char logbuf[LOGBUF_LEN];
+
+    if (result || !mqtt_aliases) {
+        return;
+    }
+
+    /* Broker allows no aliases unless it says otherwise */
+    uint16_t broker_max = 0;
+    mosquitto_property_read_int16(props, MQTT_PROP_TOPIC_ALIAS_MAXIMUM, &broker_max, false);
+    topic_alias_reset(mqtt_aliases, broker_max);
+
+    snprintf(logbuf, sizeof(logbuf), "[mqtt] Topic aliases: %u, broker allows %u\n",
+             mqtt_aliases->num, broker_max);
+    logprint(logbuf);
+}
+
+static void my_publish_callback(struct mosquitto *m, void *userdata, int mid)
+{
+    pthread_mutex_lock(&publish_mutex);
+    if (publish_inflight > 0) {
+        publish_inflight--;
+    }
+    pthread_cond_signal(&publish_cond);
+    pthread_mutex_unlock(&publish_mutex);
+}
+
+/* Waits up to timeout_ms for libmosquitto to take one more message */
+static bool publish_wait_inflight(unsigned timeout_ms)
+{
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (timeout_ms % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+
+    pthread_mutex_lock(&publish_mutex);
+    while (publish_inflight >= publish_inflight_max) {
+        if (pthread_cond_timedwait(&publish_cond, &publish_mutex, &deadline) == ETIMEDOUT) {
+            break;
+        }
+    }
+    bool ready = (publish_inflight < publish_inflight_max);
+    pthread_mutex_unlock(&publish_mutex);
+
+    return ready;
+}
+
 static void my_subscribe_callback(struct mosquitto *m, void *userdata, int mid, int qos_count, const int *granted_qos)
 {
+    char logbuf[LOGBUF_LEN];
     int i;
 
     char tmpbuf[100];
@@ -1347,18 +1571,319 @@ static void my_subscribe_callback(struct mosquitto *m, void *userdata, int mid,
     logprint(logbuf);
 }
 
+static void publish_batch(const void *payload, size_t len)
+{
+    char logbuf[LOGBUF_LEN];
+    snprintf(logbuf, sizeof(logbuf), "[mqtt] Publishing %zu bytes batch to the topic %s\n", len, MQTT_BATCH_TOPIC);
+    logprint(logbuf);
+
+    mqtt_props_t props = { .format = format_of(TOPIC_DATA) };
+    publish_mqtt_raw(mosq, MQTT_BATCH_TOPIC, payload, len, &props);
+}
+
+static void log_publish_stats(const pubq_stats_t *stats)
+{
+    char logbuf[LOGBUF_LEN];
+
+    double avg_ms = stats->latency_count ? stats->latency_sum_ns / 1e6 / stats->latency_count : 0;
+    snprintf(logbuf, sizeof(logbuf), "[mqtt] Publish queue: %lu published, %lu dropped, depth %u (max %u), "
+             "latency %.3f ms avg, %.3f ms max\n", stats->published, stats->dropped, stats->depth,
+             stats->max_depth, avg_ms, stats->latency_max_ns / 1e6);
+    logprint(logbuf);
+}
+
+/* Hands queued messages over to libmosquitto, whose thread does the network
+ * part. Runs until the queue is closed. */
+static void publish_loop(void)
+{
+    time_t last_stats = time(NULL);
+    unsigned long last_pushed = 0;
+    unsigned long last_dropped = 0;
+
+    while (!pubq_closed(mqtt_pubq)) {
+        /* Wakes up in time to flush the batch */
+        unsigned timeout = 1000;
+        if (batch_interval) {
+            unsigned due = batch_poll(&uplink_batch);
+            if (due < timeout) {
+                timeout = due;
+            }
+        }
+
+        /* Broker is slow to ack, messages stay in the publish queue */
+        pubq_msg_t *msg = NULL;
+        if (publish_wait_inflight(timeout)) {
+            msg = pubq_peek(mqtt_pubq, timeout);
+        }
+
+        if (msg) {
+            /* Properties may be unaligned in the queue */
+            mqtt_props_t props;
+            bool has_props = (msg->meta_len == sizeof(props));
+            if (has_props) {
+                memcpy(&props, pubq_msg_meta(msg), sizeof(props));
+            }
+
+            /* Counted beforehand, the ack may come before mqtt_send() returns */
+            pthread_mutex_lock(&publish_mutex);
+            publish_inflight++;
+            pthread_mutex_unlock(&publish_mutex);
+
+            int mid;
+            int res = mqtt_send(mosq, &mid, msg->topic, pubq_msg_payload(msg), msg->len, has_props ? &props : NULL);
+            if (!mid) {
+                pthread_mutex_lock(&publish_mutex);
+                publish_inflight--;
+                pthread_mutex_unlock(&publish_mutex);
+            }
+
+            /* Connection is lost and libmosquitto hasn't noticed it yet,
+             * the message stays first in the queue */
+            if (res == MOSQ_ERR_NO_CONN) {
+                usleep(PUBLISH_RETRY_INTERVAL * 1000);
+                continue;
+            }
+            pubq_consume(mqtt_pubq, msg);
+        }
+
+        time_t now = time(NULL);
+        if (now - last_stats >= PUBLISH_STATS_INTERVAL) {
+            last_stats = now;
+
+            pubq_stats_t stats;
+            pubq_stats(mqtt_pubq, &stats);
+
+            /* Idle queue is not worth a log line */
+            if (stats.pushed != last_pushed || stats.dropped != last_dropped) {
+                last_pushed = stats.pushed;
+                last_dropped = stats.dropped;
+                log_publish_stats(&stats);
+            }
+        }
+    }
+}
+
+static uint64_t replay_time_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* Returns number of gates frames were captured from, -1 on error */
+static int replay_count_gates(void)
+{
+    char logbuf[LOGBUF_LEN];
+    capture_reader_t r;
+    if (!capture_reader_open(&r, replay_name)) {
+        return -1;
+    }
+
+    capture_record_t *rec = (capture_record_t *)malloc(sizeof(capture_record_t));
+    if (!rec) {
+        capture_reader_close(&r);
+        return -1;
+    }
+
+    int res;
+    int count = 0;
+    while ((res = capture_read(&r, rec)) > 0) {
+        if (rec->dir == CAPTURE_RX && rec->gate >= count) {
+            count = rec->gate + 1;
+        }
+    }
+
+    free(rec);
+    capture_reader_close(&r);
+
+    if (res < 0) {
+        snprintf(logbuf, sizeof(logbuf), "[error] Capture file %s is damaged\n", replay_name);
+        logprint(logbuf);
+        return -1;
+    }
+
+    return count;
+}
+
+/* Feeds frames received from the gates back through serve_reply() */
+static void *replay(void *arg)
+{
+    char logbuf[LOGBUF_LEN];
+    (void) arg;
+
+    capture_reader_t r;
+    capture_record_t *rec = (capture_record_t *)malloc(sizeof(capture_record_t));
+    if (!rec || !capture_reader_open(&r, replay_name)) {
+        free(rec);
+        exit(EXIT_FAILURE);
+    }
+
+    unsigned frames = 0;
+    unsigned skipped = 0;
+    uint64_t start = replay_time_us();
+    uint64_t base_wall = 0;
+    uint64_t base_rec = 0;
+    bool rebase = true;
+
+    int res;
+    while ((res = capture_read(&r, rec)) > 0) {
+        /* Pauses between captures are not replayed */
+        if (rec->sync) {
+            rebase = true;
+        }
+
+        if (rec->dir != CAPTURE_RX) {
+            continue;
+        }
+
+        if (rec->gate >= num_gates || rec->len + 1 > FRAMEQ_FRAME_SIZE) {
+            skipped++;
+            continue;
+        }
+
+        if (rebase) {
+            base_wall = replay_time_us();
+            base_rec = rec->time_us;
+            rebase = false;
+        }
+
+        if (replay_speed > 0) {
+            uint64_t due = base_wall + (uint64_t)((rec->time_us - base_rec) / replay_speed);
+            uint64_t now = replay_time_us();
+            if (due > now) {
+                usleep(due - now);
+            }
+        }
+
+        /* Replayed frames are dated as if they were received now */
+        struct timeval rx_time;
+        gettimeofday(&rx_time, NULL);
+        dispatch_frame(rec->gate, &rx_time, rec->data, rec->len);
+        frames++;
+    }
+
+    workers_wait_idle();
+
+    double elapsed = (replay_time_us() - start) / 1e6;
+    snprintf(logbuf, sizeof(logbuf), "[replay] %u frames replayed in %.3f s, %.0f frames/s%s",
+             frames, elapsed, elapsed > 0 ? frames / elapsed : 0, res < 0 ? ", capture file is damaged" : "");
+    logprint(logbuf);
+
+    if (skipped) {
+        snprintf(logbuf, sizeof(logbuf), "[replay] %u frames from unknown gates or oversized skipped", skipped);
+        logprint(logbuf);
+    }
+
+    free(rec);
+    capture_reader_close(&r);
+
+    if (batch_interval) {
+        batch_flush(&uplink_batch);
+    }
+
+    /* Messages queued so far still go out before the disconnect */
+    if (mqtt_pubq) {
+        pubq_wait_empty(mqtt_pubq);
+
+        pubq_stats_t stats;
+        pubq_stats(mqtt_pubq, &stats);
+        log_publish_stats(&stats);
+
+        pubq_close(mqtt_pubq);
+    }
+
+    return NULL;
+}
+
+static gate_t *add_gate(const char *port)
+{
+    char logbuf[LOGBUF_LEN];
+    if (num_gates >= MAX_GATES) {
+        snprintf(logbuf, sizeof(logbuf), "[error] Too many gates, %s ignored\n", port);
+        logprint(logbuf);
+        return NULL;
+    }
+
+    gate_t *gate = calloc(1, sizeof(gate_t));
+    if (!gate || !cmdq_init(&gate->tx_queue)) {
+        snprintf(logbuf, sizeof(logbuf), "[error] Unable to allocate memory\n");
+        logprint(logbuf);
+        free(gate);
+        return NULL;
+    }
+
+    if (!transport_init(&gate->uart, port)) {
+        free(gate);
+        return NULL;
+    }
+
+    gate->num = num_gates;
+    pthread_mutex_init(&gate->mutex_pending, NULL);
+    init_pending(gate);
+
+    /* Request a devices list on a first launch */
+    gate->devlist_needed = true;
+
+    gates[num_gates++] = gate;
+    return gate;
+}
+
+static int start_gate(gate_t *gate)
+{
+    char logbuf[LOGBUF_LEN];
+    printf("Using %s port device: %s\n", gate->uart.ops->name, gate->uart.uri);
+
+    if (transport_open(&gate->uart) < 0) {
+        return -1;
+    }
+
+    if(pthread_create(&gate->writer_thread, NULL, uart_writer, gate)) {
+        snprintf(logbuf, sizeof(logbuf), "Error creating writer thread\n");
+        logprint(logbuf);
+        return -1;
+    }
+
+    /* Named threads are easier to tell apart in top and benchmarks */
+    char name[16];
+    snprintf(name, sizeof(name), "gate%d-tx", gate->num);
+    pthread_setname_np(gate->writer_thread, name);
+
+    /* Replayed frames come from the capture */
+    if (replay_name) {
+        return 0;
+    }
+
+    if(pthread_create(&gate->reader_thread, NULL, uart_reader, gate)) {
+        snprintf(logbuf, sizeof(logbuf), "Error creating reader thread\n");
+        logprint(logbuf);
+        return -1;
+    }
+
+    snprintf(name, sizeof(name), "gate%d-rx", gate->num);
+    pthread_setname_np(gate->reader_thread, name);
+
+    return 0;
+}
+
 void usage(void) {
     printf("Usage: mqtt <serial>\nExample: mqtt [-ihdp] -p /dev/ttyS0\n");
     printf("  -i\tIgnore /etc/lora-mqtt/mqtt.conf.\n");
     printf("  -h\tPrint this help.\n");
     printf("  -d\tFork to background.\n");
 //    printf("  -r\tRetain last MQTT message.\n");
-    printf("  -p <port>\tserial port device URI, e.g. /dev/ttyATH0.\n");
+    printf("  -p <port>\tgate port URI: /dev/ttyATH0, /dev/ttyUSB0@57600, tcp://host:port or unix:/path.\n");
+    printf("\t\tMay be repeated to serve up to %d gates.\n", MAX_GATES);
     printf("  -t\tUse MQTT format compatible with Tibbo system.\n");
+    printf("  -c <file>\tAppend raw gate traffic to the capture file.\n");
+    printf("  -R <file>\tReplay frames from the capture file instead of reading the gates.\n");
+    printf("  -s <speed>\tReplay speed: 1 for real time (default), N for N times faster, 0 for as fast as possible.\n");
+    printf("  -n\tReplay without MQTT broker, messages are dropped.\n");
+    printf("  -w <num>\tNumber of decoding threads (default 1), uplinks of one device stay in order.\n");
 }
 
 int main(int argc, char *argv[])
 {
+    char logbuf[LOGBUF_LEN];
     const char *host = "localhost";
     int port = 1883;
     int keepalive = 60;
@@ -1372,16 +1897,20 @@ int main(int argc, char *argv[])
     logprint(logbuf);
     
     mqtt_format = UNWDS_MQTT_REGULAR;
+    memset(topic_format, -1, sizeof(topic_format));
     tx_delay = 10;
     tx_maxretr = 3;
+    uart_flush = UART_FLUSH_POLL;
+    uart_flush_interval = UART_POLLING_INTERVAL;
     
     bool daemonize = 0;
 //    bool retain = 0;
-    char serialport[100];
     bool ignoreconfig = 0;
+    char *capture_name = NULL;
     
     int c;
-    while ((c = getopt (argc, argv, "ihdrpt:")) != -1)
+    bool workers_from_cmdline = false;
+    while ((c = getopt (argc, argv, "ihdrtp:c:R:s:nw:")) != -1)
     switch (c) {
         case 'd':
             daemonize = 1;
@@ -1395,17 +1924,28 @@ int main(int argc, char *argv[])
             break;
         case 't':
             mqtt_format = UNWDS_MQTT_ESCAPED;
+            break;
 //        case 'r':
 //            retain = 1;
 //            break;
         case 'p':
-            if (strlen(optarg) > 100) {
-                snprintf(logbuf, sizeof(logbuf), "Error: serial device URI is too long\n");
-                logprint(logbuf);
-            }
-            else {
-                strncpy(serialport, optarg, 100);
-            }
+            add_gate(optarg);
+            break;
+        case 'c':
+            capture_name = optarg;
+            break;
+        case 'R':
+            replay_name = optarg;
+            break;
+        case 's':
+            replay_speed = atof(optarg);
+            break;
+        case 'n':
+            replay_sink = true;
+            break;
+        case 'w':
+            num_workers = atoi(optarg);
+            workers_from_cmdline = true;
             break;
         default:
             usage();
@@ -1439,16 +1979,12 @@ int main(int argc, char *argv[])
     }
     
     
-    /* Create message queue */
-    msgqid = msgget(IPC_PRIVATE, IPC_CREAT);
-    if (msgqid < 0) {
-        puts("Failed to create message queue");
-        exit(EXIT_FAILURE);
-    }
-    
     FILE* config = NULL;
     char* token;
     
+    /* Ports given on the command line override the ones from config */
+    bool ports_from_cmdline = (num_gates > 0);
+    
     if (!ignoreconfig)
         {
             config = fopen( "/etc/lora-mqtt/mqtt.conf", "r" );
@@ -1468,25 +2004,44 @@ int main(int argc, char *argv[])
                     {
                         if (!strcmp(token, "port"))
                         {
-                            strcpy(serialport, strtok(NULL, "\t\n\r"));
-                            while( (*serialport == ' ') || (*serialport == '=') )
+                            char *serialport = strtok(NULL, "\t\n\r");
+                            while (serialport && ((*serialport == ' ') || (*serialport == '=')))
                             {
-                                memmove(serialport, serialport+1, strlen(serialport));
+                                serialport++;
+                            }
+                            if (serialport && !ports_from_cmdline) {
+                                add_gate(serialport);
                             }
                         }
                         if (!strcmp(token, "format"))
                         {
                             char *format;
                             format = strtok(NULL, "\t =\n\r");
-                            if (!strcmp(format, "mqtt-escaped")) {
-                                mqtt_format = UNWDS_MQTT_ESCAPED;
-                                puts("MQTT format: quotes escaped");
+                            mqtt_format_t f;
+                            if (mqtt_format_by_name(format, &f)) {
+                                mqtt_format = f;
+                                printf("MQTT format: %s\n", format);
                             } else {
-                                if (!strcmp(format, "mqtt")) {
-                                    mqtt_format = UNWDS_MQTT_REGULAR;
-                                    puts("MQTT format: regular");
+                                printf("[error] Unknown MQTT format: %s\n", format ? format : "");
+                            }
+                        }
+                        if (!strncmp(token, "format.", strlen("format."))) {
+                            char *format = strtok(NULL, "\t =\n\r");
+                            mqtt_format_t f;
+                            int i;
+                            for (i = 0; i < NUM_TOPIC_CLASSES; i++) {
+                                if (!strcmp(token + strlen("format."), topic_class_names[i])) {
+                                    break;
                                 }
                             }
+                            if (i == NUM_TOPIC_CLASSES) {
+                                printf("[error] Unknown topic class: %s\n", token);
+                            } else if (!mqtt_format_by_name(format, &f)) {
+                                printf("[error] Unknown MQTT format: %s\n", format ? format : "");
+                            } else {
+                                topic_format[i] = f;
+                                printf("MQTT format for %s topics: %s\n", topic_class_names[i], format);
+                            }
                         }
                         if (!strcmp(token, "mqtt_qos")) {
                             char *qos;
@@ -1528,6 +2083,119 @@ int main(int argc, char *argv[])
                             sscanf(td, "%d", &tx_maxretr);
                             printf("LoRa TX maximum retries: %d\n", tx_maxretr);
                         }
+                        if (!strcmp(token, "uart_flush")) {
+                            char *flush;
+                            flush = strtok(NULL, "\t =\n\r");
+                            if (!strcmp(flush, "push")) {
+                                uart_flush = UART_FLUSH_PUSH;
+                                puts("UART flush mode: gate pushes data");
+                            } else if (!strcmp(flush, "pending")) {
+                                uart_flush = UART_FLUSH_PENDING;
+                                puts("UART flush mode: flush when data is pending");
+                            } else {
+                                uart_flush = UART_FLUSH_POLL;
+                                puts("UART flush mode: periodic polling");
+                            }
+                        }
+                        if (!strcmp(token, "capture")) {
+                            char *name = strtok(NULL, "\t =\n\r");
+                            if (name && !capture_name) {
+                                capture_name = strdup(name);
+                                printf("Gate traffic capture: %s\n", capture_name);
+                            }
+                        }
+                        if (!strcmp(token, "workers")) {
+                            char *w = strtok(NULL, "\t =\n\r");
+                            if (w && !workers_from_cmdline) {
+                                sscanf(w, "%d", &num_workers);
+                                printf("Decoding workers: %d\n", num_workers);
+                            }
+                        }
+                        if (!strcmp(token, "mqtt_queue_size")) {
+                            char *qs;
+                            qs = strtok(NULL, "\t =\n\r");
+                            unsigned kb;
+                            if (qs && sscanf(qs, "%u", &kb) == 1 && kb > 0) {
+                                publish_queue_size = (size_t)kb * 1024;
+                                printf("MQTT publish queue: %u KB\n", kb);
+                            }
+                        }
+                        if (!strcmp(token, "mqtt_max_inflight")) {
+                            char *mi;
+                            mi = strtok(NULL, "\t =\n\r");
+                            unsigned n;
+                            if (mi && sscanf(mi, "%u", &n) == 1 && n > 0) {
+                                publish_inflight_max = n;
+                                printf("MQTT messages in flight: up to %u\n", n);
+                            }
+                        }
+                        if (!strcmp(token, "batch_interval")) {
+                            char *bi;
+                            bi = strtok(NULL, "\t =\n\r");
+                            if (bi) {
+                                sscanf(bi, "%u", &batch_interval);
+                                printf("Uplink batch interval: %u ms\n", batch_interval);
+                            }
+                        }
+                        if (!strcmp(token, "batch_items")) {
+                            char *bi;
+                            bi = strtok(NULL, "\t =\n\r");
+                            if (bi && sscanf(bi, "%u", &batch_items) == 1) {
+                                printf("Uplink batch items: %u\n", batch_items);
+                            }
+                        }
+                        if (!strcmp(token, "batch_size")) {
+                            char *bs;
+                            bs = strtok(NULL, "\t =\n\r");
+                            if (bs && sscanf(bs, "%zu", &batch_size) == 1) {
+                                printf("Uplink batch size: %zu bytes\n", batch_size);
+                            }
+                        }
+                        if (!strcmp(token, "batch_devices")) {
+                            char *bd;
+                            bd = strtok(NULL, "\t =\n\r");
+                            batch_devices = bd && !strcmp(bd, "true");
+                            printf("Uplinks on device topics with batching %s\n", batch_devices ? "enabled" : "disabled");
+                        }
+                        if (!strcmp(token, "mqtt_version")) {
+                            char *ver;
+                            ver = strtok(NULL, "\t =\n\r");
+                            if (ver && !strcmp(ver, "5")) {
+                                mqtt_version = MQTT_PROTOCOL_V5;
+                            } else if (ver && !strcmp(ver, "3.1")) {
+                                mqtt_version = MQTT_PROTOCOL_V31;
+                            } else {
+                                mqtt_version = MQTT_PROTOCOL_V311;
+                            }
+                            printf("MQTT protocol version: %s\n", mqtt_version == MQTT_PROTOCOL_V5 ? "5" :
+                                   mqtt_version == MQTT_PROTOCOL_V31 ? "3.1" : "3.1.1");
+                        }
+                        if (!strcmp(token, "mqtt_topic_aliases")) {
+                            char *ta;
+                            ta = strtok(NULL, "\t =\n\r");
+                            if (ta && sscanf(ta, "%u", &topic_aliases_max) == 1) {
+                                printf("MQTT v5 topic aliases: up to %u\n", topic_aliases_max);
+                            }
+                        }
+                        if (!strcmp(token, "mqtt_expiry")) {
+                            char *me;
+                            me = strtok(NULL, "\t =\n\r");
+                            if (me && sscanf(me, "%u", &mqtt_expiry) == 1) {
+                                printf("MQTT v5 uplink expiry: %u seconds\n", mqtt_expiry);
+                            }
+                        }
+                        if (!strcmp(token, "mqtt_user_props")) {
+                            char *up;
+                            up = strtok(NULL, "\t =\n\r");
+                            mqtt_user_props = up && !strcmp(up, "true");
+                            printf("MQTT v5 message properties %s\n", mqtt_user_props ? "enabled" : "disabled");
+                        }
+                        if (!strcmp(token, "uart_flush_interval")) {
+                            char *fi;
+                            fi = strtok(NULL, "\t =\n\r");
+                            sscanf(fi, "%d", &uart_flush_interval);
+                            printf("UART flush interval: %d ms\n", uart_flush_interval);
+                        }
                     }
                 }
                 free(line);
@@ -1541,45 +2209,106 @@ int main(int argc, char *argv[])
             }
         }
 
-    printf("Using serial port device: %s\n", serialport);
-    
-    pthread_mutex_init(&mutex_uart, NULL);
-    pthread_mutex_init(&mutex_pending, NULL);
+    int i;
 
-    /* Request a devices list on a first launch */
-    devlist_needed = true;
+    if (replay_name) {
+        /* Configured gates are not used, commands to the replayed ones go nowhere */
+        for (i = 0; i < num_gates; i++) {
+            free(gates[i]);
+        }
+        num_gates = 0;
 
-    init_pending();
-    
-    uart = open(serialport, O_RDWR | O_NOCTTY | O_SYNC);
-    if (uart < 0)
-    {
-        snprintf(logbuf, sizeof(logbuf), "error %d opening %s: %s\n", errno, serialport, strerror (errno));
+        int n = replay_count_gates();
+        if (n < 0) {
+            return 1;
+        }
+
+        if (n > MAX_GATES) {
+            snprintf(logbuf, sizeof(logbuf), "[warning] Capture has frames from %d gates, only %d are replayed", n, MAX_GATES);
+            logprint(logbuf);
+            n = MAX_GATES;
+        }
+
+        do {
+            add_gate("null:");
+        } while (num_gates < n);
+    }
+
+    if (num_workers < 1 || num_workers > MAX_WORKERS) {
+        snprintf(logbuf, sizeof(logbuf), "[error] Number of workers must be 1 to %d\n", MAX_WORKERS);
         logprint(logbuf);
-        usage();
         return 1;
     }
-    
-    set_interface_attribs(uart, B115200, 0);  // set speed to 115,200 bps, 8n1 (no parity)
-    set_blocking(uart, 0);                     // set no blocking
 
-    if(pthread_create(&reader_thread, NULL, uart_reader, NULL)) {
-        snprintf(logbuf, sizeof(logbuf), "Error creating reader thread\n");
+    if (num_gates == 0) {
+        snprintf(logbuf, sizeof(logbuf), "No serial port device specified\n");
         logprint(logbuf);
+        usage();
         return 1;
     }
 
-    if(pthread_create(&publisher_thread, NULL, publisher, NULL)) {
-        snprintf(logbuf, sizeof(logbuf), "Error creating publisher thread\n");
-        logprint(logbuf);
+    /* Nothing ever arrives from the null backend, the reader would spin on EOF */
+    if (!replay_name) {
+        for (i = 0; i < num_gates; i++) {
+            if (!strcmp(gates[i]->uart.uri, "null:")) {
+                snprintf(logbuf, sizeof(logbuf), "[error] Port null: is only usable when replaying a capture\n");
+                logprint(logbuf);
+                return 1;
+            }
+        }
+    }
+
+    /* Writes to a dropped socket must fail with EPIPE instead of killing us */
+    signal(SIGPIPE, SIG_IGN);
+
+    if (capture_name && !capture_open(&capture, capture_name)) {
+        return 1;
+    }
+
+    /* Messages wait in the queue while the broker is being connected */
+    if (!(replay_name && replay_sink)) {
+        if (!pubq_init(&publish_queue, publish_queue_size)) {
+            snprintf(logbuf, sizeof(logbuf), "[error] Unable to allocate memory\n");
+            logprint(logbuf);
+            return 1;
+        }
+        mqtt_pubq = &publish_queue;
+    }
+
+    if (batch_interval) {
+        if (batch_items < 1) {
+            batch_items = 1;
+        }
+        if (!batch_init(&uplink_batch, format_of(TOPIC_DATA), batch_interval, batch_items, batch_size, publish_batch)) {
+            snprintf(logbuf, sizeof(logbuf), "[error] Unable to set up uplink batches of %zu bytes\n", batch_size);
+            logprint(logbuf);
+            return 1;
+        }
+    }
+
+    /* Workers go first, readers hand frames over to them */
+    if (start_workers() < 0) {
         return 1;
     }
 
+    for (i = 0; i < num_gates; i++) {
+        if (start_gate(gates[i]) < 0) {
+            usage();
+            return 1;
+        }
+    }
+
     if (pthread_create(&pending_thread, NULL, pending_worker, NULL)) {
         snprintf(logbuf, sizeof(logbuf), "Error creating pending queue worker thread");
         logprint(logbuf);
         return 1;
     }
+    pthread_setname_np(pending_thread, "pending");
+
+    if (replay_name && replay_sink) {
+        replay(NULL);
+        return 0;
+    }
 
     mosquitto_lib_init();
     mosq = mosquitto_new(NULL, true, NULL);
@@ -1589,9 +2318,33 @@ int main(int argc, char *argv[])
         return 1;
     }
     
+    if (mqtt_version == MQTT_PROTOCOL_V5) {
+        mosquitto_int_option(mosq, MOSQ_OPT_PROTOCOL_VERSION, MQTT_PROTOCOL_V5);
+        mosquitto_connect_v5_callback_set(mosq, my_connect_v5_callback);
+
+        /* libmosquitto resends QoS 1 and 2 messages after a reconnect, when
+         * the broker has forgotten the aliases, so they always carry the topic */
+        if (topic_aliases_max && mqtt_qos > 0) {
+            snprintf(logbuf, sizeof(logbuf), "[mqtt] Topic aliases are only used with QoS 0\n");
+            logprint(logbuf);
+        } else if (topic_aliases_max) {
+            if (!topic_alias_init(&topic_aliases, topic_aliases_max)) {
+                snprintf(logbuf, sizeof(logbuf), "[error] Unable to allocate %u topic aliases\n", topic_aliases_max);
+                logprint(logbuf);
+                return 1;
+            }
+            mqtt_aliases = &topic_aliases;
+        }
+    }
+
     mosquitto_connect_callback_set(mosq, my_connect_callback);
+    mosquitto_disconnect_callback_set(mosq, my_disconnect_callback);
     mosquitto_message_callback_set(mosq, my_message_callback);
     mosquitto_subscribe_callback_set(mosq, my_subscribe_callback);
+    mosquitto_publish_callback_set(mosq, my_publish_callback);
+
+    /* libmosquitto keeps the same limit, so it has no queue of its own */
+    mosquitto_int_option(mosq, MOSQ_OPT_SEND_MAXIMUM, publish_inflight_max);
 
     if(mosquitto_connect(mosq, host, port, keepalive)){
         snprintf(logbuf, sizeof(logbuf), "Unable to connect.\n");
@@ -1599,11 +2352,22 @@ int main(int argc, char *argv[])
         return 1;
     }
 
+    /* Network goes on in the libmosquitto thread and messages reach it
+     * through the queue, so a slow or reconnecting broker holds up
+     * neither the gates nor the downlink scheduling */
+    if (mosquitto_loop_start(mosq) != MOSQ_ERR_SUCCESS) {
+        snprintf(logbuf, sizeof(logbuf), "Unable to start MQTT thread.\n");
+        logprint(logbuf);
+        return 1;
+    }
+
     snprintf(logbuf, sizeof(logbuf), "[mqtt] Entering event loop");
     logprint(logbuf);
 
-    mosquitto_loop_forever(mosq, -1, 1);
+    publish_loop();
 
+    mosquitto_disconnect(mosq);
+    mosquitto_loop_stop(mosq, false);
     mosquitto_destroy(mosq);
     mosquitto_lib_cleanup();
     
@@ -0,0 +1,295 @@
+/* Copyright (c) 2017 Unwired Devices LLC [info@unwds.com]
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+
+/**
+ * @defgroup    
+ * @ingroup     
+ * @brief       
+ * @{
+ * @file        packbuf.c
+ * @brief       CBOR and MessagePack writer for fixed-size buffers
+ */
+
+#include <string.h>
+#include <math.h>
+
+#include "packbuf.h"
+
+/* CBOR major types */
+#define CBOR_UINT   0x00
+#define CBOR_NEGINT 0x20
+#define CBOR_BYTES  0x40
+#define CBOR_TEXT   0x60
+#define CBOR_ARRAY  0x80
+#define CBOR_MAP    0xa0
+#define CBOR_NULL   0xf6
+#define CBOR_FLOAT  0xfa
+#define CBOR_DOUBLE 0xfb
+
+#define MSGPACK_NIL     0xc0
+#define MSGPACK_BIN8    0xc4
+#define MSGPACK_FLOAT   0xca
+#define MSGPACK_DOUBLE  0xcb
+#define MSGPACK_UINT8   0xcc
+#define MSGPACK_INT8    0xd0
+#define MSGPACK_STR8    0xd9
+#define MSGPACK_ARRAY16 0xdc
+#define MSGPACK_MAP16   0xde
+
+void packbuf_init(packbuf_t *pb, packbuf_format_t format, void *buf, size_t size)
+{
+    pb->buf = (uint8_t *) buf;
+    pb->size = size;
+    pb->len = 0;
+    pb->overflow = false;
+    pb->format = format;
+}
+
+void packbuf_truncate(packbuf_t *pb, size_t len)
+{
+    if (len < pb->len) {
+        pb->len = len;
+    }
+    pb->overflow = false;
+}
+
+static uint8_t *reserve(packbuf_t *pb, size_t len)
+{
+    if (pb->overflow || pb->size - pb->len < len) {
+        pb->overflow = true;
+        return NULL;
+    }
+
+    uint8_t *ptr = pb->buf + pb->len;
+    pb->len += len;
+    return ptr;
+}
+
+static void put_be(uint8_t *ptr, uint64_t val, unsigned bytes)
+{
+    while (bytes--) {
+        ptr[bytes] = val & 0xff;
+        val >>= 8;
+    }
+}
+
+/* Type byte followed by bytes of big endian value */
+static void put_head(packbuf_t *pb, uint8_t type, uint64_t val, unsigned bytes)
+{
+    uint8_t *ptr = reserve(pb, 1 + bytes);
+    if (ptr) {
+        ptr[0] = type;
+        put_be(ptr + 1, val, bytes);
+    }
+}
+
+/* CBOR head with the argument in the shortest form */
+static void cbor_head(packbuf_t *pb, uint8_t major, uint64_t val)
+{
+    if (val < 24) {
+        put_head(pb, major | val, 0, 0);
+    } else if (val <= UINT8_MAX) {
+        put_head(pb, major | 24, val, 1);
+    } else if (val <= UINT16_MAX) {
+        put_head(pb, major | 25, val, 2);
+    } else if (val <= UINT32_MAX) {
+        put_head(pb, major | 26, val, 4);
+    } else {
+        put_head(pb, major | 27, val, 8);
+    }
+}
+
+/* MessagePack str8/16/32, bin8/16/32, map16/32 and uint8..64 are laid out
+ * alike: first type of the family is for 1 byte length, next ones for 2 and 4 */
+static void msgpack_head(packbuf_t *pb, uint8_t type8, uint64_t val)
+{
+    if (val <= UINT8_MAX) {
+        put_head(pb, type8, val, 1);
+    } else if (val <= UINT16_MAX) {
+        put_head(pb, type8 + 1, val, 2);
+    } else if (val <= UINT32_MAX) {
+        put_head(pb, type8 + 2, val, 4);
+    } else {
+        put_head(pb, type8 + 3, val, 8);
+    }
+}
+
+void packbuf_map(packbuf_t *pb, uint32_t num)
+{
+    if (pb->format == PACKBUF_CBOR) {
+        cbor_head(pb, CBOR_MAP, num);
+    } else if (num < 16) {
+        put_head(pb, 0x80 | num, 0, 0);
+    } else if (num <= UINT16_MAX) {
+        put_head(pb, MSGPACK_MAP16, num, 2);
+    } else {
+        put_head(pb, MSGPACK_MAP16 + 1, num, 4);
+    }
+}
+
+void packbuf_array(packbuf_t *pb, uint32_t num)
+{
+    if (pb->format == PACKBUF_CBOR) {
+        cbor_head(pb, CBOR_ARRAY, num);
+    } else if (num < 16) {
+        put_head(pb, 0x90 | num, 0, 0);
+    } else if (num <= UINT16_MAX) {
+        put_head(pb, MSGPACK_ARRAY16, num, 2);
+    } else {
+        put_head(pb, MSGPACK_ARRAY16 + 1, num, 4);
+    }
+}
+
+size_t packbuf_map_begin(packbuf_t *pb)
+{
+    size_t mark = pb->len;
+
+    /* Two byte size is valid in both formats for any number of pairs */
+    if (pb->format == PACKBUF_CBOR) {
+        put_head(pb, CBOR_MAP | 25, 0, 2);
+    } else {
+        put_head(pb, MSGPACK_MAP16, 0, 2);
+    }
+
+    return mark;
+}
+
+void packbuf_map_end(packbuf_t *pb, size_t mark, uint16_t num)
+{
+    if (mark + 3 <= pb->len) {
+        put_be(pb->buf + mark + 1, num, 2);
+    }
+}
+
+void packbuf_nil(packbuf_t *pb)
+{
+    put_head(pb, pb->format == PACKBUF_CBOR ? CBOR_NULL : MSGPACK_NIL, 0, 0);
+}
+
+void packbuf_uint(packbuf_t *pb, uint64_t val)
+{
+    if (pb->format == PACKBUF_CBOR) {
+        cbor_head(pb, CBOR_UINT, val);
+    } else if (val < 128) {
+        put_head(pb, val, 0, 0);
+    } else {
+        msgpack_head(pb, MSGPACK_UINT8, val);
+    }
+}
+
+void packbuf_int(packbuf_t *pb, int64_t val)
+{
+    if (val >= 0) {
+        packbuf_uint(pb, val);
+        return;
+    }
+
+    if (pb->format == PACKBUF_CBOR) {
+        cbor_head(pb, CBOR_NEGINT, -1 - val);
+    } else if (val >= -32) {
+        put_head(pb, (uint8_t) val, 0, 0);
+    } else if (val >= INT8_MIN) {
+        put_head(pb, MSGPACK_INT8, val, 1);
+    } else if (val >= INT16_MIN) {
+        put_head(pb, MSGPACK_INT8 + 1, val, 2);
+    } else if (val >= INT32_MIN) {
+        put_head(pb, MSGPACK_INT8 + 2, val, 4);
+    } else {
+        put_head(pb, MSGPACK_INT8 + 3, val, 8);
+    }
+}
+
+static const double pow10_table[] = {
+    1, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9,
+};
+
+/* Whether the float rounds to the same precision digits as the double */
+static bool fits_float(double val, uint8_t precision)
+{
+    if (!(fabs(val) <= 1e7) || precision > 9) {
+        return false;
+    }
+
+    double scale = pow10_table[precision];
+    return llround(val * scale) == llround((double)(float) val * scale);
+}
+
+void packbuf_float(packbuf_t *pb, double val, uint8_t precision)
+{
+    union {
+        float f;
+        uint32_t u;
+    } f32;
+    union {
+        double f;
+        uint64_t u;
+    } f64;
+    bool cbor = (pb->format == PACKBUF_CBOR);
+
+    if (fits_float(val, precision)) {
+        f32.f = val;
+        put_head(pb, cbor ? CBOR_FLOAT : MSGPACK_FLOAT, f32.u, 4);
+    } else {
+        f64.f = val;
+        put_head(pb, cbor ? CBOR_DOUBLE : MSGPACK_DOUBLE, f64.u, 8);
+    }
+}
+
+static void put_data(packbuf_t *pb, const void *data, size_t len)
+{
+    uint8_t *ptr = reserve(pb, len);
+    if (ptr) {
+        memcpy(ptr, data, len);
+    }
+}
+
+void packbuf_text(packbuf_t *pb, const char *str, size_t len)
+{
+    if (pb->format == PACKBUF_CBOR) {
+        cbor_head(pb, CBOR_TEXT, len);
+    } else if (len < 32) {
+        put_head(pb, 0xa0 | len, 0, 0);
+    } else {
+        msgpack_head(pb, MSGPACK_STR8, len);
+    }
+    put_data(pb, str, len);
+}
+
+void packbuf_string(packbuf_t *pb, const char *str)
+{
+    packbuf_text(pb, str, strlen(str));
+}
+
+void packbuf_bytes(packbuf_t *pb, const void *data, size_t len)
+{
+    if (pb->format == PACKBUF_CBOR) {
+        cbor_head(pb, CBOR_BYTES, len);
+    } else {
+        msgpack_head(pb, MSGPACK_BIN8, len);
+    }
+    put_data(pb, data, len);
+}
+
+void packbuf_raw(packbuf_t *pb, const void *data, size_t len)
+{
+    put_data(pb, data, len);
+}
@@ -0,0 +1,259 @@
+/* Copyright (c) 2017 Unwired Devices LLC [info@unwds.com]
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+
+/**
+ * @defgroup    
+ * @ingroup     
+ * @brief       
+ * @{
+ * @file        pubq.c
+ * @brief       Bounded queue of outgoing MQTT messages
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/types.h>
+
+#include "pubq.h"
+
+#define PUBQ_ALIGN 8
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+bool pubq_init(pubq_t *q, size_t size)
+{
+    size &= ~(size_t)(PUBQ_ALIGN - 1);
+
+    q->buf = (uint8_t *)malloc(size);
+    if (!q->buf) {
+        return false;
+    }
+
+    q->size = size;
+    q->head = 0;
+    q->tail = 0;
+    q->used = 0;
+    q->paused = true;
+    q->closed = false;
+    memset(&q->stats, 0, sizeof(q->stats));
+
+    if (pthread_mutex_init(&q->mutex, NULL)) {
+        return false;
+    }
+
+    if (pthread_cond_init(&q->data_cond, NULL)) {
+        return false;
+    }
+
+    if (pthread_cond_init(&q->empty_cond, NULL)) {
+        return false;
+    }
+
+    return true;
+}
+
+/* Returns offset to write need bytes at, or -1 if there's no room */
+static ssize_t reserve(pubq_t *q, size_t need)
+{
+    if (q->head > q->tail || q->used == 0) {
+        size_t end = q->size - q->head;
+        if (need <= end) {
+            return q->head;
+        }
+        if (need > q->tail) {
+            return -1;
+        }
+
+        /* Gap at the end is marked and skipped */
+        if (end) {
+            ((pubq_msg_t *)(q->buf + q->head))->size = 0;
+        }
+        q->used += end;
+        q->head = 0;
+        return 0;
+    }
+
+    if (need > q->tail - q->head) {
+        return -1;
+    }
+    return q->head;
+}
+
+bool pubq_push(pubq_t *q, const char *topic, const void *payload, size_t len, const void *meta, size_t meta_len)
+{
+    size_t topic_len = strlen(topic) + 1;
+    size_t need = sizeof(pubq_msg_t) + topic_len + len + meta_len;
+    need = (need + PUBQ_ALIGN - 1) & ~(size_t)(PUBQ_ALIGN - 1);
+
+    pthread_mutex_lock(&q->mutex);
+
+    ssize_t pos = (need <= q->size) ? reserve(q, need) : -1;
+    if (pos < 0) {
+        q->stats.dropped++;
+        pthread_mutex_unlock(&q->mutex);
+        return false;
+    }
+
+    pubq_msg_t *msg = (pubq_msg_t *)(q->buf + pos);
+    msg->size = need;
+    msg->len = len;
+    msg->queued_ns = now_ns();
+    msg->meta_len = meta_len;
+    memcpy(msg->topic, topic, topic_len);
+    memcpy(msg->topic + topic_len, payload, len);
+    if (meta_len) {
+        memcpy(msg->topic + topic_len + len, meta, meta_len);
+    }
+
+    q->head = pos + need;
+    q->used += need;
+
+    q->stats.pushed++;
+    q->stats.depth++;
+    if (q->stats.depth > q->stats.max_depth) {
+        q->stats.max_depth = q->stats.depth;
+    }
+
+    pthread_cond_signal(&q->data_cond);
+    pthread_mutex_unlock(&q->mutex);
+
+    return true;
+}
+
+pubq_msg_t *pubq_peek(pubq_t *q, int timeout_ms)
+{
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (timeout_ms % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+
+    pthread_mutex_lock(&q->mutex);
+
+    while (!q->closed && (q->paused || q->stats.depth == 0)) {
+        if (pthread_cond_timedwait(&q->data_cond, &q->mutex, &deadline) == ETIMEDOUT) {
+            pthread_mutex_unlock(&q->mutex);
+            return NULL;
+        }
+    }
+
+    if (q->closed) {
+        pthread_mutex_unlock(&q->mutex);
+        return NULL;
+    }
+
+    /* Skip the gap left by a wrap */
+    if (q->tail == q->size || ((pubq_msg_t *)(q->buf + q->tail))->size == 0) {
+        q->used -= q->size - q->tail;
+        q->tail = 0;
+    }
+
+    /* Message doesn't move until consumed, so it's used without the lock */
+    pubq_msg_t *msg = (pubq_msg_t *)(q->buf + q->tail);
+
+    pthread_mutex_unlock(&q->mutex);
+
+    return msg;
+}
+
+void pubq_consume(pubq_t *q, pubq_msg_t *msg)
+{
+    uint64_t latency = now_ns() - msg->queued_ns;
+
+    pthread_mutex_lock(&q->mutex);
+
+    q->tail += msg->size;
+    q->used -= msg->size;
+    if (q->used == 0) {
+        q->head = 0;
+        q->tail = 0;
+    }
+
+    q->stats.published++;
+    q->stats.depth--;
+    q->stats.latency_count++;
+    q->stats.latency_sum_ns += latency;
+    if (latency > q->stats.latency_max_ns) {
+        q->stats.latency_max_ns = latency;
+    }
+
+    if (q->stats.depth == 0) {
+        pthread_cond_broadcast(&q->empty_cond);
+    }
+    pthread_mutex_unlock(&q->mutex);
+}
+
+void pubq_pause(pubq_t *q, bool paused)
+{
+    pthread_mutex_lock(&q->mutex);
+    q->paused = paused;
+    pthread_cond_signal(&q->data_cond);
+    pthread_mutex_unlock(&q->mutex);
+}
+
+void pubq_close(pubq_t *q)
+{
+    pthread_mutex_lock(&q->mutex);
+    q->closed = true;
+    pthread_cond_signal(&q->data_cond);
+    pthread_cond_broadcast(&q->empty_cond);
+    pthread_mutex_unlock(&q->mutex);
+}
+
+bool pubq_closed(pubq_t *q)
+{
+    pthread_mutex_lock(&q->mutex);
+    bool closed = q->closed;
+    pthread_mutex_unlock(&q->mutex);
+
+    return closed;
+}
+
+void pubq_wait_empty(pubq_t *q)
+{
+    pthread_mutex_lock(&q->mutex);
+    while (q->stats.depth && !q->closed) {
+        pthread_cond_wait(&q->empty_cond, &q->mutex);
+    }
+    pthread_mutex_unlock(&q->mutex);
+}
+
+void pubq_stats(pubq_t *q, pubq_stats_t *stats)
+{
+    pthread_mutex_lock(&q->mutex);
+    *stats = q->stats;
+    q->stats.max_depth = q->stats.depth;
+    q->stats.latency_count = 0;
+    q->stats.latency_sum_ns = 0;
+    q->stats.latency_max_ns = 0;
+    pthread_mutex_unlock(&q->mutex);
+}
@@ -0,0 +1,227 @@
+/* Copyright (c) 2017 Unwired Devices LLC [info@unwds.com]
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+/**
+ * @defgroup    
+ * @ingroup     
+ * @brief       
+ * @{
+ * @file        ringbuf.c
+ * @brief       Byte ring buffer with line framing for the gate link
+ */
+
+#include <string.h>
+#include <unistd.h>
+
+#include "ringbuf.h"
+
+#define RINGBUF_MASK (RINGBUF_SIZE - 1)
+
+void ringbuf_init(ringbuf_t *rb)
+{
+    rb->head = 0;
+    rb->tail = 0;
+    rb->scan = 0;
+    rb->discard = false;
+}
+
+unsigned ringbuf_used(const ringbuf_t *rb)
+{
+    return rb->head - rb->tail;
+}
+
+unsigned ringbuf_free(const ringbuf_t *rb)
+{
+    return RINGBUF_SIZE - ringbuf_used(rb);
+}
+
+ssize_t ringbuf_read(ringbuf_t *rb, int fd)
+{
+    unsigned space = ringbuf_free(rb);
+    unsigned start = rb->head & RINGBUF_MASK;
+    unsigned first = RINGBUF_SIZE - start;
+    struct iovec iov[2];
+    int iovcnt = 1;
+
+    if (space == 0) {
+        return 0;
+    }
+
+    /* Free space may wrap around the end of the buffer */
+    if (first >= space) {
+        iov[0].iov_base = rb->buf + start;
+        iov[0].iov_len = space;
+    } else {
+        iov[0].iov_base = rb->buf + start;
+        iov[0].iov_len = first;
+        iov[1].iov_base = rb->buf;
+        iov[1].iov_len = space - first;
+        iovcnt = 2;
+    }
+
+    ssize_t r = readv(fd, iov, iovcnt);
+    if (r > 0) {
+        rb->head += r;
+    }
+
+    return r;
+}
+
+unsigned ringbuf_write(ringbuf_t *rb, const void *data, unsigned len)
+{
+    unsigned space = ringbuf_free(rb);
+    unsigned start = rb->head & RINGBUF_MASK;
+    unsigned first = RINGBUF_SIZE - start;
+
+    if (len > space) {
+        len = space;
+    }
+
+    if (first >= len) {
+        memcpy(rb->buf + start, data, len);
+    } else {
+        memcpy(rb->buf + start, data, first);
+        memcpy(rb->buf, (const uint8_t *)data + first, len - first);
+    }
+
+    rb->head += len;
+    return len;
+}
+
+int ringbuf_peek(const ringbuf_t *rb, struct iovec *iov)
+{
+    unsigned used = ringbuf_used(rb);
+    unsigned start = rb->tail & RINGBUF_MASK;
+    unsigned first = RINGBUF_SIZE - start;
+
+    if (used == 0) {
+        return 0;
+    }
+
+    iov[0].iov_base = (void *)(rb->buf + start);
+
+    if (first >= used) {
+        iov[0].iov_len = used;
+        return 1;
+    }
+
+    iov[0].iov_len = first;
+    iov[1].iov_base = (void *)rb->buf;
+    iov[1].iov_len = used - first;
+    return 2;
+}
+
+void ringbuf_consume(ringbuf_t *rb, unsigned len)
+{
+    if (len > ringbuf_used(rb)) {
+        len = ringbuf_used(rb);
+    }
+
+    rb->tail += len;
+
+    /* Don't scan what is already gone */
+    if ((int)(rb->scan - rb->tail) < 0) {
+        rb->scan = rb->tail;
+    }
+}
+
+/* Looks for delim in [scan, head), returns its free-running index or head if not found */
+static unsigned ringbuf_find(const ringbuf_t *rb, char delim)
+{
+    unsigned pos = rb->scan;
+
+    while (pos != rb->head) {
+        unsigned start = pos & RINGBUF_MASK;
+        unsigned len = rb->head - pos;
+        if (len > RINGBUF_SIZE - start) {
+            len = RINGBUF_SIZE - start;
+        }
+
+        const uint8_t *p = memchr(rb->buf + start, delim, len);
+        if (p) {
+            return pos + (p - (rb->buf + start));
+        }
+
+        pos += len;
+    }
+
+    return pos;
+}
+
+char *ringbuf_next_frame(ringbuf_t *rb, char delim, unsigned *len, bool *dropped)
+{
+    while (1) {
+        unsigned end = ringbuf_find(rb, delim);
+
+        if (end == rb->head) {
+            rb->scan = end;
+
+            if (ringbuf_free(rb) == 0) {
+                /* Buffer is full of one frame, no way to get it completely */
+                rb->tail = rb->head;
+                rb->scan = rb->head;
+                rb->discard = true;
+                if (dropped) {
+                    *dropped = true;
+                }
+            }
+
+            return NULL;
+        }
+
+        unsigned start = rb->tail;
+        unsigned flen = end - start;
+
+        rb->tail = end + 1;
+        rb->scan = rb->tail;
+
+        if (rb->discard) {
+            /* Tail of an oversized frame */
+            rb->discard = false;
+            continue;
+        }
+
+        char *frame;
+        unsigned offset = start & RINGBUF_MASK;
+
+        if (offset + flen < RINGBUF_SIZE) {
+            /* Contiguous, terminate in place of the delimiter */
+            frame = (char *)rb->buf + offset;
+            frame[flen] = '\0';
+        } else {
+            unsigned first = RINGBUF_SIZE - offset;
+            memcpy(rb->frame, rb->buf + offset, first);
+            memcpy(rb->frame + first, rb->buf, flen - first);
+            rb->frame[flen] = '\0';
+            frame = rb->frame;
+        }
+
+        while (flen > 0 && frame[flen - 1] == '\r') {
+            frame[--flen] = '\0';
+        }
+
+        if (len) {
+            *len = flen;
+        }
+
+        return frame;
+    }
+}
@@ -0,0 +1,161 @@
+/* Copyright (c) 2017 Unwired Devices LLC [info@unwds.com]
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+
+/**
+ * @defgroup    
+ * @ingroup     
+ * @brief       
+ * @{
+ * @file        textbuf.c
+ * @brief       Cursor-based string builder for fixed-size buffers
+ */
+
+#include <string.h>
+
+#include "textbuf.h"
+
+static const char hex_chars[] = "0123456789abcdef";
+
+void textbuf_init(textbuf_t *tb, char *buf, size_t size)
+{
+    tb->buf = buf;
+    tb->size = size;
+    tb->len = 0;
+    tb->overflow = false;
+
+    if (size) {
+        buf[0] = '\0';
+    }
+}
+
+void textbuf_truncate(textbuf_t *tb, size_t len)
+{
+    if (len < tb->len) {
+        tb->len = len;
+        tb->buf[len] = '\0';
+    }
+    tb->overflow = false;
+}
+
+bool textbuf_append_n(textbuf_t *tb, const char *str, size_t n)
+{
+    const char *end = memchr(str, '\0', n);
+    if (end) {
+        n = end - str;
+    }
+
+    if (tb->len + n >= tb->size) {
+        tb->overflow = true;
+        return false;
+    }
+
+    memcpy(tb->buf + tb->len, str, n);
+    tb->len += n;
+    tb->buf[tb->len] = '\0';
+
+    return true;
+}
+
+bool textbuf_append(textbuf_t *tb, const char *str)
+{
+    return textbuf_append_n(tb, str, strlen(str));
+}
+
+bool textbuf_append_char(textbuf_t *tb, char c)
+{
+    return textbuf_append_n(tb, &c, 1);
+}
+
+bool textbuf_append_hex(textbuf_t *tb, const uint8_t *bytes, size_t num_bytes)
+{
+    if (tb->len + 2 * num_bytes >= tb->size) {
+        tb->overflow = true;
+        return false;
+    }
+
+    char *ptr = tb->buf + tb->len;
+    size_t i;
+    for (i = 0; i < num_bytes; i++) {
+        *ptr++ = hex_chars[bytes[i] >> 4];
+        *ptr++ = hex_chars[bytes[i] & 0x0F];
+    }
+    *ptr = '\0';
+    tb->len += 2 * num_bytes;
+
+    return true;
+}
+
+/* Writes digits of val ending right before end, at least min_digits of them */
+static char *format_uint(char *end, uint32_t val, unsigned min_digits)
+{
+    char *ptr = end;
+    do {
+        *--ptr = '0' + val % 10;
+        val /= 10;
+    } while (val || (unsigned)(end - ptr) < min_digits);
+
+    return ptr;
+}
+
+bool textbuf_append_uint(textbuf_t *tb, uint32_t val)
+{
+    char tmp[10];
+    char *start = format_uint(tmp + sizeof(tmp), val, 1);
+    return textbuf_append_n(tb, start, tmp + sizeof(tmp) - start);
+}
+
+bool textbuf_append_int(textbuf_t *tb, int32_t val)
+{
+    char tmp[11];
+    /* Negate in unsigned to survive INT32_MIN */
+    uint32_t abs_val = (val < 0) ? 0 - (uint32_t)val : (uint32_t)val;
+    char *start = format_uint(tmp + sizeof(tmp), abs_val, 1);
+    if (val < 0) {
+        *--start = '-';
+    }
+    return textbuf_append_n(tb, start, tmp + sizeof(tmp) - start);
+}
+
+bool textbuf_append_fixed(textbuf_t *tb, int32_t val, uint8_t precision)
+{
+    uint32_t divider = 1;
+    uint8_t i;
+
+    if (precision > 9) {
+        precision = 9;
+    }
+    for (i = 0; i < precision; i++) {
+        divider *= 10;
+    }
+
+    uint32_t abs_val = (val < 0) ? 0 - (uint32_t)val : (uint32_t)val;
+
+    char tmp[22];
+    char *start = format_uint(tmp + sizeof(tmp), abs_val % divider, precision ? precision : 1);
+    *--start = '.';
+    start = format_uint(start, abs_val / divider, 1);
+    if (val < 0) {
+        *--start = '-';
+    }
+
+    return textbuf_append_n(tb, start, tmp + sizeof(tmp) - start);
+}
@@ -0,0 +1,76 @@
+/* Copyright (c) 2017 Unwired Devices LLC [info@unwds.com]
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+/**
+ * @defgroup    
+ * @ingroup     
+ * @brief       
+ * @{
+ * @file        timestamp.c
+ * @brief       Cached formatting of message and log timestamps
+ */
+
+#include "timestamp.h"
+#include "textbuf.h"
+
+typedef struct {
+    time_t sec;
+    size_t len;
+    char text[TIMESTAMP_ISO8601_LEN];
+} ts_cache_t;
+
+/* Every thread keeps its own copy, so no locking is needed */
+static __thread ts_cache_t utc_cache = { .sec = -1 };
+static __thread ts_cache_t local_cache = { .sec = -1 };
+
+size_t timestamp_iso8601(const struct timeval *tv, char *buf, size_t size)
+{
+    if (tv->tv_sec != utc_cache.sec) {
+        struct tm tm;
+        gmtime_r(&tv->tv_sec, &tm);
+        utc_cache.len = strftime(utc_cache.text, sizeof(utc_cache.text), "%FT%T.", &tm);
+        utc_cache.sec = tv->tv_sec;
+    }
+
+    textbuf_t tb;
+    textbuf_init(&tb, buf, size);
+    textbuf_append_n(&tb, utc_cache.text, utc_cache.len);
+    textbuf_append_uint(&tb, tv->tv_usec);
+    textbuf_append_char(&tb, 'Z');
+
+    return tb.len;
+}
+
+size_t timestamp_log(time_t t, char *buf, size_t size)
+{
+    if (t != local_cache.sec) {
+        struct tm tm;
+        localtime_r(&t, &tm);
+        local_cache.len = strftime(local_cache.text, sizeof(local_cache.text), "%T", &tm);
+        local_cache.sec = t;
+    }
+
+    textbuf_t tb;
+    textbuf_init(&tb, buf, size);
+    textbuf_append_n(&tb, local_cache.text, local_cache.len);
+
+    return tb.len;
+}
@@ -0,0 +1,582 @@
+/* Copyright (c) 2017 Unwired Devices LLC [info@unwds.com]
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+/**
+ * @defgroup    
+ * @ingroup     
+ * @brief       
+ * @{
+ * @file        bench.c
+ * @brief       End-to-end throughput and latency benchmark
+ *
+ * Runs lora-mqtt against an emulated gate on a Unix socket and a local
+ * MQTT broker. Uplinks carry a sequence number in counter module values,
+ * so the time from the frame leaving the gate to the message arriving
+ * from the broker is known for each of them. Downlinks are timed from
+ * the publish to the command reaching the gate, which ACKs it at once.
+ * Results are printed as JSON.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <mosquitto.h>
+
+#include "mqtt.h"
+#include "ringbuf.h"
+
+#define BENCH_EUI_BASE UINT64_C(0x8000000000000000)
+#define BENCH_DRAIN_TIMEOUT 10000   /* ms to wait for the last messages */
+#define BENCH_MAX_THREADS 32
+
+typedef struct {
+    pid_t tid;
+    char name[32];
+    unsigned long ticks;            /* utime + stime */
+} thread_stat_t;
+
+typedef struct {
+    int num;
+    thread_stat_t threads[BENCH_MAX_THREADS];
+    unsigned long rss_kb;
+    unsigned long rss_peak_kb;
+} proc_stat_t;
+
+static unsigned num_frames = 20000;
+static unsigned num_devices = 100;
+static unsigned num_downlinks = 100;
+static unsigned rate = 0;           /* frames per second, 0 is as fast as possible */
+
+/* Per-frame send time and latency, indexed by sequence number */
+static uint64_t *up_sent;
+static uint32_t *up_lat;
+static atomic_uint up_received;
+static atomic_uint up_duplicates;
+static uint64_t up_last_rx;
+
+/* Per-device downlink publish time, 0 when none is in flight */
+static uint64_t *down_sent;
+static uint32_t *down_lat;
+static atomic_uint down_acked;
+
+static int gate_fd = -1;
+static pthread_mutex_t gate_mutex = PTHREAD_MUTEX_INITIALIZER;
+static atomic_bool devlist_requested;
+
+static uint64_t now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void gate_write(const char *buf, size_t len)
+{
+    pthread_mutex_lock(&gate_mutex);
+    while (len > 0) {
+        ssize_t res = write(gate_fd, buf, len);
+        if (res < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        buf += res;
+        len -= res;
+    }
+    pthread_mutex_unlock(&gate_mutex);
+}
+
+/* Plays the gate: answers devices list and ACKs every downlink */
+static void *gate_thread(void *arg)
+{
+    static ringbuf_t rx;
+    ringbuf_init(&rx);
+
+    while (1) {
+        ssize_t n = ringbuf_read(&rx, gate_fd);
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+
+        char *cmd;
+        unsigned len;
+        bool dropped;
+        while ((cmd = ringbuf_next_frame(&rx, '\r', &len, &dropped)) != NULL) {
+            if (len == 0) {
+                continue;
+            }
+
+            if (cmd[0] == CMD_DEVLIST) {
+                /* All devices are class C, so downlinks go out at once */
+                char buf[64];
+                unsigned i;
+                for (i = 0; i < num_devices; i++) {
+                    int l = snprintf(buf, sizeof(buf), "%c%016" PRIx64 "%016" PRIx64 "%04x%04x\n",
+                                     REPLY_LIST, BENCH_EUI_BASE + i, (uint64_t)1, 0, LS_ED_CLASS_C);
+                    gate_write(buf, l);
+                }
+                atomic_store(&devlist_requested, true);
+                continue;
+            }
+
+            if (cmd[0] != CMD_IND || len < 17) {
+                continue;
+            }
+
+            uint64_t t = now_us();
+            char addr[17] = {};
+            memcpy(addr, cmd + 1, 16);
+            uint64_t eui = strtoull(addr, NULL, 16);
+            if (eui < BENCH_EUI_BASE || eui - BENCH_EUI_BASE >= num_devices) {
+                continue;
+            }
+
+            unsigned dev = eui - BENCH_EUI_BASE;
+            if (down_sent[dev]) {
+                down_lat[atomic_fetch_add(&down_acked, 1)] = t - down_sent[dev];
+                down_sent[dev] = 0;
+            }
+
+            char buf[32];
+            int l = snprintf(buf, sizeof(buf), "%c%016" PRIx64 "\n", REPLY_ACK, eui);
+            gate_write(buf, l);
+        }
+    }
+
+    return NULL;
+}
+
+static void on_message(struct mosquitto *m, void *obj, const struct mosquitto_message *msg)
+{
+    uint64_t t = now_us();
+
+    /* Only uplinks of the counter module carry sequence numbers */
+    size_t tlen = strlen(msg->topic);
+    if (tlen < 8 || strcmp(msg->topic + tlen - 8, "/counter") != 0) {
+        return;
+    }
+
+    char payload[512];
+    int len = msg->payloadlen < sizeof(payload) - 1 ? msg->payloadlen : sizeof(payload) - 1;
+    memcpy(payload, msg->payload, len);
+    payload[len] = '\0';
+
+    char *v = strstr(payload, "\"v0\": ");
+    if (!v) {
+        return;
+    }
+
+    unsigned long seq = strtoul(v + strlen("\"v0\": "), NULL, 10);
+    if (seq >= num_frames || !up_sent[seq]) {
+        return;
+    }
+
+    if (up_lat[seq]) {
+        atomic_fetch_add(&up_duplicates, 1);
+        return;
+    }
+
+    up_lat[seq] = (t - up_sent[seq]) | 1;
+    up_last_rx = t;
+    atomic_fetch_add(&up_received, 1);
+}
+
+/* REPLY_IND of the counter module with seq in the first value */
+static int make_frame(char *buf, size_t size, unsigned seq)
+{
+    uint64_t eui = BENCH_EUI_BASE + seq % num_devices;
+    uint32_t v0 = seq & 0xFFFFFF;
+    uint32_t num[3] = { v0 << 8, 0, 0 };
+    uint8_t data[12];
+
+    int i;
+    for (i = 0; i < 12; i++) {
+        data[i] = num[i / 4] >> (8 * (i % 4));
+    }
+
+    int len = snprintf(buf, size, "%c%016" PRIx64 "ffb500%02x", REPLY_IND, eui, 12);
+    for (i = 0; i < 12; i++) {
+        len += snprintf(buf + len, size - len, "%02x", data[i]);
+    }
+    len += snprintf(buf + len, size - len, "\n");
+
+    return len;
+}
+
+static int cmp_u32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+static void print_latency(FILE *out, uint32_t *lat, unsigned n)
+{
+    if (n == 0) {
+        fprintf(out, "null");
+        return;
+    }
+
+    qsort(lat, n, sizeof(uint32_t), cmp_u32);
+    fprintf(out, "{ \"p50\": %u, \"p99\": %u, \"p999\": %u, \"max\": %u }",
+            lat[n * 50 / 100], lat[n * 99 / 100], lat[n * 999 / 1000], lat[n - 1]);
+}
+
+static void read_proc(pid_t pid, proc_stat_t *ps)
+{
+    char path[64], line[256];
+
+    memset(ps, 0, sizeof(*ps));
+
+    snprintf(path, sizeof(path), "/proc/%d/status", pid);
+    FILE *f = fopen(path, "r");
+    if (f) {
+        while (fgets(line, sizeof(line), f)) {
+            sscanf(line, "VmRSS: %lu", &ps->rss_kb);
+            sscanf(line, "VmHWM: %lu", &ps->rss_peak_kb);
+        }
+        fclose(f);
+    }
+
+    snprintf(path, sizeof(path), "/proc/%d/task", pid);
+    DIR *d = opendir(path);
+    if (!d) {
+        return;
+    }
+
+    struct dirent *e;
+    while ((e = readdir(d)) != NULL && ps->num < BENCH_MAX_THREADS) {
+        if (e->d_name[0] == '.') {
+            continue;
+        }
+
+        thread_stat_t *ts = &ps->threads[ps->num];
+        ts->tid = atoi(e->d_name);
+
+        snprintf(path, sizeof(path), "/proc/%d/task/%d/stat", pid, ts->tid);
+        f = fopen(path, "r");
+        if (!f) {
+            continue;
+        }
+        if (!fgets(line, sizeof(line), f)) {
+            fclose(f);
+            continue;
+        }
+        fclose(f);
+
+        /* pid (comm) state ppid ... utime is the 14th field, stime the 15th */
+        char *open = strchr(line, '(');
+        char *close = strrchr(line, ')');
+        if (!open || !close) {
+            continue;
+        }
+        snprintf(ts->name, sizeof(ts->name), "%.*s", (int)(close - open - 1), open + 1);
+
+        unsigned long utime, stime;
+        if (sscanf(close + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu", &utime, &stime) == 2) {
+            ts->ticks = utime + stime;
+            ps->num++;
+        }
+    }
+    closedir(d);
+}
+
+static void print_threads(FILE *out, proc_stat_t *before, proc_stat_t *after, double wall)
+{
+    long hz = sysconf(_SC_CLK_TCK);
+    int i, j;
+
+    fprintf(out, "[");
+    for (i = 0; i < after->num; i++) {
+        unsigned long ticks = after->threads[i].ticks;
+        for (j = 0; j < before->num; j++) {
+            if (before->threads[j].tid == after->threads[i].tid) {
+                ticks -= before->threads[j].ticks;
+                break;
+            }
+        }
+
+        double cpu = (double)ticks / hz;
+        fprintf(out, "%s\n      { \"tid\": %d, \"name\": \"%s\", \"cpu_s\": %.2f, \"cpu_pct\": %.1f }",
+                i ? "," : "", after->threads[i].tid, after->threads[i].name, cpu, wall > 0 ? 100 * cpu / wall : 0);
+    }
+    fprintf(out, "\n    ]");
+}
+
+static void usage(void)
+{
+    printf("Usage: bench [options]\n");
+    printf("  -m <path>\tlora-mqtt binary (default bin/mqtt).\n");
+    printf("  -n <num>\tUplink frames to send (default %u).\n", num_frames);
+    printf("  -d <num>\tNumber of devices (default %u).\n", num_devices);
+    printf("  -D <num>\tDownlinks to send, at most one per device (default %u).\n", num_downlinks);
+    printf("  -r <rate>\tUplinks per second, 0 for as fast as possible (default %u).\n", rate);
+    printf("  -H <host>\tMQTT broker host (default localhost).\n");
+    printf("  -P <port>\tMQTT broker port (default 1883).\n");
+    printf("  -o <file>\tWrite JSON results to file instead of stdout.\n");
+}
+
+int main(int argc, char *argv[])
+{
+    const char *mqtt_bin = "bin/mqtt";
+    const char *host = "localhost";
+    const char *outname = NULL;
+    int port = 1883;
+
+    int c;
+    while ((c = getopt(argc, argv, "hm:n:d:D:r:H:P:o:")) != -1)
+    switch (c) {
+        case 'm':
+            mqtt_bin = optarg;
+            break;
+        case 'n':
+            num_frames = atoi(optarg);
+            break;
+        case 'd':
+            num_devices = atoi(optarg);
+            break;
+        case 'D':
+            num_downlinks = atoi(optarg);
+            break;
+        case 'r':
+            rate = atoi(optarg);
+            break;
+        case 'H':
+            host = optarg;
+            break;
+        case 'P':
+            port = atoi(optarg);
+            break;
+        case 'o':
+            outname = optarg;
+            break;
+        case 'h':
+            usage();
+            return 0;
+        default:
+            usage();
+            return -1;
+    }
+
+    if (num_frames == 0 || num_frames > 0xFFFFFF || num_devices == 0) {
+        usage();
+        return -1;
+    }
+    if (num_downlinks > num_devices) {
+        num_downlinks = num_devices;
+    }
+
+    up_sent = calloc(num_frames, sizeof(uint64_t));
+    up_lat = calloc(num_frames, sizeof(uint32_t));
+    down_sent = calloc(num_devices, sizeof(uint64_t));
+    down_lat = calloc(num_devices, sizeof(uint32_t));
+    if (!up_sent || !up_lat || !down_sent || !down_lat) {
+        puts("[error] Unable to allocate memory");
+        return 1;
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+
+    /* Emulated gate link */
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "/tmp/lora-mqtt-bench.%d.sock", getpid());
+    unlink(addr.sun_path);
+
+    int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd < 0 || bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(listen_fd, 1) < 0) {
+        perror("socket");
+        return 1;
+    }
+
+    /* Subscriber on the same broker lora-mqtt publishes to */
+    mosquitto_lib_init();
+    struct mosquitto *mosq = mosquitto_new(NULL, true, NULL);
+    if (!mosq) {
+        puts("[error] Unable to allocate memory");
+        return 1;
+    }
+    mosquitto_message_callback_set(mosq, on_message);
+    if (mosquitto_connect(mosq, host, port, 60) != MOSQ_ERR_SUCCESS) {
+        fprintf(stderr, "Unable to connect to MQTT broker at %s:%d\n", host, port);
+        return 1;
+    }
+    mosquitto_subscribe(mosq, NULL, "devices/lora/#", 0);
+    mosquitto_loop_start(mosq);
+
+    char port_uri[128];
+    snprintf(port_uri, sizeof(port_uri), "unix:%s", addr.sun_path);
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        /* Keep our stdout clean for the results */
+        int null = open("/dev/null", O_WRONLY);
+        if (null >= 0) {
+            dup2(null, STDOUT_FILENO);
+            close(null);
+        }
+        execl(mqtt_bin, mqtt_bin, "-i", "-p", port_uri, (char *)NULL);
+        perror("exec");
+        _exit(127);
+    }
+    if (pid < 0) {
+        perror("fork");
+        return 1;
+    }
+
+    gate_fd = accept(listen_fd, NULL, NULL);
+    if (gate_fd < 0) {
+        perror("accept");
+        kill(pid, SIGTERM);
+        return 1;
+    }
+
+    pthread_t gate_th;
+    pthread_create(&gate_th, NULL, gate_thread, NULL);
+
+    /* Wait for lora-mqtt to learn the devices and subscribe */
+    int i;
+    for (i = 0; i < 100 && !atomic_load(&devlist_requested); i++) {
+        usleep(100000);
+    }
+    sleep(1);
+
+    fprintf(stderr, "[bench] Sending %u uplinks from %u devices\n", num_frames, num_devices);
+
+    proc_stat_t ps_start, ps_end;
+    read_proc(pid, &ps_start);
+
+    uint64_t start = now_us();
+    char frame[128];
+    unsigned seq;
+    for (seq = 0; seq < num_frames; seq++) {
+        if (rate) {
+            uint64_t due = start + (uint64_t)seq * 1000000 / rate;
+            uint64_t t = now_us();
+            if (due > t) {
+                usleep(due - t);
+            }
+        }
+
+        int len = make_frame(frame, sizeof(frame), seq);
+        up_sent[seq] = now_us();
+        gate_write(frame, len);
+    }
+
+    uint64_t deadline = now_us() + BENCH_DRAIN_TIMEOUT * 1000;
+    while (atomic_load(&up_received) < num_frames && now_us() < deadline) {
+        usleep(10000);
+    }
+    uint64_t up_end = up_last_rx ? up_last_rx : now_us();
+
+    fprintf(stderr, "[bench] Sending %u downlinks\n", num_downlinks);
+
+    char topic[64];
+    unsigned d;
+    for (d = 0; d < num_downlinks; d++) {
+        snprintf(topic, sizeof(topic), "devices/lora/%016" PRIx64 "/meteo", BENCH_EUI_BASE + d);
+        down_sent[d] = now_us();
+        /* QoS 0: lora-mqtt ignores messages with a message id set */
+        mosquitto_publish(mosq, NULL, topic, 3, "get", 0, false);
+        usleep(10000);
+    }
+
+    deadline = now_us() + BENCH_DRAIN_TIMEOUT * 1000;
+    while (atomic_load(&down_acked) < num_downlinks && now_us() < deadline) {
+        usleep(10000);
+    }
+
+    uint64_t end = now_us();
+    read_proc(pid, &ps_end);
+
+    kill(pid, SIGTERM);
+    waitpid(pid, NULL, 0);
+    unlink(addr.sun_path);
+
+    /* Collect latencies of the frames which made it */
+    unsigned received = 0;
+    for (seq = 0; seq < num_frames; seq++) {
+        if (up_lat[seq]) {
+            up_lat[received++] = up_lat[seq];
+        }
+    }
+
+    double up_time = (up_end - start) / 1e6;
+    double wall = (end - start) / 1e6;
+    unsigned acked = atomic_load(&down_acked);
+
+    FILE *out = outname ? fopen(outname, "w") : stdout;
+    if (!out) {
+        perror(outname);
+        return 1;
+    }
+
+    fprintf(out, "{\n");
+    fprintf(out, "  \"frames\": %u,\n  \"devices\": %u,\n  \"rate\": %u,\n", num_frames, num_devices, rate);
+    fprintf(out, "  \"uplink\": {\n");
+    fprintf(out, "    \"received\": %u,\n    \"lost\": %u,\n    \"duplicates\": %u,\n",
+            received, num_frames - received, atomic_load(&up_duplicates));
+    fprintf(out, "    \"duration_s\": %.3f,\n    \"frames_per_s\": %.1f,\n",
+            up_time, up_time > 0 ? received / up_time : 0);
+    fprintf(out, "    \"latency_us\": ");
+    print_latency(out, up_lat, received);
+    fprintf(out, "\n  },\n");
+    fprintf(out, "  \"downlink\": {\n");
+    fprintf(out, "    \"sent\": %u,\n    \"acked\": %u,\n", num_downlinks, acked);
+    fprintf(out, "    \"latency_us\": ");
+    print_latency(out, down_lat, acked);
+    fprintf(out, "\n  },\n");
+    fprintf(out, "  \"process\": {\n");
+    fprintf(out, "    \"wall_s\": %.3f,\n    \"rss_kb\": %lu,\n    \"rss_peak_kb\": %lu,\n",
+            wall, ps_end.rss_kb, ps_end.rss_peak_kb);
+    fprintf(out, "    \"threads\": ");
+    print_threads(out, &ps_start, &ps_end, wall);
+    fprintf(out, "\n  }\n}\n");
+
+    if (out != stdout) {
+        fclose(out);
+    }
+
+    mosquitto_loop_stop(mosq, true);
+    mosquitto_destroy(mosq);
+    mosquitto_lib_cleanup();
+
+    return (received == num_frames && acked == num_downlinks) ? 0 : 2;
+}
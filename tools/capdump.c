@@ -0,0 +1,136 @@
+/* Copyright (c) 2017 Unwired Devices LLC [info@unwds.com]
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+
+/**
+ * @defgroup    
+ * @ingroup     
+ * @brief       
+ * @{
+ * @file        capdump.c
+ * @brief       Prints gate traffic capture as text
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "capture.h"
+
+static void print_record(const capture_record_t *rec)
+{
+    char date[32];
+    time_t sec = rec->time_us / 1000000;
+    struct tm tm;
+    gmtime_r(&sec, &tm);
+    strftime(date, sizeof(date), "%FT%T", &tm);
+
+    printf("%s.%06uZ %s gate%u ", date, (unsigned)(rec->time_us % 1000000),
+           rec->dir == CAPTURE_RX ? "rx" : "tx", rec->gate);
+
+    unsigned i;
+    for (i = 0; i < rec->len; i++) {
+        unsigned char c = rec->data[i];
+        if (c == '\r') {
+            printf("\\r");
+        } else if (isprint(c)) {
+            putchar(c);
+        } else {
+            printf("\\x%02x", c);
+        }
+    }
+    putchar('\n');
+}
+
+/* Uplink 'I' + EUI + RSSI + status + module id + payload, as a decbench corpus line */
+static void print_corpus(const capture_record_t *rec)
+{
+    const unsigned hdr = 1 + 16 + 4 + 2;
+
+    if (rec->dir != CAPTURE_RX || rec->data[0] != 'I' || rec->len < hdr + 2) {
+        return;
+    }
+
+    char modid[3] = { rec->data[hdr], rec->data[hdr + 1], '\0' };
+    printf("%-12lu %s  # %.16s\n", strtoul(modid, NULL, 16), rec->data + hdr + 2, rec->data + 1);
+}
+
+static void usage(void)
+{
+    printf("Usage: capdump [-d] <capture file>\n");
+    printf("  -d\tPrint uplinks as decoder benchmark corpus lines.\n");
+}
+
+int main(int argc, char *argv[])
+{
+    bool corpus = false;
+
+    int c;
+    while ((c = getopt(argc, argv, "hd")) != -1)
+    switch (c) {
+        case 'd':
+            corpus = true;
+            break;
+        case 'h':
+            usage();
+            return 0;
+        default:
+            usage();
+            return -1;
+    }
+
+    if (optind >= argc) {
+        usage();
+        return -1;
+    }
+
+    capture_reader_t r;
+    if (!capture_reader_open(&r, argv[optind])) {
+        return 1;
+    }
+
+    capture_record_t *rec = (capture_record_t *)malloc(sizeof(capture_record_t));
+    if (!rec) {
+        return 1;
+    }
+
+    int res;
+    while ((res = capture_read(&r, rec)) > 0) {
+        if (corpus) {
+            print_corpus(rec);
+        } else {
+            print_record(rec);
+        }
+    }
+
+    free(rec);
+    capture_reader_close(&r);
+
+    if (res < 0) {
+        fprintf(stderr, "[error] Capture file is damaged\n");
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,403 @@
+/* Copyright (c) 2017 Unwired Devices LLC [info@unwds.com]
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+
+/**
+ * @defgroup    
+ * @ingroup     
+ * @brief       
+ * @{
+ * @file        decbench.c
+ * @brief       Microbenchmark of module decoders
+ *
+ * Feeds every payload of the corpus (tools/decoder-corpus.txt by default)
+ * to its module decoder many times in a row and reports time per frame
+ * spent in hex_decode(), convert_to() and build_mqtt_message(), the message
+ * size and the number of heap allocations they make per frame.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "unwds-mqtt.h"
+#include "utils.h"
+
+#define DECBENCH_PAYLOAD_LEN 1024   /* same as REPLY_LEN in mqtt.c */
+#define DECBENCH_WARMUP 1000
+
+typedef struct {
+    char module[20];
+    uint8_t modid;
+    int len;
+    char hex[2 * DECBENCH_PAYLOAD_LEN + 1];  /* payload as it comes from the gate */
+    char comment[60];
+    unsigned line;
+
+    size_t msg_len;
+    double hex_ns;
+    double decode_ns;
+    double build_ns;
+    double allocs;
+} corpus_entry_t;
+
+static corpus_entry_t *entries = NULL;
+static unsigned num_entries = 0;
+static unsigned max_entries = 0;
+
+static unsigned long alloc_count = 0;
+static int alloc_counting = 0;
+
+#ifdef __GLIBC__
+/* Count allocations by wrapping the glibc allocator */
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+void *malloc(size_t size)
+{
+    alloc_count += alloc_counting;
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+    alloc_count += alloc_counting;
+    return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    alloc_count += alloc_counting;
+    return __libc_realloc(ptr, size);
+}
+
+#define DECBENCH_COUNTS_ALLOCS 1
+#else
+#define DECBENCH_COUNTS_ALLOCS 0
+#endif
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static char *strip(char *str)
+{
+    while (isspace((unsigned char)*str)) {
+        str++;
+    }
+
+    char *end = str + strlen(str);
+    while (end > str && isspace((unsigned char)end[-1])) {
+        *--end = '\0';
+    }
+
+    return str;
+}
+
+static bool load_corpus(const char *name, const char *only)
+{
+    FILE *f = fopen(name, "r");
+    if (!f) {
+        printf("[error] Unable to open corpus file %s\n", name);
+        return false;
+    }
+
+    char line[4 * DECBENCH_PAYLOAD_LEN];
+    unsigned lineno = 0;
+
+    while (fgets(line, sizeof(line), f)) {
+        lineno++;
+
+        char *comment = strchr(line, '#');
+        if (comment) {
+            *comment++ = '\0';
+        }
+
+        char *module = strtok(line, " \t\r\n");
+        char *hex = strtok(NULL, " \t\r\n");
+        if (!module) {
+            continue;
+        }
+
+        if (!hex || strlen(hex) % 2 || strlen(hex) / 2 > DECBENCH_PAYLOAD_LEN) {
+            printf("[error] %s:%u: invalid payload\n", name, lineno);
+            fclose(f);
+            return false;
+        }
+
+        int modid;
+        if (strspn(module, "0123456789") == strlen(module)) {
+            modid = atoi(module);
+        } else {
+            modid = unwds_modid_by_name(module);
+        }
+        if (modid < 0 || modid > 255) {
+            printf("[error] %s:%u: unknown module \"%s\"\n", name, lineno, module);
+            fclose(f);
+            return false;
+        }
+
+        if (only && strcmp(only, module)) {
+            continue;
+        }
+
+        if (num_entries == max_entries) {
+            max_entries = max_entries ? 2 * max_entries : 64;
+            entries = (corpus_entry_t *)realloc(entries, max_entries * sizeof(corpus_entry_t));
+            if (!entries) {
+                puts("[error] Unable to allocate memory");
+                fclose(f);
+                return false;
+            }
+        }
+
+        corpus_entry_t *e = &entries[num_entries];
+        memset(e, 0, sizeof(corpus_entry_t));
+
+        uint8_t data[DECBENCH_PAYLOAD_LEN];
+        if (hex_decode(hex, strlen(hex), data, sizeof(data), false) < 0) {
+            printf("[error] %s:%u: invalid payload\n", name, lineno);
+            fclose(f);
+            return false;
+        }
+
+        snprintf(e->module, sizeof(e->module), "%s", module);
+        snprintf(e->hex, sizeof(e->hex), "%s", hex);
+        snprintf(e->comment, sizeof(e->comment), "%s", comment ? strip(comment) : "");
+        e->modid = modid;
+        e->len = strlen(hex) / 2;
+        e->line = lineno;
+
+        num_entries++;
+    }
+
+    fclose(f);
+    return true;
+}
+
+static mqtt_format_t format = UNWDS_MQTT_REGULAR;
+
+static bool run_entry(corpus_entry_t *e, unsigned iterations)
+{
+    static mqtt_msg_t mqtt_msg;
+    static uint8_t moddata[DECBENCH_PAYLOAD_LEN];
+    static char msg[MQTT_MAX_MSG_SIZE];
+    const char *topic;
+
+    mqtt_status_t status = { .rssi = -70, .temperature = 20, .battery = 3300 };
+    const char *addr = "0123456789abcdef";
+
+    unsigned i;
+    uint64_t hex_ns = 0;
+    uint64_t decode_ns = 0;
+    uint64_t build_ns = 0;
+
+    memset(moddata, 0, sizeof(moddata));
+
+    for (i = 0; i < DECBENCH_WARMUP + iterations; i++) {
+        bool measure = (i >= DECBENCH_WARMUP);
+
+        mqtt_msg_init(&mqtt_msg);
+
+        alloc_counting = measure;
+
+        /* Decoders may convert the payload in place, so it's decoded afresh every time */
+        uint64_t start = now_ns();
+        if (hex_decode(e->hex, 2 * e->len, moddata, sizeof(moddata), false) != e->len) {
+            alloc_counting = 0;
+            return false;
+        }
+        uint64_t unhexed = now_ns();
+        if (!convert_to(e->modid, moddata, e->len, &topic, &mqtt_msg)) {
+            alloc_counting = 0;
+            return false;
+        }
+        uint64_t decoded = now_ns();
+        e->msg_len = build_mqtt_message(msg, &mqtt_msg, status, addr, NULL, format);
+        uint64_t built = now_ns();
+
+        alloc_counting = 0;
+
+        if (measure) {
+            hex_ns += unhexed - start;
+            decode_ns += decoded - unhexed;
+            build_ns += built - decoded;
+        }
+    }
+
+    e->hex_ns = (double)hex_ns / iterations;
+    e->decode_ns = (double)decode_ns / iterations;
+    e->build_ns = (double)build_ns / iterations;
+    e->allocs = (double)alloc_count / iterations;
+    alloc_count = 0;
+
+    return true;
+}
+
+static void print_table(void)
+{
+    double build_ns = 0, msg_bytes = 0;
+    unsigned i;
+
+    printf("%-12s %5s %6s %8s %10s %10s %8s  %s\n", "module", "len", "bytes", "hex ns", "decode ns", "build ns",
+           "allocs", "payload");
+    for (i = 0; i < num_entries; i++) {
+        corpus_entry_t *e = &entries[i];
+        char allocs[20] = "-";
+        if (DECBENCH_COUNTS_ALLOCS) {
+            snprintf(allocs, sizeof(allocs), "%.2f", e->allocs);
+        }
+
+        printf("%-12s %5d %6zu %8.1f %10.1f %10.1f %8s  %s\n", e->module, e->len, e->msg_len,
+               e->hex_ns, e->decode_ns, e->build_ns, allocs, e->comment);
+
+        build_ns += e->build_ns;
+        msg_bytes += e->msg_len;
+    }
+
+    /* Compares formats, e.g. mqtt against mqtt-escaped */
+    if (build_ns > 0) {
+        printf("\n%s: %.0f messages/s, %.1f MB/s built\n", mqtt_format_name(format),
+               1e9 * num_entries / build_ns, 1e3 * msg_bytes / build_ns);
+    }
+}
+
+static void print_json(unsigned iterations)
+{
+    unsigned i;
+
+    printf("{\n  \"iterations\": %u,\n  \"format\": \"%s\",\n  \"entries\": [", iterations,
+           mqtt_format_name(format));
+    for (i = 0; i < num_entries; i++) {
+        corpus_entry_t *e = &entries[i];
+        char allocs[20] = "null";
+        if (DECBENCH_COUNTS_ALLOCS) {
+            snprintf(allocs, sizeof(allocs), "%.2f", e->allocs);
+        }
+
+        printf("%s\n    { \"module\": \"%s\", \"id\": %u, \"line\": %u, \"len\": %d, \"bytes\": %zu, "
+               "\"hex_ns\": %.1f, \"decode_ns\": %.1f, \"build_ns\": %.1f, \"allocs\": %s }",
+               i ? "," : "", e->module, e->modid, e->line, e->len, e->msg_len,
+               e->hex_ns, e->decode_ns, e->build_ns, allocs);
+    }
+    printf("\n  ]\n}\n");
+}
+
+static void usage(void)
+{
+    printf("Usage: decbench [options]\n");
+    printf("  -c <file>\tCorpus of payloads (default tools/decoder-corpus.txt).\n");
+    printf("  -n <num>\tIterations per payload (default 100000).\n");
+    printf("  -m <module>\tOnly run payloads of this module.\n");
+    printf("  -f <format>\tMessage format: mqtt (default), mqtt-escaped, cbor or msgpack.\n");
+    printf("  -j\t\tPrint results as JSON.\n");
+}
+
+int main(int argc, char *argv[])
+{
+    const char *corpus = "tools/decoder-corpus.txt";
+    const char *only = NULL;
+    unsigned iterations = 100000;
+    bool json = false;
+
+    int c;
+    while ((c = getopt(argc, argv, "hc:n:m:f:j")) != -1)
+    switch (c) {
+        case 'c':
+            corpus = optarg;
+            break;
+        case 'n':
+            iterations = atoi(optarg);
+            break;
+        case 'm':
+            only = optarg;
+            break;
+        case 'f':
+            if (!mqtt_format_by_name(optarg, &format)) {
+                fprintf(stderr, "Unknown format: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'j':
+            json = true;
+            break;
+        case 'h':
+            usage();
+            return 0;
+        default:
+            usage();
+            return -1;
+    }
+
+    if (iterations == 0) {
+        usage();
+        return -1;
+    }
+
+    if (!load_corpus(corpus, only)) {
+        return 1;
+    }
+
+    if (num_entries == 0) {
+        puts("[error] No payloads to run");
+        return 1;
+    }
+
+    /* Decoders may print, keep it out of the results */
+    fflush(stdout);
+    int saved_stdout = dup(STDOUT_FILENO);
+    if (!freopen("/dev/null", "w", stdout)) {
+        return 1;
+    }
+
+    unsigned i;
+    bool ok = true;
+    for (i = 0; i < num_entries && ok; i++) {
+        ok = run_entry(&entries[i], iterations);
+        fflush(stdout);
+    }
+
+    dup2(saved_stdout, STDOUT_FILENO);
+    close(saved_stdout);
+    clearerr(stdout);
+
+    if (!ok) {
+        printf("[error] line %u: module %s failed to decode the payload\n", entries[i - 1].line, entries[i - 1].module);
+        return 1;
+    }
+
+    if (json) {
+        print_json(iterations);
+    } else {
+        print_table();
+    }
+
+    return 0;
+}
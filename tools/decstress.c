@@ -0,0 +1,287 @@
+/* Copyright (c) 2017 Unwired Devices LLC [info@unwds.com]
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+
+/**
+ * @defgroup    
+ * @ingroup     
+ * @brief       
+ * @{
+ * @file        decstress.c
+ * @brief       Concurrent decoding stress test
+ *
+ * Runs every uplink of the corpus through convert_uplink() and
+ * publish_mqtt_message() from many threads at once and checks that each
+ * thread gets the same message as a single-threaded run. Meant to be
+ * built with -fsanitize=thread, see "make stress".
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <mosquitto.h>
+
+#include "unwds-mqtt.h"
+#include "mqtt.h"
+#include "utils.h"
+
+#define DECSTRESS_MAX_THREADS 64
+
+/* RSSI -70 and status byte as the gate sends them */
+#define DECSTRESS_RSSI_STATUS "ffba5a"
+
+typedef struct {
+    char addr[17];
+    char frame[6 + 2 + 2 * REPLY_LEN + 1];  /* REPLY_IND data after the EUI */
+    const char *topic;
+    char msg[MQTT_MAX_MSG_SIZE];            /* reference, up to the date */
+    bool decoded;                           /* some payloads are refused by design */
+    unsigned line;
+} stress_entry_t;
+
+static stress_entry_t *entries = NULL;
+static unsigned num_entries = 0;
+
+static unsigned iterations = 100;
+static bool do_publish = true;
+static struct mosquitto *mosq = NULL;
+
+static unsigned long mismatches = 0;
+static pthread_mutex_t mismatch_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* The date differs between runs, compare what goes before it */
+static size_t undated_len(const char *msg)
+{
+    const char *date = strstr(msg, ", \"date\": ");
+    return date ? (size_t)(date - msg) : strlen(msg);
+}
+
+static bool load_corpus(const char *name)
+{
+    FILE *f = fopen(name, "r");
+    if (!f) {
+        printf("[error] Unable to open corpus file %s\n", name);
+        return false;
+    }
+
+    char line[4 * REPLY_LEN];
+    unsigned lineno = 0;
+    unsigned max_entries = 0;
+
+    while (fgets(line, sizeof(line), f)) {
+        lineno++;
+
+        char *comment = strchr(line, '#');
+        if (comment) {
+            *comment = '\0';
+        }
+
+        char *saveptr;
+        char *module = strtok_r(line, " \t\r\n", &saveptr);
+        char *hex = strtok_r(NULL, " \t\r\n", &saveptr);
+        if (!module) {
+            continue;
+        }
+
+        int modid;
+        if (strspn(module, "0123456789") == strlen(module)) {
+            modid = atoi(module);
+        } else {
+            modid = unwds_modid_by_name(module);
+        }
+        if (modid < 0 || modid > 255 || !hex || strlen(hex) / 2 > REPLY_LEN - 1) {
+            printf("[error] %s:%u: invalid corpus line\n", name, lineno);
+            fclose(f);
+            return false;
+        }
+
+        if (num_entries == max_entries) {
+            max_entries = max_entries ? 2 * max_entries : 64;
+            entries = (stress_entry_t *)realloc(entries, max_entries * sizeof(stress_entry_t));
+            if (!entries) {
+                puts("[error] Unable to allocate memory");
+                fclose(f);
+                return false;
+            }
+        }
+
+        stress_entry_t *e = &entries[num_entries++];
+        memset(e, 0, sizeof(stress_entry_t));
+        /* Every line gets its own device, so topics differ too */
+        snprintf(e->addr, sizeof(e->addr), "%016x", lineno);
+        snprintf(e->frame, sizeof(e->frame), DECSTRESS_RSSI_STATUS "%02x%s", modid, hex);
+        e->line = lineno;
+    }
+
+    fclose(f);
+    return true;
+}
+
+static bool decode(stress_entry_t *e, const char **topic, char *msg)
+{
+    /* Decoders may change the payload, work on a copy */
+    char frame[sizeof(e->frame)];
+    strcpy(frame, e->frame);
+
+    return convert_uplink(frame, e->addr, NULL, UNWDS_MQTT_REGULAR, topic, msg, NULL) > 0;
+}
+
+static void *stress_thread(void *arg)
+{
+    unsigned offset = (uintptr_t)arg;
+    const char *topic;
+    char *msg = (char *)malloc(MQTT_MAX_MSG_SIZE);
+    unsigned long failed = 0;
+    unsigned i, k;
+
+    if (!msg) {
+        return NULL;
+    }
+
+    for (i = 0; i < iterations; i++) {
+        for (k = 0; k < num_entries; k++) {
+            /* Threads start at different entries to mix the decoders */
+            stress_entry_t *e = &entries[(k + offset) % num_entries];
+
+            topic = NULL;
+            bool decoded = decode(e, &topic, msg);
+            if (decoded != e->decoded) {
+                failed++;
+                continue;
+            }
+            if (!decoded) {
+                continue;
+            }
+
+            size_t len = undated_len(msg);
+            if (strcmp(topic, e->topic) || len != undated_len(e->msg) || memcmp(msg, e->msg, len)) {
+                failed++;
+                continue;
+            }
+
+            if (do_publish) {
+                publish_mqtt_message(mosq, e->addr, topic, msg, strlen(msg),
+                                     (k & 1) ? UNWDS_MQTT_ESCAPED : UNWDS_MQTT_REGULAR);
+            }
+        }
+    }
+
+    free(msg);
+
+    pthread_mutex_lock(&mismatch_mutex);
+    mismatches += failed;
+    pthread_mutex_unlock(&mismatch_mutex);
+
+    return NULL;
+}
+
+static void usage(void)
+{
+    printf("Usage: decstress [options]\n");
+    printf("  -c <file>\tCorpus of payloads (default tools/decoder-corpus.txt).\n");
+    printf("  -t <num>\tNumber of threads (default 8).\n");
+    printf("  -n <num>\tPasses over the corpus per thread (default 100).\n");
+    printf("  -P\t\tDon't call publish_mqtt_message().\n");
+}
+
+int main(int argc, char *argv[])
+{
+    const char *corpus = "tools/decoder-corpus.txt";
+    unsigned num_threads = 8;
+
+    int c;
+    while ((c = getopt(argc, argv, "hc:t:n:P")) != -1)
+    switch (c) {
+        case 'c':
+            corpus = optarg;
+            break;
+        case 't':
+            num_threads = atoi(optarg);
+            break;
+        case 'n':
+            iterations = atoi(optarg);
+            break;
+        case 'P':
+            do_publish = false;
+            break;
+        case 'h':
+            usage();
+            return 0;
+        default:
+            usage();
+            return -1;
+    }
+
+    if (num_threads == 0 || num_threads > DECSTRESS_MAX_THREADS || iterations == 0) {
+        usage();
+        return -1;
+    }
+
+    if (!load_corpus(corpus)) {
+        return 1;
+    }
+
+    if (num_entries == 0) {
+        puts("[error] No payloads to run");
+        return 1;
+    }
+
+    /* Decoders and the publisher print a lot, keep it out of the results */
+    fflush(stdout);
+    int saved_stdout = dup(STDOUT_FILENO);
+    if (!freopen("/dev/null", "w", stdout)) {
+        return 1;
+    }
+
+    unsigned i;
+    for (i = 0; i < num_entries; i++) {
+        entries[i].decoded = decode(&entries[i], &entries[i].topic, entries[i].msg);
+    }
+
+    /* Never connected, so publishing stops right at mosquitto_publish() */
+    mosquitto_lib_init();
+    mosq = mosquitto_new(NULL, true, NULL);
+
+    pthread_t threads[DECSTRESS_MAX_THREADS];
+    for (i = 0; i < num_threads; i++) {
+        pthread_create(&threads[i], NULL, stress_thread, (void *)(uintptr_t)(i * num_entries / num_threads));
+    }
+    for (i = 0; i < num_threads; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    mosquitto_destroy(mosq);
+    mosquitto_lib_cleanup();
+
+    fflush(stdout);
+    dup2(saved_stdout, STDOUT_FILENO);
+    close(saved_stdout);
+    clearerr(stdout);
+
+    printf("%u threads, %lu frames, %lu mismatches\n", num_threads,
+           (unsigned long)num_entries * iterations * num_threads, mismatches);
+
+    return mismatches ? 1 : 0;
+}
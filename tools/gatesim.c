@@ -0,0 +1,645 @@
+/* Copyright (c) 2017 Unwired Devices LLC [info@unwds.com]
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+/**
+ * @defgroup    
+ * @ingroup     
+ * @brief       
+ * @{
+ * @file        gatesim.c
+ * @brief       Gate simulator and load generator
+ *
+ * Creates a pty (or listens on a Unix socket) and speaks the gate protocol
+ * from mqtt.h on behalf of a number of emulated devices, so lora-mqtt can
+ * be run and load-tested without the radio.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <termios.h>
+#include <unistd.h>
+#include <inttypes.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "mqtt.h"
+#include "ringbuf.h"
+#include "utils.h"
+
+#define GATESIM_EUI_BASE 0x8000000000000000ULL
+#define GATESIM_MAX_MIX 32
+#define GATESIM_MAX_BURST 256
+#define GATESIM_FRAME_LEN 1024
+#define GATESIM_IDLE_EXIT 5000     /* ms without commands before giving up on held frames */
+
+typedef struct {
+    uint64_t eui;
+    bool joined;
+    uint8_t pending;            /* downlinks announced with CMD_HAS_PENDING */
+    uint8_t nodeclass;
+} sim_device_t;
+
+typedef struct {
+    uint8_t modid;
+    unsigned weight;
+} sim_mix_t;
+
+typedef struct {
+    unsigned long uplinks;
+    unsigned long joins;
+    unsigned long pending_reqs;
+    unsigned long downlinks;
+    unsigned long acks;
+    unsigned long acks_dropped;
+    unsigned long flushes;
+    unsigned long commands;
+} sim_stats_t;
+
+static sim_device_t *devices;
+static unsigned num_devices = 1000;
+static unsigned rate = 100;             /* uplinks per second, 0 is as fast as possible */
+static unsigned long max_uplinks = 0;   /* stop after that many, 0 is forever */
+static unsigned ack_drop = 10;          /* percent of ACKs lost */
+static unsigned class_c = 0;            /* percent of class C devices */
+static bool hold_frames = false;        /* keep uplinks until CMD_FLUSH */
+
+static sim_mix_t mix[GATESIM_MAX_MIX];
+static unsigned num_mix = 0;
+static unsigned mix_total = 0;
+
+static sim_stats_t stats;
+
+/* Replies waiting for CMD_FLUSH or for the link to accept them */
+static char *outbuf;
+static size_t outlen, outsize;
+
+static uint64_t rnd_state = 88172645463325252ULL;
+
+static uint32_t rnd(void)
+{
+    rnd_state ^= rnd_state << 13;
+    rnd_state ^= rnd_state >> 7;
+    rnd_state ^= rnd_state << 17;
+    return (uint32_t)(rnd_state >> 16);
+}
+
+static void out_printf(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+
+static void out_printf(const char *fmt, ...)
+{
+    va_list ap;
+
+    if (outsize - outlen < 2 * GATESIM_FRAME_LEN) {
+        outsize = outsize ? outsize * 2 : 64 * 1024;
+        outbuf = realloc(outbuf, outsize);
+        if (!outbuf) {
+            puts("[error] Unable to allocate memory");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    va_start(ap, fmt);
+    outlen += vsnprintf(outbuf + outlen, outsize - outlen, fmt, ap);
+    va_end(ap);
+}
+
+/* Writes out what's buffered. Returns false if the link is gone */
+static bool out_flush(int fd)
+{
+    size_t done = 0;
+
+    while (done < outlen) {
+        ssize_t res = write(fd, outbuf + done, outlen - done);
+        if (res < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN) {
+                struct pollfd pfd = { .fd = fd, .events = POLLOUT };
+                poll(&pfd, 1, 100);
+                continue;
+            }
+            outlen = 0;
+            return false;
+        }
+        done += res;
+    }
+
+    outlen = 0;
+    return true;
+}
+
+/* Fills module payload with something its decoder accepts */
+static unsigned make_payload(uint8_t modid, uint8_t *data)
+{
+    unsigned i, len;
+
+    switch (modid) {
+        case 2: /* 4btn: button, direction */
+            data[0] = 1 + rnd() % 4;
+            data[1] = rnd() & 1;
+            return 2;
+        case 6: /* lmt01: two sensors, 0.1 C */
+            for (i = 0; i < 4; i += 2) {
+                int16_t t = 200 + rnd() % 100;
+                data[i] = t & 0xFF;
+                data[i + 1] = t >> 8;
+            }
+            return 4;
+        case 9: /* pir */
+            data[0] = rnd() & 1;
+            return 1;
+        case 10: /* adc: 8 channels */
+            for (i = 0; i < 16; i++) {
+                data[i] = rnd();
+            }
+            return 16;
+        case 12: /* counter: 4 packed 24-bit values */
+            for (i = 0; i < 12; i++) {
+                data[i] = rnd();
+            }
+            return 12;
+        case 15: /* light */
+            data[0] = 0;
+            data[1] = rnd();
+            data[2] = rnd();
+            return 3;
+        case 17: /* meteo: temperature, humidity, pressure, big endian */
+            data[0] = 0;
+            data[1] = 0;
+            data[2] = 150 + rnd() % 100;
+            data[3] = 1;
+            data[4] = rnd();
+            data[5] = 0x03;
+            data[6] = 0xE0 + rnd() % 16;
+            return 7;
+        case 7: /* uart: printable text */
+            len = 4 + rnd() % 24;
+            for (i = 0; i < len; i++) {
+                data[i] = 'a' + rnd() % 26;
+            }
+            return len;
+        default:
+            data[0] = 0;
+            return 1;
+    }
+}
+
+static uint8_t pick_module(void)
+{
+    unsigned w = rnd() % mix_total;
+    unsigned i;
+
+    for (i = 0; i < num_mix - 1; i++) {
+        if (w < mix[i].weight) {
+            break;
+        }
+        w -= mix[i].weight;
+    }
+
+    return mix[i].modid;
+}
+
+static void send_join(sim_device_t *dev)
+{
+    dev->joined = true;
+    stats.joins++;
+    out_printf("%c%016" PRIx64 "%u\n", REPLY_JOIN, dev->eui, dev->nodeclass);
+}
+
+static void send_uplink(void)
+{
+    sim_device_t *dev = &devices[rnd() % num_devices];
+
+    if (!dev->joined) {
+        send_join(dev);
+    }
+
+    uint8_t data[GATESIM_FRAME_LEN / 2];
+    uint8_t modid = pick_module();
+    unsigned len = make_payload(modid, data);
+
+    int16_t rssi = -40 - (int)(rnd() % 80);
+    uint8_t status = rnd();
+
+    out_printf("%c%016" PRIx64 "%04x%02x%02x", REPLY_IND, dev->eui, (uint16_t)rssi, status, modid);
+
+    unsigned i;
+    for (i = 0; i < len; i++) {
+        out_printf("%02x", data[i]);
+    }
+    out_printf("\n");
+
+    /* Class A device picks up its downlink right after the uplink */
+    if (dev->pending) {
+        stats.pending_reqs++;
+        out_printf("%c%016" PRIx64 "\n", REPLY_PENDING_REQ, dev->eui);
+    }
+
+    stats.uplinks++;
+}
+
+static sim_device_t *find_device(const char *hex, unsigned len)
+{
+    char addr[17] = {};
+    if (len > 16) {
+        len = 16;
+    }
+    memcpy(addr, hex, len);
+
+    uint64_t eui = strtoull(addr, NULL, 16);
+    if (eui < GATESIM_EUI_BASE || eui - GATESIM_EUI_BASE >= num_devices) {
+        return NULL;
+    }
+
+    return &devices[eui - GATESIM_EUI_BASE];
+}
+
+static void serve_command(char *cmd, unsigned len)
+{
+    stats.commands++;
+
+    switch ((gate_cmd_type_t)cmd[0]) {
+        case CMD_PING:
+            out_printf("%c\n", REPLY_PONG);
+            break;
+
+        case CMD_DEVLIST: {
+            unsigned i;
+            for (i = 0; i < num_devices; i++) {
+                if (!devices[i].joined) {
+                    continue;
+                }
+                out_printf("%c%016" PRIx64 "%016" PRIx64 "%04x%04x\n", REPLY_LIST,
+                           devices[i].eui, (uint64_t)1, (unsigned)(rnd() % 600), devices[i].nodeclass);
+            }
+            break;
+        }
+
+        case CMD_FLUSH:
+            stats.flushes++;
+            break;
+
+        case CMD_HAS_PENDING: {
+            /* ?<addr><count, 2 hex> */
+            if (len < 4) {
+                break;
+            }
+            sim_device_t *dev = find_device(cmd + 1, len - 3);
+            if (dev) {
+                dev->pending = strtoul(cmd + len - 2, NULL, 16);
+            }
+            break;
+        }
+
+        case CMD_IND: {
+            /* I<addr, 16 hex><payload> */
+            sim_device_t *dev = find_device(cmd + 1, len - 1);
+            if (!dev) {
+                break;
+            }
+
+            stats.downlinks++;
+            if (dev->pending) {
+                dev->pending--;
+            }
+
+            if (rnd() % 100 < ack_drop) {
+                stats.acks_dropped++;
+                break;
+            }
+
+            stats.acks++;
+            out_printf("%c%016" PRIx64 "\n", REPLY_ACK, dev->eui);
+            break;
+        }
+
+        case CMD_INVITE: {
+            sim_device_t *dev = find_device(cmd + 1, len - 1);
+            if (dev) {
+                send_join(dev);
+            }
+            break;
+        }
+
+        default:
+            break;
+    }
+}
+
+static void print_stats(void)
+{
+    fprintf(stderr, "[sim] up %lu join %lu req %lu | down %lu ack %lu lost %lu | flush %lu cmd %lu\n",
+            stats.uplinks, stats.joins, stats.pending_reqs,
+            stats.downlinks, stats.acks, stats.acks_dropped,
+            stats.flushes, stats.commands);
+}
+
+static bool parse_mix(char *str)
+{
+    char *saveptr = NULL;
+    char *tok;
+
+    num_mix = 0;
+    mix_total = 0;
+
+    for (tok = strtok_r(str, ",", &saveptr); tok; tok = strtok_r(NULL, ",", &saveptr)) {
+        unsigned modid, weight = 1;
+        if (sscanf(tok, "%u:%u", &modid, &weight) < 1 || num_mix >= GATESIM_MAX_MIX || modid > 255) {
+            return false;
+        }
+        mix[num_mix].modid = modid;
+        mix[num_mix].weight = weight;
+        mix_total += weight;
+        num_mix++;
+    }
+
+    return mix_total > 0;
+}
+
+static int open_pty(const char *link)
+{
+    int fd = posix_openpt(O_RDWR | O_NOCTTY);
+    if (fd < 0 || grantpt(fd) < 0 || unlockpt(fd) < 0) {
+        perror("posix_openpt");
+        return -1;
+    }
+
+    /* Raw mode on the slave side, lora-mqtt sets its own attributes anyway */
+    struct termios tty;
+    int slave = open(ptsname(fd), O_RDWR | O_NOCTTY);
+    if (slave >= 0) {
+        if (tcgetattr(slave, &tty) == 0) {
+            cfmakeraw(&tty);
+            tcsetattr(slave, TCSANOW, &tty);
+        }
+        close(slave);
+    }
+
+    unlink(link);
+    if (symlink(ptsname(fd), link) < 0) {
+        perror("symlink");
+        return -1;
+    }
+
+    fprintf(stderr, "[sim] Gate is at %s (%s)\n", link, ptsname(fd));
+    return fd;
+}
+
+static int open_socket(const char *path)
+{
+    struct sockaddr_un addr;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Socket path is too long: %s\n", path);
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(path);
+    if (fd < 0 || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 1) < 0) {
+        perror("socket");
+        return -1;
+    }
+
+    fprintf(stderr, "[sim] Gate is at unix:%s\n", path);
+    return fd;
+}
+
+static void usage(void)
+{
+    printf("Usage: gatesim [options]\n");
+    printf("  -p <link>\tCreate a pty and symlink it to <link> (default /tmp/gatesim).\n");
+    printf("  -u <path>\tListen on a Unix socket instead of pty.\n");
+    printf("  -n <num>\tNumber of emulated devices (default %u).\n", num_devices);
+    printf("  -r <rate>\tUplinks per second, 0 for as fast as possible (default %u).\n", rate);
+    printf("  -c <count>\tStop after <count> uplinks.\n");
+    printf("  -m <mix>\tModule mix as id:weight,... (default 17:4,6:2,12:2,2:1,9:1).\n");
+    printf("  -a <pct>\tPercent of ACKs to drop (default %u).\n", ack_drop);
+    printf("  -C <pct>\tPercent of class C devices (default %u).\n", class_c);
+    printf("  -f\t\tHold uplinks until CMD_FLUSH like the gate firmware does.\n");
+    printf("  -s <seed>\tRandom seed.\n");
+}
+
+int main(int argc, char *argv[])
+{
+    const char *link = "/tmp/gatesim";
+    const char *sock_path = NULL;
+    char default_mix[] = "17:4,6:2,12:2,2:1,9:1";
+    char *mix_str = default_mix;
+
+    int c;
+    while ((c = getopt(argc, argv, "hp:u:n:r:c:m:a:C:fs:")) != -1)
+    switch (c) {
+        case 'p':
+            link = optarg;
+            break;
+        case 'u':
+            sock_path = optarg;
+            break;
+        case 'n':
+            num_devices = atoi(optarg);
+            break;
+        case 'r':
+            rate = atoi(optarg);
+            break;
+        case 'c':
+            max_uplinks = strtoul(optarg, NULL, 10);
+            break;
+        case 'm':
+            mix_str = optarg;
+            break;
+        case 'a':
+            ack_drop = atoi(optarg);
+            break;
+        case 'C':
+            class_c = atoi(optarg);
+            break;
+        case 'f':
+            hold_frames = true;
+            break;
+        case 's':
+            rnd_state ^= strtoull(optarg, NULL, 0);
+            break;
+        case 'h':
+            usage();
+            return 0;
+        default:
+            usage();
+            return -1;
+    }
+
+    if (num_devices == 0 || !parse_mix(mix_str)) {
+        usage();
+        return -1;
+    }
+
+    devices = calloc(num_devices, sizeof(sim_device_t));
+    if (!devices) {
+        puts("[error] Unable to allocate memory");
+        return 1;
+    }
+
+    unsigned i;
+    for (i = 0; i < num_devices; i++) {
+        devices[i].eui = GATESIM_EUI_BASE + i;
+        devices[i].nodeclass = (rnd() % 100 < class_c) ? LS_ED_CLASS_C : LS_ED_CLASS_A;
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+
+    int listen_fd = -1;
+    int fd;
+    if (sock_path) {
+        listen_fd = open_socket(sock_path);
+        if (listen_fd < 0) {
+            return 1;
+        }
+        fd = -1;
+    } else {
+        fd = open_pty(link);
+        if (fd < 0) {
+            return 1;
+        }
+    }
+
+    static ringbuf_t rx;
+    ringbuf_init(&rx);
+
+    uint64_t start = get_time_ms();
+    uint64_t last_stats = start;
+    uint64_t last_cmd = start;
+    unsigned long due_base = 0;
+
+    while (max_uplinks == 0 || stats.uplinks < max_uplinks || outlen > 0) {
+        if (fd < 0) {
+            fd = accept(listen_fd, NULL, NULL);
+            if (fd < 0) {
+                continue;
+            }
+            fprintf(stderr, "[sim] Client connected\n");
+            ringbuf_init(&rx);
+            outlen = 0;
+            start = get_time_ms();
+            due_base = stats.uplinks;
+        }
+
+        uint64_t now = get_time_ms();
+
+        /* Uplinks are generated on schedule even if the host does not flush */
+        unsigned burst = 0;
+        if (max_uplinks == 0 || stats.uplinks < max_uplinks) {
+            if (rate == 0) {
+                burst = GATESIM_MAX_BURST;
+            } else {
+                unsigned long due = due_base + (now - start) * rate / 1000;
+                if (due > stats.uplinks) {
+                    burst = due - stats.uplinks;
+                }
+            }
+            if (max_uplinks && burst > max_uplinks - stats.uplinks) {
+                burst = max_uplinks - stats.uplinks;
+            }
+        }
+
+        while (burst--) {
+            send_uplink();
+        }
+
+        struct pollfd pfd = { .fd = fd, .events = POLLIN };
+        int timeout = (rate == 0) ? 0 : 10;
+        bool flush = !hold_frames;
+        bool link_lost = false;
+
+        if (poll(&pfd, 1, timeout) > 0) {
+            if (pfd.revents & POLLIN) {
+                ssize_t n = ringbuf_read(&rx, fd);
+                if (n == 0 && sock_path) {
+                    link_lost = true;
+                }
+            }
+            if (pfd.revents & (POLLHUP | POLLERR)) {
+                link_lost = true;
+            }
+
+            char *cmd;
+            unsigned len;
+            bool dropped;
+            while ((cmd = ringbuf_next_frame(&rx, '\r', &len, &dropped)) != NULL) {
+                if (len == 0) {
+                    continue;
+                }
+                last_cmd = now;
+                serve_command(cmd, len);
+                if (cmd[0] == CMD_FLUSH) {
+                    flush = true;
+                }
+            }
+        }
+
+        if (flush && outlen > 0 && !out_flush(fd)) {
+            link_lost = true;
+        }
+
+        if (link_lost) {
+            if (!sock_path) {
+                /* Nobody has the pty open, wait for lora-mqtt to come back */
+                usleep(100000);
+                continue;
+            }
+            fprintf(stderr, "[sim] Client disconnected\n");
+            close(fd);
+            fd = -1;
+            continue;
+        }
+
+        if (now - last_stats >= 1000) {
+            last_stats = now;
+            print_stats();
+        }
+
+        /* All uplinks generated but nobody picks up the rest */
+        if (max_uplinks && stats.uplinks >= max_uplinks && now - last_cmd > GATESIM_IDLE_EXIT) {
+            break;
+        }
+    }
+
+    print_stats();
+
+    if (!sock_path) {
+        unlink(link);
+    } else {
+        unlink(sock_path);
+    }
+
+    return 0;
+}
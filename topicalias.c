@@ -0,0 +1,155 @@
+/* Copyright (c) 2017 Unwired Devices LLC [info@unwds.com]
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+
+
+/**
+ * @defgroup    
+ * @ingroup     
+ * @brief       
+ * @{
+ * @file        topicalias.c
+ * @brief       MQTT v5 topic aliases for the busiest topics
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "topicalias.h"
+
+/* FNV-1a, saves most of the strcmp() calls on lookup */
+static uint32_t topic_hash(const char *topic)
+{
+    uint32_t hash = 2166136261u;
+    while (*topic) {
+        hash ^= (uint8_t)*topic++;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+bool topic_alias_init(topic_alias_t *ta, unsigned max)
+{
+    if (max > UINT16_MAX) {
+        max = UINT16_MAX;
+    }
+
+    ta->slots = (topic_alias_slot_t *)calloc(max ? max : 1, sizeof(topic_alias_slot_t));
+    if (!ta->slots) {
+        return false;
+    }
+
+    ta->max = max;
+    ta->num = 0;
+    ta->used = 0;
+    ta->replaced = 0;
+
+    return pthread_mutex_init(&ta->mutex, NULL) == 0;
+}
+
+void topic_alias_reset(topic_alias_t *ta, unsigned broker_max)
+{
+    pthread_mutex_lock(&ta->mutex);
+
+    ta->num = (broker_max < ta->max) ? broker_max : ta->max;
+    ta->used = 0;
+    ta->replaced = 0;
+
+    pthread_mutex_unlock(&ta->mutex);
+}
+
+/* Takes a free slot or the least used one, returns its index */
+static unsigned take_slot(topic_alias_t *ta)
+{
+    unsigned i, victim = 0;
+
+    if (ta->used < ta->num) {
+        return ta->used++;
+    }
+
+    for (i = 1; i < ta->num; i++) {
+        if (ta->slots[i].hits < ta->slots[victim].hits) {
+            victim = i;
+        }
+    }
+
+    if (++ta->replaced >= ta->num) {
+        ta->replaced = 0;
+        for (i = 0; i < ta->num; i++) {
+            ta->slots[i].hits /= 2;
+        }
+    }
+
+    return victim;
+}
+
+uint16_t topic_alias_get(topic_alias_t *ta, const char *topic, bool *known)
+{
+    uint32_t hash = topic_hash(topic);
+    unsigned i;
+
+    *known = false;
+
+    if (strlen(topic) >= TOPIC_ALIAS_TOPIC_LEN) {
+        return 0;
+    }
+
+    pthread_mutex_lock(&ta->mutex);
+
+    if (!ta->num) {
+        pthread_mutex_unlock(&ta->mutex);
+        return 0;
+    }
+
+    for (i = 0; i < ta->used; i++) {
+        topic_alias_slot_t *slot = &ta->slots[i];
+        if (slot->hash == hash && !strcmp(slot->topic, topic)) {
+            slot->hits++;
+            *known = slot->sent;
+            pthread_mutex_unlock(&ta->mutex);
+            return i + 1;
+        }
+    }
+
+    i = take_slot(ta);
+
+    topic_alias_slot_t *slot = &ta->slots[i];
+    slot->hash = hash;
+    slot->hits = 1;
+    slot->sent = false;
+    strcpy(slot->topic, topic);
+
+    pthread_mutex_unlock(&ta->mutex);
+
+    return i + 1;
+}
+
+void topic_alias_sent(topic_alias_t *ta, uint16_t alias)
+{
+    pthread_mutex_lock(&ta->mutex);
+
+    /* Aliases might have been reset since, by a reconnect */
+    if (alias && alias <= ta->used) {
+        ta->slots[alias - 1].sent = true;
+    }
+
+    pthread_mutex_unlock(&ta->mutex);
+}
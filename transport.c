@@ -0,0 +1,300 @@
+/* Copyright (c) 2017 Unwired Devices LLC [info@unwds.com]
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+/**
+ * @defgroup    
+ * @ingroup     
+ * @brief       
+ * @{
+ * @file        transport.c
+ * @brief       Link to the gate: serial port, TCP or Unix socket
+ */
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include "transport.h"
+#include "utils.h"
+
+static void transport_log(const char *fmt, ...)
+{
+    char buf[TRANSPORT_URI_LEN + 100];
+    va_list ap;
+
+    va_start(ap, fmt);
+    vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+
+    logprint(buf);
+}
+
+static int set_interface_attribs (int fd, int speed, int parity)
+{
+        struct termios tty;
+        memset (&tty, 0, sizeof tty);
+        if (tcgetattr (fd, &tty) != 0)
+        {
+                fprintf(stderr, "error %d from tcgetattr", errno);
+                return -1;
+        }
+
+        cfsetospeed (&tty, speed);
+        cfsetispeed (&tty, speed);
+
+        tty.c_cflag = (tty.c_cflag & ~CSIZE) | CS8;     // 8-bit chars
+        // disable IGNBRK for mismatched speed tests; otherwise receive break
+        // as \000 chars
+        // tty.c_iflag &= ~IGNBRK;         // disable break processing
+        tty.c_iflag |= IGNBRK;         // disable break processing
+        tty.c_lflag = 0;                // no signaling chars, no echo,
+                                        // no canonical processing
+        tty.c_oflag = 0;                // no remapping, no delays
+        tty.c_cc[VMIN]  = 0;            // read doesn't block
+        tty.c_cc[VTIME] = 5;            // 0.5 seconds read timeout
+
+        tty.c_iflag &= ~(IXON | IXOFF | IXANY); // shut off xon/xoff ctrl
+
+        tty.c_cflag |= (CLOCAL | CREAD);// ignore modem controls,
+                                        // enable reading
+        tty.c_cflag &= ~(PARENB | PARODD);      // shut off parity
+        tty.c_cflag |= parity;
+        tty.c_cflag &= ~CSTOPB;
+        tty.c_cflag &= ~CRTSCTS;
+
+        if (tcsetattr (fd, TCSANOW, &tty) != 0)
+        {
+                fprintf(stderr, "error %d from tcsetattr\n", errno);
+                return -1;
+        }
+        return 0;
+}
+
+static void set_blocking (int fd, int should_block)
+{
+        struct termios tty;
+        memset (&tty, 0, sizeof tty);
+        if (tcgetattr (fd, &tty) != 0)
+        {
+                fprintf(stderr, "error %d from tggetattr", errno);
+                return;
+        }
+
+        tty.c_cc[VMIN]  = should_block ? 1 : 0;
+        tty.c_cc[VTIME] = 5;            // 0.5 seconds read timeout
+
+        if (tcsetattr (fd, TCSANOW, &tty) != 0)
+                fprintf(stderr, "error %d setting term attributes", errno);
+}
+
+static int baudrate(int baud)
+{
+    switch (baud) {
+        case 9600:   return B9600;
+        case 19200:  return B19200;
+        case 38400:  return B38400;
+        case 57600:  return B57600;
+        case 115200: return B115200;
+        case 230400: return B230400;
+        case 460800: return B460800;
+        case 921600: return B921600;
+        default:     return -1;
+    }
+}
+
+static int serial_open(transport_t *t)
+{
+    char path[TRANSPORT_URI_LEN];
+    int speed = B115200;
+
+    strcpy(path, t->uri);
+
+    /* /dev/ttyUSB0@57600 */
+    char *at = strrchr(path, '@');
+    if (at) {
+        *at = '\0';
+        speed = baudrate(atoi(at + 1));
+        if (speed < 0) {
+            transport_log("[error] Unsupported baudrate: %s\n", at + 1);
+            return -1;
+        }
+    }
+
+    int fd = open(path, O_RDWR | O_NOCTTY | O_SYNC);
+    if (fd < 0) {
+        transport_log("error %d opening %s: %s\n", errno, path, strerror (errno));
+        return -1;
+    }
+    
+    set_interface_attribs(fd, speed, 0);  // set speed, 8n1 (no parity)
+    set_blocking(fd, 0);                  // set no blocking
+
+    return fd;
+}
+
+static int tcp_open(transport_t *t)
+{
+    char host[TRANSPORT_URI_LEN];
+
+    /* tcp://host:port */
+    strcpy(host, t->uri + strlen("tcp://"));
+    char *port = strrchr(host, ':');
+    if (!port) {
+        transport_log("[error] No TCP port given in %s\n", t->uri);
+        return -1;
+    }
+    *port++ = '\0';
+
+    struct addrinfo hints, *res, *ai;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    int err = getaddrinfo(host, port, &hints, &res);
+    if (err) {
+        transport_log("[error] Unable to resolve %s: %s\n", host, gai_strerror(err));
+        return -1;
+    }
+
+    int fd = -1;
+    for (ai = res; ai != NULL; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, ai->ai_protocol);
+        if (fd < 0) {
+            continue;
+        }
+
+        if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) {
+            break;
+        }
+
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(res);
+
+    if (fd < 0) {
+        transport_log("error %d connecting to %s: %s\n", errno, t->uri, strerror (errno));
+        return -1;
+    }
+
+    /* Commands are short, don't let Nagle hold them back */
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, &one, sizeof(one));
+
+    return fd;
+}
+
+static int unix_open(transport_t *t)
+{
+    struct sockaddr_un addr;
+    const char *path = t->uri + strlen("unix:");
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        transport_log("[error] Socket path is too long: %s\n", path);
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        transport_log("error %d connecting to %s: %s\n", errno, t->uri, strerror (errno));
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+static int null_open(transport_t *t)
+{
+    (void) t;
+    return open("/dev/null", O_RDWR | O_CLOEXEC);
+}
+
+static const transport_ops_t serial_ops = { "serial", serial_open, false };
+static const transport_ops_t tcp_ops = { "tcp", tcp_open, true };
+static const transport_ops_t unix_ops = { "unix", unix_open, true };
+static const transport_ops_t null_ops = { "null", null_open, false };
+
+bool transport_init(transport_t *t, const char *uri)
+{
+    if (strlen(uri) >= TRANSPORT_URI_LEN) {
+        transport_log("Error: serial device URI is too long\n");
+        return false;
+    }
+
+    strcpy(t->uri, uri);
+    t->fd = -1;
+
+    if (!strncmp(uri, "tcp://", strlen("tcp://"))) {
+        t->ops = &tcp_ops;
+    } else if (!strncmp(uri, "unix:", strlen("unix:"))) {
+        t->ops = &unix_ops;
+    } else if (!strcmp(uri, "null:")) {
+        t->ops = &null_ops;
+    } else {
+        t->ops = &serial_ops;
+    }
+
+    return true;
+}
+
+int transport_open(transport_t *t)
+{
+    t->fd = t->ops->open(t);
+    return t->fd;
+}
+
+bool transport_reopen(transport_t *t)
+{
+    int fd = t->ops->open(t);
+    if (fd < 0) {
+        return false;
+    }
+
+    /* Atomically replaces the broken link, writer keeps using the same fd */
+    if (dup2(fd, t->fd) < 0) {
+        close(fd);
+        return false;
+    }
+    close(fd);
+
+    transport_log("[gate] Reconnected to %s", t->uri);
+
+    return true;
+}
@@ -26,206 +26,861 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <inttypes.h>
+#include <pthread.h>
 #include <time.h>
 #include <sys/time.h>
 
 #include "utils.h"
+#include "jsonbuf.h"
+#include "packbuf.h"
+#include "pubq.h"
+#include "framectx.h"
+#include "timestamp.h"
 #include "unwds-modules.h"
 
 bool mqtt_retain = false;
 bool mqtt_sepio = false;
 int mqtt_qos = 1;
+int mqtt_version = MQTT_PROTOCOL_V311;
+unsigned mqtt_expiry = 0;
+bool mqtt_user_props = false;
+topic_alias_t *mqtt_aliases = NULL;
+pubq_t *mqtt_pubq = NULL;
+
+const char *mqtt_msg_strdup(mqtt_msg_t *mqtt_msg, const char *str)
+{
+    size_t len = strlen(str) + 1;
+    if (mqtt_msg->strings_len + len > sizeof(mqtt_msg->strings)) {
+        return NULL;
+    }
+
+    char *copy = mqtt_msg->strings + mqtt_msg->strings_len;
+    memcpy(copy, str, len);
+    mqtt_msg->strings_len += len;
+
+    return copy;
+}
+
+static mqtt_value_t *add_value(mqtt_msg_t *mqtt_msg, const char *name, mqtt_value_type_t type)
+{
+    if (!name || mqtt_msg->num >= MQTT_MSG_MAX_NUM) {
+        return NULL;
+    }
+
+    mqtt_value_t *value = &mqtt_msg->values[mqtt_msg->num++];
+    value->name = name;
+    value->type = type;
+    value->precision = 0;
+
+    return value;
+}
+
+static void add_text(mqtt_msg_t *mqtt_msg, const char *name, const char *str, mqtt_value_type_t type)
+{
+    uint16_t strings_len = mqtt_msg->strings_len;
+
+    const char *copy = mqtt_msg_strdup(mqtt_msg, str);
+    mqtt_value_t *value = copy ? add_value(mqtt_msg, name, type) : NULL;
+    if (!value) {
+        mqtt_msg->strings_len = strings_len;
+        return;
+    }
+    value->str = copy;
+}
 
-static int mqtt_mid = 0;
- 
 void add_value_pair(mqtt_msg_t *mqtt_msg, const char *name, const char *value)
 {
-    uint8_t i = 0;
-    
-    for (i = 0; i < MQTT_MSG_MAX_NUM; i++) {
-        if (mqtt_msg[i].name[0] == 0) {
-            strcat(mqtt_msg[i].name, name);
-            strcat(mqtt_msg[i].value, value);
-            return;
+    uint16_t strings_len = mqtt_msg->strings_len;
+
+    const char *name_copy = mqtt_msg_strdup(mqtt_msg, name);
+    const char *copy = name_copy ? mqtt_msg_strdup(mqtt_msg, value) : NULL;
+    mqtt_value_t *val = copy ? add_value(mqtt_msg, name_copy, MQTT_VALUE_TEXT) : NULL;
+    if (!val) {
+        mqtt_msg->strings_len = strings_len;
+        return;
+    }
+    val->str = copy;
+}
+
+void add_int_value(mqtt_msg_t *mqtt_msg, const char *name, int32_t val)
+{
+    mqtt_value_t *value = add_value(mqtt_msg, name, MQTT_VALUE_INT);
+    if (value) {
+        value->i = val;
+    }
+}
+
+void add_uint_value(mqtt_msg_t *mqtt_msg, const char *name, uint32_t val)
+{
+    mqtt_value_t *value = add_value(mqtt_msg, name, MQTT_VALUE_UINT);
+    if (value) {
+        value->u = val;
+    }
+}
+
+void add_fixed_value(mqtt_msg_t *mqtt_msg, const char *name, int32_t val, uint8_t precision)
+{
+    mqtt_value_t *value = add_value(mqtt_msg, name, MQTT_VALUE_FIXED);
+    if (value) {
+        value->i = val;
+        value->precision = precision;
+    }
+}
+
+void add_float_value(mqtt_msg_t *mqtt_msg, const char *name, double val, uint8_t precision)
+{
+    mqtt_value_t *value = add_value(mqtt_msg, name, MQTT_VALUE_FLOAT);
+    if (value) {
+        value->f = val;
+        value->precision = precision;
+    }
+}
+
+void add_string_value(mqtt_msg_t *mqtt_msg, const char *name, const char *val)
+{
+    add_text(mqtt_msg, name, val, MQTT_VALUE_STRING);
+}
+
+void add_raw_value(mqtt_msg_t *mqtt_msg, const char *name, const char *json)
+{
+    add_text(mqtt_msg, name, json, MQTT_VALUE_RAW);
+}
+
+static const char *format_names[] = {
+    [UNWDS_MQTT_REGULAR] = "mqtt",
+    [UNWDS_MQTT_ESCAPED] = "mqtt-escaped",
+    [UNWDS_MQTT_CBOR] = "cbor",
+    [UNWDS_MQTT_MSGPACK] = "msgpack",
+};
+
+bool mqtt_format_by_name(const char *name, mqtt_format_t *format)
+{
+    unsigned i;
+    for (i = 0; i < sizeof(format_names) / sizeof(format_names[0]); i++) {
+        if (name && !strcmp(name, format_names[i])) {
+            *format = (mqtt_format_t) i;
+            return true;
         }
     }
+    return false;
 }
 
-static void mqtt_escape_quotes(char *msg) {
-    char *buf = (char *)malloc(MQTT_MAX_MSG_SIZE);
-    memset(buf, 0, MQTT_MAX_MSG_SIZE);
-    
-    char *ptr;
-    ptr = strtok(msg, "\"");
-    
-    do {
-        strcat(buf, ptr);
-        strcat(buf, "\\\"");
-        ptr = strtok(NULL, "\"");
-    } while (ptr);
-    
-    strcpy(msg, buf);
-    free(buf);
+const char *mqtt_format_name(mqtt_format_t format)
+{
+    if ((unsigned) format < sizeof(format_names) / sizeof(format_names[0])) {
+        return format_names[format];
+    }
+    return "?";
 }
 
-void publish_mqtt_message(struct mosquitto *mosq, const char *addr, const char *topic, char *msg, const mqtt_format_t format) {
-    if (!mosq) {
+static bool is_binary(mqtt_format_t format)
+{
+    return format == UNWDS_MQTT_CBOR || format == UNWDS_MQTT_MSGPACK;
+}
+
+size_t mqtt_topic_prefix(char *prefix, const char *addr)
+{
+    size_t addr_len = strnlen(addr, 16);
+    size_t len = sizeof(MQTT_PUBLISH_TO) - 1;
+
+    memcpy(prefix, MQTT_PUBLISH_TO, len);
+    memcpy(prefix + len, addr, addr_len);
+    len += addr_len;
+    prefix[len++] = '/';
+    if (mqtt_sepio) {
+        memcpy(prefix + len, "miso/", 5);
+        len += 5;
+    }
+    prefix[len] = '\0';
+
+    return len;
+}
+
+void publish_mqtt_message(struct mosquitto *mosq, const char *addr, const char *topic, const char *msg, size_t len,
+                          const mqtt_format_t format) {
+    char prefix[MQTT_TOPIC_PREFIX_LEN];
+    size_t prefix_len = mqtt_topic_prefix(prefix, addr);
+    mqtt_props_t props = { .format = format };
+
+    publish_mqtt_topic(mosq, prefix, prefix_len, topic, msg, len, &props);
+}
+
+void publish_mqtt_topic(struct mosquitto *mosq, const char *prefix, size_t prefix_len, const char *topic,
+                        const char *msg, size_t len, const mqtt_props_t *props) {
+    mqtt_format_t format = props->format;
+
+    if (!mosq && !mqtt_pubq) {
         return;
     }
-       
-    // Append an MQTT topic path to the topic from the reply
-    char *mqtt_topic = (char *)malloc(strlen(MQTT_PUBLISH_TO) + strlen(addr) + strlen(topic) + strlen("/miso") + 1);
 
-    strcpy(mqtt_topic, MQTT_PUBLISH_TO);
-    strcat(mqtt_topic, addr);
-    strcat(mqtt_topic, "/");
-    if (mqtt_sepio) {
-        strcat(mqtt_topic, "miso/");
+    frame_ctx_t *ctx = frame_ctx_get();
+    if (!ctx) {
+        puts("[error] Unable to allocate memory");
+        return;
     }
-    strcat(mqtt_topic, topic);
-    
-    if (format == UNWDS_MQTT_ESCAPED) {
-        mqtt_escape_quotes(msg);
+
+    // Append the topic from the reply to the device topic prefix
+    char *mqtt_topic = ctx->mqtt_topic;
+    size_t topic_len = strlen(topic);
+    if (prefix_len + topic_len >= sizeof(ctx->mqtt_topic)) {
+        puts("[error] MQTT topic is too long");
+        return;
     }
+    memcpy(mqtt_topic, prefix, prefix_len);
+    memcpy(mqtt_topic + prefix_len, topic, topic_len + 1);
     
-    char *logbuf = (char *) malloc(MQTT_MAX_MSG_SIZE + 50);
-    snprintf(logbuf, MQTT_MAX_MSG_SIZE + 50, "[mqtt] Publishing to the topic %s the message \"%s\"\n", mqtt_topic, msg);
+    char *logbuf = ctx->logbuf;
+    if (is_binary(format)) {
+        snprintf(logbuf, FRAME_LOGBUF_LEN, "[mqtt] Publishing to the topic %s %zu bytes of %s\n",
+                 mqtt_topic, len, mqtt_format_name(format));
+    } else {
+        snprintf(logbuf, FRAME_LOGBUF_LEN, "[mqtt] Publishing to the topic %s the message \"%s\"\n", mqtt_topic, msg);
+    }
     logprint(logbuf);
 
-    int res = mosquitto_publish(mosq, &mqtt_mid, mqtt_topic, strlen(msg), msg, mqtt_qos, mqtt_retain);
-    
+    publish_mqtt_raw(mosq, mqtt_topic, msg, len, props);
+}
+
+void publish_mqtt_raw(struct mosquitto *mosq, const char *topic, const void *payload, size_t len,
+                      const mqtt_props_t *props)
+{
+    if (!mqtt_pubq) {
+        if (mosq) {
+            mqtt_send(mosq, NULL, topic, payload, len, props);
+        }
+        return;
+    }
+
+    /* Properties are only needed for MQTT v5 */
+    size_t props_len = (props && mqtt_version == MQTT_PROTOCOL_V5) ? sizeof(*props) : 0;
+    if (!pubq_push(mqtt_pubq, topic, payload, len, props, props_len)) {
+        logprint("[mqtt] Error: publish queue is full, message dropped\n");
+    }
+}
+
+static const char *content_types[] = {
+    [UNWDS_MQTT_REGULAR] = "application/json",
+    [UNWDS_MQTT_ESCAPED] = "text/plain",
+    [UNWDS_MQTT_CBOR] = "application/cbor",
+    [UNWDS_MQTT_MSGPACK] = "application/msgpack",
+};
+
+/* Seconds the uplink has left to live, 0 if it's stale already */
+static uint32_t uplink_expiry(const mqtt_props_t *props)
+{
+    struct timeval now;
+    gettimeofday(&now, NULL);
+
+    /* Broker counts from now, the uplink may have waited in the queue */
+    long age = now.tv_sec - props->rx_time.tv_sec;
+    if (age < 0) {
+        age = 0;
+    }
+    return (age < (long)mqtt_expiry) ? mqtt_expiry - age : 0;
+}
+
+static void add_uplink_props(mosquitto_property **proplist, const mqtt_props_t *props)
+{
+    char val[24];
+
+    snprintf(val, sizeof(val), "%u", props->modid);
+    mosquitto_property_add_string_pair(proplist, MQTT_PROP_USER_PROPERTY, "module", val);
+    snprintf(val, sizeof(val), "%d", props->rssi);
+    mosquitto_property_add_string_pair(proplist, MQTT_PROP_USER_PROPERTY, "rssi", val);
+    snprintf(val, sizeof(val), "%" PRIu64, (uint64_t) props->rx_time.tv_sec * 1000000 + props->rx_time.tv_usec);
+    mosquitto_property_add_string_pair(proplist, MQTT_PROP_USER_PROPERTY, "time", val);
+}
+
+static int mqtt_send_v5(struct mosquitto *mosq, int *mid, const char *topic, const void *payload, size_t len,
+                        const mqtt_props_t *props, uint32_t expiry)
+{
+    mosquitto_property *proplist = NULL;
+
+    if (expiry) {
+        mosquitto_property_add_int32(&proplist, MQTT_PROP_MESSAGE_EXPIRY_INTERVAL, expiry);
+    }
+
+    if (props && mqtt_user_props) {
+        if ((unsigned) props->format < sizeof(content_types) / sizeof(content_types[0])) {
+            mosquitto_property_add_string(&proplist, MQTT_PROP_CONTENT_TYPE, content_types[props->format]);
+        }
+        if (props->uplink) {
+            add_uplink_props(&proplist, props);
+        }
+    }
+
+    /* Topic goes once with its alias, the alias alone afterwards */
+    bool known = false;
+    uint16_t alias = mqtt_aliases ? topic_alias_get(mqtt_aliases, topic, &known) : 0;
+    if (alias) {
+        mosquitto_property_add_int16(&proplist, MQTT_PROP_TOPIC_ALIAS, alias);
+    }
+
+    int res = mosquitto_publish_v5(mosq, mid, known ? NULL : topic, len, payload, mqtt_qos, mqtt_retain, proplist);
+    if (res == MOSQ_ERR_SUCCESS && alias && !known) {
+        topic_alias_sent(mqtt_aliases, alias);
+    }
+
+    mosquitto_property_free_all(&proplist);
+    return res;
+}
+
+int mqtt_send(struct mosquitto *mosq, int *mid, const char *topic, const void *payload, size_t len,
+              const mqtt_props_t *props)
+{
+    char logbuf[100];
+
+    int msg_mid = 0;
+    int res;
+    if (mid) {
+        *mid = 0;
+    }
+
+    if (mqtt_version == MQTT_PROTOCOL_V5) {
+        uint32_t expiry = 0;
+        if (mqtt_expiry && props && props->uplink) {
+            expiry = uplink_expiry(props);
+            if (!expiry) {
+                logprint("[mqtt] Uplink is older than the message expiry, dropped\n");
+                return MOSQ_ERR_SUCCESS;
+            }
+        }
+        res = mqtt_send_v5(mosq, &msg_mid, topic, payload, len, props, expiry);
+    } else {
+        res = mosquitto_publish(mosq, &msg_mid, topic, len, payload, mqtt_qos, mqtt_retain);
+    }
+
+    if (mid && res == MOSQ_ERR_SUCCESS) {
+        *mid = msg_mid;
+    }
+
     switch (res) {
         case MOSQ_ERR_SUCCESS:
-            snprintf(logbuf, MQTT_MAX_MSG_SIZE + 50, "[mqtt] Message published successfully\n");
+            snprintf(logbuf, sizeof(logbuf), "[mqtt] Message published successfully\n");
             break;
         case MOSQ_ERR_INVAL:
-            snprintf(logbuf, MQTT_MAX_MSG_SIZE + 50, "[mqtt] Error: invalid input\n");
+            snprintf(logbuf, sizeof(logbuf), "[mqtt] Error: invalid input\n");
             break;
         case MOSQ_ERR_NOMEM:
-            snprintf(logbuf, MQTT_MAX_MSG_SIZE + 50, "[mqtt] Error: out of memory\n");
+            snprintf(logbuf, sizeof(logbuf), "[mqtt] Error: out of memory\n");
             break;
         case MOSQ_ERR_NO_CONN:
-            snprintf(logbuf, MQTT_MAX_MSG_SIZE + 50, "[mqtt] Error: not connected\n");
+            snprintf(logbuf, sizeof(logbuf), "[mqtt] Error: not connected\n");
             break;
         case MOSQ_ERR_PROTOCOL:
-            snprintf(logbuf, MQTT_MAX_MSG_SIZE + 50, "[mqtt] Error: protocol error\n");
+            snprintf(logbuf, sizeof(logbuf), "[mqtt] Error: protocol error\n");
             break;
         case MOSQ_ERR_PAYLOAD_SIZE:
-            snprintf(logbuf, MQTT_MAX_MSG_SIZE + 50, "[mqtt] Error: payload too large\n");
+            snprintf(logbuf, sizeof(logbuf), "[mqtt] Error: payload too large\n");
+            break;
+        default:
+            snprintf(logbuf, sizeof(logbuf), "[mqtt] Error: %s\n", mosquitto_strerror(res));
             break;
     }
     logprint(logbuf);
-    free(logbuf);
-    free(mqtt_topic);
+
+    return res;
 }
 
-void build_mqtt_message(char *msg, const mqtt_msg_t *mqtt_msg, const mqtt_status_t status, const char *addr) {   
-    bool needs_quotes = 0;
-    
-    strcpy(msg, "{ \"data\": { ");
-    
-    uint8_t i = 0;
-    for (i = 0; i < MQTT_MSG_MAX_NUM; i++) {
-        if (mqtt_msg[i].name[0] == 0) {
-            strcat(msg, " }");
-            break;
-        }
-        
-        if (i != 0) {
-            strcat(msg, ", ");
-        }
-        
-        strcat(msg, "\"");
-        strcat(msg, mqtt_msg[i].name);
-        strcat(msg, "\": ");
-        
-        char *endptr = NULL;
-        strtof(mqtt_msg[i].value, &endptr);
-        
-        int len = strlen(mqtt_msg[i].value);
-        
-        /* numbers in JSON do not need to be escaped in quotes */
-        if ( &mqtt_msg[i].value[len] == endptr  ) {
-            needs_quotes = 0;
-        } else {
-            needs_quotes = 1;
+static void json_values(jsonbuf_t *jb, const mqtt_msg_t *mqtt_msg)
+{
+    uint8_t i;
+    for (i = 0; i < mqtt_msg->num; i++) {
+        const mqtt_value_t *value = &mqtt_msg->values[i];
+        switch (value->type) {
+            case MQTT_VALUE_TEXT:
+                jsonbuf_value(jb, value->name, value->str);
+                break;
+            case MQTT_VALUE_INT:
+                jsonbuf_int(jb, value->name, value->i);
+                break;
+            case MQTT_VALUE_UINT:
+                jsonbuf_uint(jb, value->name, value->u);
+                break;
+            case MQTT_VALUE_FIXED:
+                jsonbuf_fixed(jb, value->name, value->i, value->precision);
+                break;
+            case MQTT_VALUE_FLOAT:
+                jsonbuf_float(jb, value->name, value->f, value->precision);
+                break;
+            case MQTT_VALUE_STRING:
+                jsonbuf_string(jb, value->name, value->str);
+                break;
+            case MQTT_VALUE_RAW:
+                jsonbuf_raw(jb, value->name, value->str);
+                break;
         }
-        
-        /* sublasses do not need to be escaped */
-        if ((mqtt_msg[i].value[0] == '{') && (mqtt_msg[i].value[len - 1] == '}')) {
-            needs_quotes = 0;
+    }
+}
+
+static size_t json_mqtt_message(char *msg, const mqtt_msg_t *mqtt_msg, const mqtt_status_t status, const char *addr,
+                                const struct timeval *date, mqtt_format_t format) {
+    jsonbuf_t jb;
+    jsonbuf_init(&jb, msg, MQTT_MAX_MSG_SIZE);
+    jsonbuf_escape_quotes(&jb, format == UNWDS_MQTT_ESCAPED);
+
+    jsonbuf_begin_object(&jb, NULL);
+    jsonbuf_begin_object(&jb, "data");
+    json_values(&jb, mqtt_msg);
+    jsonbuf_end_object(&jb);
+
+    jsonbuf_begin_object(&jb, "status");
+    jsonbuf_string_key(&jb, "\"devEUI\" : ", addr);
+    jsonbuf_int(&jb, "rssi", status.rssi);
+    jsonbuf_int(&jb, "temperature", status.temperature);
+    jsonbuf_int(&jb, "battery", status.battery);
+
+    char buf[TIMESTAMP_ISO8601_LEN];
+    timestamp_iso8601(date, buf, sizeof(buf));
+    jsonbuf_string(&jb, "date", buf);
+
+    jsonbuf_end_object(&jb);
+    jsonbuf_end_object(&jb);
+
+    if (jsonbuf_overflow(&jb)) {
+        puts("[error] MQTT message is too long, some values are dropped");
+    }
+
+    return jsonbuf_len(&jb);
+}
+
+/* Keys of the binary message, see README */
+enum {
+    PACK_KEY_DATA = 0,
+    PACK_KEY_DEVEUI,
+    PACK_KEY_RSSI,
+    PACK_KEY_TEMPERATURE,
+    PACK_KEY_BATTERY,
+    PACK_KEY_DATE,
+    PACK_NUM_KEYS,
+};
+
+typedef struct {
+    bool is_int;
+    uint8_t precision;
+    long long i;
+    double f;
+} text_number_t;
+
+/* Parses decoder text which JSON takes for a number */
+static bool parse_number(const char *text, text_number_t *num)
+{
+    if (!text[0] || !jsonbuf_is_number(text)) {
+        return false;
+    }
+
+    char *end;
+    errno = 0;
+    num->i = strtoll(text, &end, 10);
+    num->is_int = (*end == '\0' && !errno);
+    if (num->is_int) {
+        return true;
+    }
+
+    num->f = strtod(text, &end);
+    if (*end != '\0' || !isfinite(num->f)) {
+        return false;
+    }
+
+    const char *point = strchr(text, '.');
+    num->precision = 9;
+    if (point && !strpbrk(point, "eE")) {
+        num->precision = strlen(point + 1);
+    }
+    return true;
+}
+
+static bool pack_number(packbuf_t *pb, const char *text)
+{
+    text_number_t num;
+    if (!parse_number(text, &num)) {
+        return false;
+    }
+
+    if (num.is_int) {
+        packbuf_int(pb, num.i);
+    } else {
+        packbuf_float(pb, num.f, num.precision);
+    }
+    return true;
+}
+
+/* Array of numbers as decoders write it, "[ 1, 2, 3 ]" */
+static bool pack_array(packbuf_t *pb, const char *text)
+{
+    size_t len = strlen(text);
+    if (len < 2 || text[0] != '[' || text[len - 1] != ']') {
+        return false;
+    }
+
+    /* Elements are checked and counted first, as the count goes before them */
+    char item[32];
+    uint32_t num = 0;
+    int pass;
+    for (pass = 0; pass < 2; pass++) {
+        const char *ptr = text + 1;
+        const char *end = text + len - 1;
+
+        if (pass) {
+            packbuf_array(pb, num);
         }
-        
-        /* arrays do not need to be escaped */
-        if ((mqtt_msg[i].value[0] == '[') && (mqtt_msg[i].value[len - 1] == ']')) {
-            needs_quotes = 0;
+
+        while (ptr < end) {
+            ptr += strspn(ptr, " ");
+            size_t item_len = strcspn(ptr, ",]");
+            while (item_len && ptr[item_len - 1] == ' ') {
+                item_len--;
+            }
+
+            /* empty array or trailing comma */
+            if (!item_len && ptr + strspn(ptr, ", ") >= end) {
+                break;
+            }
+            if (!item_len || item_len >= sizeof(item)) {
+                return false;
+            }
+
+            memcpy(item, ptr, item_len);
+            item[item_len] = '\0';
+            if (pass) {
+                pack_number(pb, item);
+            } else {
+                text_number_t parsed;
+                if (!parse_number(item, &parsed)) {
+                    return false;
+                }
+                num++;
+            }
+
+            ptr += strcspn(ptr, ",]");
+            if (*ptr == ',') {
+                ptr++;
+            }
         }
-        
-        /* elements INSIDE sublass or array MUST be escaped manually if needed */
-        
-        /* leading zeros are not allowed for regular numbers in JSON */
-        if ((mqtt_msg[i].value[0] == '0') && (mqtt_msg[i].value[1] != '.') && (mqtt_msg[i].value[1] != 0)) {
-            needs_quotes = 1;
+    }
+
+    return true;
+}
+
+/* Decoder text goes as a number or an array of numbers where JSON would
+ * have them, as text otherwise */
+static void pack_text(packbuf_t *pb, const char *text)
+{
+    if (!pack_number(pb, text) && !pack_array(pb, text)) {
+        packbuf_string(pb, text);
+    }
+}
+
+static void pack_float(packbuf_t *pb, double val, uint8_t precision)
+{
+    /* same values as jsonbuf_float() writes null for */
+    if (!isfinite(val) || fabs(val) >= 1e30) {
+        packbuf_nil(pb);
+        return;
+    }
+    packbuf_float(pb, val, precision);
+}
+
+/* Writes values as a map, values which don't fit are dropped.
+ * Returns false if some were. */
+static bool pack_values(packbuf_t *pb, const mqtt_msg_t *mqtt_msg)
+{
+    size_t map = packbuf_map_begin(pb);
+    if (packbuf_overflow(pb)) {
+        return false;
+    }
+
+    bool complete = true;
+    uint16_t num = 0;
+    uint8_t i;
+    for (i = 0; i < mqtt_msg->num; i++) {
+        const mqtt_value_t *value = &mqtt_msg->values[i];
+        size_t mark = packbuf_len(pb);
+
+        packbuf_string(pb, value->name);
+        switch (value->type) {
+            case MQTT_VALUE_TEXT:
+                pack_text(pb, value->str);
+                break;
+            case MQTT_VALUE_INT:
+                packbuf_int(pb, value->i);
+                break;
+            case MQTT_VALUE_UINT:
+                packbuf_uint(pb, value->u);
+                break;
+            case MQTT_VALUE_FIXED:
+                if (value->precision) {
+                    pack_float(pb, value->i / pow(10, value->precision), value->precision);
+                } else {
+                    packbuf_int(pb, value->i);
+                }
+                break;
+            case MQTT_VALUE_FLOAT:
+                pack_float(pb, value->f, value->precision);
+                break;
+            case MQTT_VALUE_STRING:
+                packbuf_string(pb, value->str);
+                break;
+            case MQTT_VALUE_RAW:
+                if (!pack_array(pb, value->str)) {
+                    packbuf_string(pb, value->str);
+                }
+                break;
         }
-        
-        if (needs_quotes) {
-            strcat(msg, "\"");
+
+        if (packbuf_overflow(pb)) {
+            packbuf_truncate(pb, mark);
+            complete = false;
+            continue;
         }
-        strcat(msg, mqtt_msg[i].value);
-        if (needs_quotes) {
-            strcat(msg, "\"");
+        num++;
+    }
+
+    packbuf_map_end(pb, map, num);
+    return complete;
+}
+
+static size_t pack_mqtt_message(char *msg, const mqtt_msg_t *mqtt_msg, const mqtt_status_t status, const char *addr,
+                                const struct timeval *date, packbuf_format_t format) {
+    packbuf_t pb;
+    packbuf_init(&pb, format, msg, MQTT_MAX_MSG_SIZE);
+
+    packbuf_map(&pb, PACK_NUM_KEYS);
+
+    uint8_t eui[8];
+    packbuf_uint(&pb, PACK_KEY_DEVEUI);
+    if (hex_decode(addr, strlen(addr), eui, sizeof(eui), false) == sizeof(eui)) {
+        packbuf_bytes(&pb, eui, sizeof(eui));
+    } else {
+        packbuf_string(&pb, addr);
+    }
+
+    packbuf_uint(&pb, PACK_KEY_RSSI);
+    packbuf_int(&pb, status.rssi);
+    packbuf_uint(&pb, PACK_KEY_TEMPERATURE);
+    packbuf_int(&pb, status.temperature);
+    packbuf_uint(&pb, PACK_KEY_BATTERY);
+    packbuf_int(&pb, status.battery);
+    packbuf_uint(&pb, PACK_KEY_DATE);
+    packbuf_uint(&pb, (uint64_t) date->tv_sec * 1000000 + date->tv_usec);
+
+    /* Data goes last, so values that don't fit can be dropped */
+    packbuf_uint(&pb, PACK_KEY_DATA);
+    if (!pack_values(&pb, mqtt_msg)) {
+        puts("[error] MQTT message is too long, some values are dropped");
+    }
+
+    return packbuf_len(&pb);
+}
+
+size_t build_mqtt_message(char *msg, const mqtt_msg_t *mqtt_msg, const mqtt_status_t status, const char *addr,
+                          const struct timeval *date, mqtt_format_t format) {
+    struct timeval now;
+    if (!date) {
+        gettimeofday(&now, NULL);
+        date = &now;
+    }
+
+    switch (format) {
+        case UNWDS_MQTT_CBOR:
+            return pack_mqtt_message(msg, mqtt_msg, status, addr, date, PACKBUF_CBOR);
+        case UNWDS_MQTT_MSGPACK:
+            return pack_mqtt_message(msg, mqtt_msg, status, addr, date, PACKBUF_MSGPACK);
+        default:
+            return json_mqtt_message(msg, mqtt_msg, status, addr, date, format);
+    }
+}
+
+size_t build_mqtt_values(char *msg, const mqtt_msg_t *mqtt_msg, mqtt_format_t format)
+{
+    if (is_binary(format)) {
+        packbuf_t pb;
+        packbuf_init(&pb, format == UNWDS_MQTT_CBOR ? PACKBUF_CBOR : PACKBUF_MSGPACK, msg, MQTT_MAX_MSG_SIZE);
+        if (!pack_values(&pb, mqtt_msg)) {
+            puts("[error] MQTT message is too long, some values are dropped");
         }
+        return packbuf_len(&pb);
     }
+
+    jsonbuf_t jb;
+    jsonbuf_init(&jb, msg, MQTT_MAX_MSG_SIZE);
+    jsonbuf_escape_quotes(&jb, format == UNWDS_MQTT_ESCAPED);
+    jsonbuf_begin_object(&jb, NULL);
+    json_values(&jb, mqtt_msg);
+    jsonbuf_end_object(&jb);
+
+    if (jsonbuf_overflow(&jb)) {
+        puts("[error] MQTT message is too long, some values are dropped");
+    }
+
+    return jsonbuf_len(&jb);
+}
+
+/**
+ * Decodes REPLY_IND application data into the topic and message
+ */
+size_t convert_uplink(char *str, const char *addr, const struct timeval *rx_time, mqtt_format_t format,
+                      const char **topic, char *msg, mqtt_props_t *props)
+{
+    char logbuf[REPLY_LEN + 100];
+
+    int16_t rssi;
+    if (!hex_to_bytesn(str, 4, (uint8_t *) &rssi, !is_big_endian())) {
+        snprintf(logbuf, sizeof(logbuf), "[error] Unable to parse RSSI from gate reply: %s\n", str);
+        logprint(logbuf);
+        return 0;
+    }
+
+    /* Skip RSSI hex */
+    str += 4;
     
-    char buf[50];
-    strcat(msg, ", \"status\": { \"devEUI\" : ");
-    snprintf(buf, sizeof(buf), "\"%s\"", addr);
-    strcat(msg, buf);
-    
-    strcat(msg, ", \"rssi\": ");
-    snprintf(buf, sizeof(buf), "%d", status.rssi);
-    strcat(msg, buf);
+    uint8_t status;
+    if (!hex_to_bytesn(str, 2, &status, !is_big_endian())) {
+        snprintf(logbuf, sizeof(logbuf), "[error] Unable to parse status from gate reply: %s\n", str);
+        logprint(logbuf);
+        return 0;
+    }
     
-    strcat(msg, ", \"temperature\": ");
-    snprintf(buf, sizeof(buf), "%d", status.temperature);
-    strcat(msg, buf);
+    /* Skip status hex */
+    str += 2;
+
+    frame_ctx_t *ctx = frame_ctx_get();
+    if (!ctx) {
+        snprintf(logbuf, sizeof(logbuf), "[error] Unable to allocate memory\n");
+        logprint(logbuf);
+        return 0;
+    }
+
+    uint8_t *bytes = ctx->bytes;
+    int num_bytes = hex_decode(str, strlen(str), bytes, sizeof(ctx->bytes), false);
+    if (num_bytes < 1) {
+        snprintf(logbuf, sizeof(logbuf), "[error] Unable to parse payload bytes gate reply: \"%s\" | len: %zu\n", str, strlen(str));
+        logprint(logbuf);
+        return 0;
+    }
     
-    strcat(msg, ", \"battery\": ");
-    snprintf(buf, sizeof(buf), "%d", status.battery);
-    strcat(msg, buf);
+    /* Module ID goes first */
+    int moddatalen = num_bytes - 1;
+
+    uint8_t modid = bytes[0];
+    uint8_t *moddata = bytes + 1;
+
+    mqtt_msg_t *mqtt_msg = &ctx->values;
+    mqtt_msg_init(mqtt_msg);
     
-    char time[64];
-    struct timeval tv;
-    struct tm *tm;
-    gettimeofday(&tv, NULL);
-    tm = gmtime(&tv.tv_sec);
+    mqtt_status_t mqtt_status;           
+    mqtt_status.rssi = rssi;
+    mqtt_status.battery = 2000 + (50*(status & 0x1F));
+    mqtt_status.temperature = 20*(status >> 5) - 30;
     
-    strcat(msg, ", \"date\": ");
-    strftime(time, sizeof(time), "\"%FT%T.%%uZ\"", tm);
-    snprintf(buf, sizeof(buf), time, tv.tv_usec);
-    strcat(msg, buf);
+    if (modid == UNWDS_MODULE_NOT_FOUND) {
+        *topic = "device";
+        char mqtt_val[50];
+        snprintf(mqtt_val, 50, "module ID %d is not available", moddata[0]);
+        add_string_value(mqtt_msg, "error", mqtt_val);
+    } else {
+        if (!convert_to(modid, moddata, moddatalen, topic, mqtt_msg)) {
+            snprintf(logbuf, sizeof(logbuf), "[error] Unable to convert gate reply \"%s\" for module %d\n", str, modid);
+            logprint(logbuf);
+            return 0;
+        }
+    }
 
-    strcat(msg, " }}");
+    struct timeval now;
+    if (!rx_time) {
+        gettimeofday(&now, NULL);
+        rx_time = &now;
+    }
+
+    if (props) {
+        props->format = format;
+        props->uplink = true;
+        props->modid = modid;
+        props->rssi = rssi;
+        props->rx_time = *rx_time;
+    }
+
+    return build_mqtt_message(msg, mqtt_msg, mqtt_status, addr, rx_time, format);
+}
+
+#define NUM_MODULES (sizeof(unwds_modules_list)/sizeof(unwds_module_desc_t))
+
+/* Dispatch tables built from unwds_modules_list on first use */
+static const unwds_module_desc_t *modules_by_id[256];
+static const unwds_module_desc_t *modules_by_name[NUM_MODULES];
+static pthread_once_t modules_once = PTHREAD_ONCE_INIT;
+
+static int module_name_cmp(const void *a, const void *b)
+{
+    const unwds_module_desc_t *ma = *(const unwds_module_desc_t * const *)a;
+    const unwds_module_desc_t *mb = *(const unwds_module_desc_t * const *)b;
+    return strcmp(ma->name, mb->name);
+}
+
+static int module_name_find(const void *key, const void *elem)
+{
+    const unwds_module_desc_t *m = *(const unwds_module_desc_t * const *)elem;
+    return strcmp((const char *)key, m->name);
+}
+
+static void modules_init(void)
+{
+    char logbuf[100];
+    unsigned i;
+
+    for (i = 0; i < NUM_MODULES; i++) {
+        const unwds_module_desc_t *m = &unwds_modules_list[i];
+
+        /* First module with a decoder wins, as with the old linear search */
+        if (m->reply && !modules_by_id[m->id]) {
+            modules_by_id[m->id] = m;
+        } else if (m->reply) {
+            snprintf(logbuf, sizeof(logbuf), "[error] Module ID %d is used by both %s and %s\n",
+                     m->id, modules_by_id[m->id]->name, m->name);
+            logprint(logbuf);
+        }
+
+        modules_by_name[i] = m;
+    }
+
+    qsort(modules_by_name, NUM_MODULES, sizeof(modules_by_name[0]), module_name_cmp);
+
+    for (i = 1; i < NUM_MODULES; i++) {
+        if (!strcmp(modules_by_name[i - 1]->name, modules_by_name[i]->name)) {
+            snprintf(logbuf, sizeof(logbuf), "[error] Module name %s is used twice\n",
+                     modules_by_name[i]->name);
+            logprint(logbuf);
+        }
+    }
+}
+
+static const unwds_module_desc_t *module_by_name(const char *name)
+{
+    pthread_once(&modules_once, modules_init);
+
+    const unwds_module_desc_t **m = bsearch(name, modules_by_name, NUM_MODULES,
+                                            sizeof(modules_by_name[0]), module_name_find);
+    return m ? *m : NULL;
 }
 
 /**
  * Convert received data into MQTT topic and message
  */
-bool convert_to(uint8_t modid, uint8_t *moddata, int moddatalen, char *topic, mqtt_msg_t *mqtt_msg)
+bool convert_to(uint8_t modid, uint8_t *moddata, int moddatalen, const char **topic, mqtt_msg_t *mqtt_msg)
 {
-    int num_modules = sizeof(unwds_modules_list)/sizeof(unwds_module_desc_t);
-    
-    int i = 0;
-    for (i = 0; i<num_modules; i++) {
-        if (unwds_modules_list[i].id == modid) {
-            if (unwds_modules_list[i].reply) {
-                umdk_reply_ptr = unwds_modules_list[i].reply;
-                strcpy(topic, unwds_modules_list[i].name);
-                return umdk_reply_ptr(moddata, moddatalen, mqtt_msg);
-            }
-        }
+    pthread_once(&modules_once, modules_init);
+
+    const unwds_module_desc_t *m = modules_by_id[modid];
+    if (!m) {
+        return false;
     }
-    return false;
+
+    bool (*reply)(uint8_t*, int, mqtt_msg_t*) = m->reply;
+    *topic = m->name;
+    return reply(moddata, moddatalen, mqtt_msg);
 }
 
 /**
@@ -233,31 +888,21 @@ bool convert_to(uint8_t modid, uint8_t *moddata, int moddatalen, char *topic, mq
  */
 bool convert_from(char *type, char *param, char *out, int bufsize)
 {
-    int num_modules = sizeof(unwds_modules_list)/sizeof(unwds_module_desc_t);
-    
-    int i = 0;
-    for (i = 0; i<num_modules; i++) {
-        if (strcmp(type, unwds_modules_list[i].name) == 0) {
-            if (unwds_modules_list[i].cmd) {
-                umdk_command_ptr = unwds_modules_list[i].cmd;
-                /* first byte - two characters with ASCII HEX - is a module ID */
-                snprintf(out, 3, "%02x", unwds_modules_list[i].id);
-                /* the rest is data */
-                umdk_command_ptr(param, out + 2, bufsize);
-                return true;
-            }
-        }
+    const unwds_module_desc_t *m = module_by_name(type);
+    if (!m || !m->cmd) {
+        return false;
     }
-    return false;
+
+    void (*command)(char*, char*, int) = m->cmd;
+    /* first byte - two characters with ASCII HEX - is a module ID */
+    snprintf(out, 3, "%02x", m->id);
+    /* the rest is data */
+    command(param, out + 2, bufsize);
+    return true;
 }
 
 int unwds_modid_by_name(char *name) {
-    int i = 0;
-    for (i = 0; i < sizeof(unwds_modules_list)/sizeof(unwds_module_desc_t); i++) {
-        if (strcmp(name, unwds_modules_list[i].name) == 0) {
-            return unwds_modules_list[i].id;
-        }
-    }
+    const unwds_module_desc_t *m = module_by_name(name);
     
-    return -1;
+    return m ? m->id : -1;
 }
\ No newline at end of file
@@ -38,47 +38,139 @@
 #include <sys/time.h>
 
 #include "utils.h"
+#include "timestamp.h"
+#include "textbuf.h"
 
-bool hex_to_bytes(char *hexstr, uint8_t *bytes, bool reverse_order) {
-    return hex_to_bytesn(hexstr, strlen(hexstr), bytes, reverse_order);
+/* Nibble value of a hex character, 0xFF for anything else */
+static const uint8_t hex_table[256] = {
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+       0,    1,    2,    3,    4,    5,    6,    7,    8,    9, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF,   10,   11,   12,   13,   14,   15, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF,   10,   11,   12,   13,   14,   15, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+};
+
+static const char hex_chars[] = "0123456789ABCDEF";
+
+/*
+ * 16 characters at a time with GCC vector extensions, which compile to SSE2
+ * on x86 and NEON on ARM. Other targets (MIPS) only use the table.
+ */
+#if (defined(__SSE2__) || defined(__ARM_NEON)) && \
+    (__GNUC__ >= 9 || defined(__clang__)) && \
+    (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+#define HEX_DECODE_SIMD 1
+
+typedef uint8_t hex_u8x16_t __attribute__((vector_size(16)));
+typedef uint16_t hex_u16x8_t __attribute__((vector_size(16)));
+typedef uint8_t hex_u8x8_t __attribute__((vector_size(8)));
+
+static bool hex_decode16(const char *hexstr, uint8_t *bytes)
+{
+    hex_u8x16_t v;
+    memcpy(&v, hexstr, sizeof(v));
+
+    hex_u8x16_t digit = v - '0';
+    hex_u8x16_t alpha = (v | 0x20) - 'a';
+    hex_u8x16_t is_digit = (hex_u8x16_t)(digit <= 9);
+    hex_u8x16_t is_alpha = (hex_u8x16_t)(alpha <= 5);
+
+    uint64_t valid[2];
+    hex_u8x16_t ok = is_digit | is_alpha;
+    memcpy(valid, &ok, sizeof(valid));
+    if ((valid[0] & valid[1]) != UINT64_MAX) {
+        return false;
+    }
+
+    hex_u8x16_t nibbles = (digit & is_digit) | ((alpha + 10) & is_alpha);
+
+    /* Every 16-bit lane holds high nibble in the low byte and low nibble in the high one */
+    hex_u16x8_t pairs = (hex_u16x8_t)nibbles;
+    pairs = ((pairs << 4) & 0xF0) | (pairs >> 8);
+
+    hex_u8x8_t res = __builtin_convertvector(pairs, hex_u8x8_t);
+    memcpy(bytes, &res, sizeof(res));
+
+    return true;
 }
+#endif
 
-bool hex_to_bytesn(char *hexstr, int len, uint8_t *bytes, bool reverse_order) {
+int hex_decode(const char *hexstr, size_t len, uint8_t *bytes, size_t size, bool reverse_order) {
     /* Length must be even */
-    if (len % 2 != 0)
-        return false;
+    if (len % 2 != 0 || len / 2 > size) {
+        return -1;
+    }
 
-    /* Move in string by two characters */
-    char *ptr = &(*hexstr);
-    int i = 0;
-    if (reverse_order) {
-        ptr += len - 2;
+    size_t num_bytes = len / 2;
+    size_t i = 0;
 
-        for (; (len >> 1) - i; ptr -= 2) {
-            unsigned int v = 0;
-            sscanf(ptr, "%02x", &v);
+    if (reverse_order) {
+        const char *ptr = hexstr + len - 2;
+        for (; i < num_bytes; i++, ptr -= 2) {
+            uint8_t hi = hex_table[(uint8_t)ptr[0]];
+            uint8_t lo = hex_table[(uint8_t)ptr[1]];
+            if ((hi | lo) & 0xF0) {
+                return -1;
+            }
+            bytes[i] = (hi << 4) | lo;
+        }
+        return num_bytes;
+    }
 
-            bytes[i++] = (uint8_t) v;
+#ifdef HEX_DECODE_SIMD
+    for (; i + 8 <= num_bytes; i += 8) {
+        if (!hex_decode16(hexstr + 2 * i, bytes + i)) {
+            return -1;
         }
-    } else {
-        for (; *ptr; ptr += 2) {
-            unsigned int v = 0;
-            sscanf(ptr, "%02x", &v);
+    }
+#endif
 
-            bytes[i++] = (uint8_t) v;
+    for (; i < num_bytes; i++) {
+        uint8_t hi = hex_table[(uint8_t)hexstr[2 * i]];
+        uint8_t lo = hex_table[(uint8_t)hexstr[2 * i + 1]];
+        if ((hi | lo) & 0xF0) {
+            return -1;
         }
+        bytes[i] = (hi << 4) | lo;
     }
 
-    return true;
+    return num_bytes;
+}
+
+bool hex_to_bytes(char *hexstr, uint8_t *bytes, bool reverse_order) {
+    return hex_to_bytesn(hexstr, strlen(hexstr), bytes, reverse_order);
+}
+
+bool hex_to_bytesn(char *hexstr, int len, uint8_t *bytes, bool reverse_order) {
+    if (len < 0) {
+        return false;
+    }
+
+    return hex_decode(hexstr, len, bytes, len / 2, reverse_order) >= 0;
 }
 
 void bytes_to_hex(uint8_t *bytes, size_t num_bytes, char *str, bool reverse_order) {
+    /* Appends to what's already in str */
+    str += strlen(str);
+
     size_t i;
     for (i = 0; i < num_bytes; i++) {
-        char buf[3];
-        snprintf(buf, sizeof(buf), "%02X", bytes[(reverse_order) ? num_bytes - 1 - i : i]);
-        strcat(str, buf);
+        uint8_t b = bytes[(reverse_order) ? num_bytes - 1 - i : i];
+        *str++ = hex_chars[b >> 4];
+        *str++ = hex_chars[b & 0x0F];
     }
+    *str = '\0';
 }
 
 bool is_big_endian(void)
@@ -133,33 +225,25 @@ void uint16_to_le(uint16_t *num)
     }
 }
 
+uint64_t get_time_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
 void logprint(char *str)
 {
-    time_t t = time(NULL);
-    struct tm tm = *localtime(&t);
-    printf("[%02d:%02d:%02d]%s\n", tm.tm_hour, tm.tm_min, tm.tm_sec, str);
+    char ts[TIMESTAMP_LOG_LEN];
+    timestamp_log(time(NULL), ts, sizeof(ts));
+    printf("[%s]%s\n", ts, str);
     syslog(LOG_INFO, "%s", str);
 }
 
 void int_to_float_str(char *buf, int decimal, uint8_t precision) {  
-    int i = 0;
-    int divider = 1;
-    char format[10] = { };
-    char digits[3];
-    
-    if (decimal < 0) {
-        strcat(format, "-");
-    }
-    strcat(format, "%d.%0");
-    
-    for (i = 0; i<precision; i++) {
-        divider *= 10;
-    }
-
-    snprintf(digits, 3, "%dd", i);
-    strcat(format, digits);
-    
-    snprintf(buf, 50, format, abs(decimal/divider), abs(decimal%divider));
+    textbuf_t tb;
+    textbuf_init(&tb, buf, 50);
+    textbuf_append_fixed(&tb, decimal, precision);
 }
 
 bool is_number(char* str) {